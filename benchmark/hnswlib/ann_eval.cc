@@ -0,0 +1,502 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-27.
+//
+// recall and qps of hnsw configs on local data, in the spirit of
+// ann-benchmarks. reads fvecs/bvecs/ivecs or generates a synthetic set,
+// computes the ground truth with a flat index on all threads, then builds
+// one index per M and ef_construction and sweeps ef over the queries.
+//
+//   ann_eval --base=sift_base.fvecs --query=sift_query.fvecs --k=10 \
+//            --M=16,32 --ef_construction=200 --ef=10,20,40,80,160 --format=json
+//   ann_eval --synthetic=100000 --queries=1000 --dim=128 --output=result.csv
+//
+// flags:
+//   --base, --query       fvecs or bvecs files, bvecs are converted to float
+//   --ground_truth        ivecs with at least k neighbors per query, computed if unset
+//   --save_ground_truth   write the computed ground truth as ivecs
+//   --synthetic, --queries, --dim, --seed
+//                         uniform random data when no base file is given
+//   --max_base            use the first n base vectors only, 0 is all
+//   --metric              l2 or ip
+//   --k, --M, --ef_construction, --ef
+//                         lists are comma separated
+//   --threads             build and ground truth threads, 0 is all cpus
+//   --search_threads      threads running the queries, 1 by default
+//   --format, --output    csv or json, to a file or stdout
+#include <phekda/core/latency_histogram.h>
+#include <phekda/hnswlib/index.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+    struct Options {
+        std::string base;
+        std::string query;
+        std::string ground_truth;
+        std::string save_ground_truth;
+        std::string output;
+        std::string format{"csv"};
+        std::string metric{"l2"};
+        size_t synthetic{10000};
+        size_t queries{1000};
+        size_t dim{128};
+        size_t max_base{0};
+        uint32_t seed{47};
+        size_t k{10};
+        size_t threads{0};
+        size_t search_threads{1};
+        std::vector<size_t> M{16};
+        std::vector<size_t> ef_construction{200};
+        std::vector<size_t> ef{10, 20, 40, 80, 160, 320};
+    };
+
+    struct Dataset {
+        size_t n{0};
+        size_t dim{0};
+        std::vector<float> data;
+
+        const uint8_t *row(size_t i) const {
+            return reinterpret_cast<const uint8_t *>(data.data() + i * dim);
+        }
+    };
+
+    struct Row {
+        size_t M{0};
+        size_t ef_construction{0};
+        size_t ef{0};
+        double recall{0.0};
+        double qps{0.0};
+        phekda::HistogramSnapshot latency;
+        double build_seconds{0.0};
+        size_t memory_bytes{0};
+    };
+
+    bool ends_with(const std::string &s, const std::string &suffix) {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    turbo::Status parse_list(const std::string &value, std::vector<size_t> &out) {
+        out.clear();
+        std::stringstream ss(value);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            char *end = nullptr;
+            auto v = std::strtoull(item.c_str(), &end, 10);
+            if (item.empty() || *end != '\0') {
+                return turbo::invalid_argument_error("not a number list: " + value);
+            }
+            out.push_back(v);
+        }
+        if (out.empty()) {
+            return turbo::invalid_argument_error("empty list");
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status parse_options(int argc, char **argv, Options &options) {
+        std::map<std::string, std::string *> strings{
+                {"base", &options.base}, {"query", &options.query}, {"ground_truth", &options.ground_truth},
+                {"save_ground_truth", &options.save_ground_truth}, {"output", &options.output},
+                {"format", &options.format}, {"metric", &options.metric}};
+        std::map<std::string, size_t *> numbers{
+                {"synthetic", &options.synthetic}, {"queries", &options.queries}, {"dim", &options.dim},
+                {"max_base", &options.max_base}, {"k", &options.k}, {"threads", &options.threads},
+                {"search_threads", &options.search_threads}};
+        std::map<std::string, std::vector<size_t> *> lists{
+                {"M", &options.M}, {"ef_construction", &options.ef_construction}, {"ef", &options.ef}};
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            auto eq = arg.find('=');
+            if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+                return turbo::invalid_argument_error("expect --flag=value, got " + arg);
+            }
+            auto name = arg.substr(2, eq - 2);
+            auto value = arg.substr(eq + 1);
+            if (strings.count(name)) {
+                *strings[name] = value;
+            } else if (numbers.count(name)) {
+                std::vector<size_t> v;
+                auto rs = parse_list(value, v);
+                if (!rs.ok() || v.size() != 1) {
+                    return turbo::invalid_argument_error("--" + name + " expects a number");
+                }
+                *numbers[name] = v[0];
+            } else if (name == "seed") {
+                options.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+            } else if (lists.count(name)) {
+                auto rs = parse_list(value, *lists[name]);
+                if (!rs.ok()) {
+                    return rs;
+                }
+            } else {
+                return turbo::invalid_argument_error("unknown flag --" + name);
+            }
+        }
+        if (options.format != "csv" && options.format != "json") {
+            return turbo::invalid_argument_error("--format is csv or json");
+        }
+        if (options.metric != "l2" && options.metric != "ip") {
+            return turbo::invalid_argument_error("--metric is l2 or ip");
+        }
+        if (options.base.empty() != options.query.empty()) {
+            return turbo::invalid_argument_error("--base and --query go together");
+        }
+        if (options.k == 0 || options.search_threads == 0) {
+            return turbo::invalid_argument_error("--k and --search_threads must be positive");
+        }
+        if (options.threads == 0) {
+            options.threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+        return turbo::OkStatus();
+    }
+
+    // records of [int32 dim][dim x T], the texmex layout of fvecs, bvecs and ivecs
+    template<typename T>
+    turbo::Status read_vecs(const std::string &path, size_t max_n, size_t &n, size_t &dim, std::vector<T> &out) {
+        std::ifstream input(path, std::ios::binary);
+        if (!input) {
+            return turbo::not_found_error("cannot open " + path);
+        }
+        n = 0;
+        dim = 0;
+        out.clear();
+        int32_t d;
+        while (input.read(reinterpret_cast<char *>(&d), sizeof(d))) {
+            if (d <= 0 || (dim != 0 && static_cast<size_t>(d) != dim)) {
+                return turbo::data_loss_error("bad record dimension in " + path);
+            }
+            dim = d;
+            out.resize((n + 1) * dim);
+            if (!input.read(reinterpret_cast<char *>(out.data() + n * dim), dim * sizeof(T))) {
+                return turbo::data_loss_error("truncated record in " + path);
+            }
+            if (++n == max_n) {
+                break;
+            }
+        }
+        if (n == 0) {
+            return turbo::data_loss_error("no vectors in " + path);
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status read_dataset(const std::string &path, size_t max_n, Dataset &set) {
+        if (ends_with(path, ".fvecs")) {
+            return read_vecs<float>(path, max_n, set.n, set.dim, set.data);
+        }
+        if (ends_with(path, ".bvecs")) {
+            std::vector<uint8_t> bytes;
+            auto rs = read_vecs<uint8_t>(path, max_n, set.n, set.dim, bytes);
+            if (!rs.ok()) {
+                return rs;
+            }
+            set.data.assign(bytes.begin(), bytes.end());
+            return turbo::OkStatus();
+        }
+        return turbo::invalid_argument_error("expect a .fvecs or .bvecs file: " + path);
+    }
+
+    turbo::Status write_ivecs(const std::string &path, const std::vector<int32_t> &data, size_t dim) {
+        std::ofstream output(path, std::ios::binary);
+        if (!output) {
+            return turbo::internal_error("cannot write " + path);
+        }
+        auto d = static_cast<int32_t>(dim);
+        for (size_t i = 0; i < data.size(); i += dim) {
+            output.write(reinterpret_cast<const char *>(&d), sizeof(d));
+            output.write(reinterpret_cast<const char *>(data.data() + i), dim * sizeof(int32_t));
+        }
+        return output ? turbo::OkStatus() : turbo::internal_error("cannot write " + path);
+    }
+
+    Dataset synthetic(size_t n, size_t dim, uint32_t seed) {
+        Dataset set;
+        set.n = n;
+        set.dim = dim;
+        set.data.resize(n * dim);
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> distrib;
+        for (auto &v: set.data) {
+            v = distrib(rng);
+        }
+        return set;
+    }
+
+    // run fn(i) for i in [0, n) on threads workers
+    void parallel_for(size_t n, size_t threads, const std::function<void(size_t)> &fn) {
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < std::min(threads, n); ++t) {
+            workers.emplace_back([&] {
+                for (size_t i = next++; i < n; i = next++) {
+                    fn(i);
+                }
+            });
+        }
+        for (auto &worker: workers) {
+            worker.join();
+        }
+    }
+
+    phekda::IndexConfig index_config(const Options &options, const Dataset &base, phekda::IndexType type,
+                                     size_t M, size_t ef_construction) {
+        phekda::HnswlibConfig config;
+        config.M = M;
+        config.ef_construction = ef_construction;
+        phekda::IndexConfig conf;
+        conf.with_dimension(base.dim)
+                .with_metric(options.metric == "ip" ? phekda::MetricType::METRIC_IP : phekda::MetricType::METRIC_L2)
+                .with_data_type(phekda::DataType::FLOAT32)
+                .with_max_elements(base.n)
+                .with_index(config);
+        conf.core.index_type = type;
+        return conf;
+    }
+
+    turbo::Status add_all(phekda::HnswIndex &index, const Dataset &base, size_t threads) {
+        std::atomic<bool> failed{false};
+        parallel_for(base.n, threads, [&](size_t i) {
+            if (!index.add_vector(base.row(i), i, {}).ok()) {
+                failed = true;
+            }
+        });
+        return failed ? turbo::internal_error("add_vector failed") : turbo::OkStatus();
+    }
+
+    // exact k nearest neighbors of every query, row major nq x k
+    turbo::Status ground_truth(const Options &options, const Dataset &base, const Dataset &queries,
+                               std::vector<int32_t> &truth) {
+        phekda::HnswIndex flat;
+        auto rs = flat.initialize(index_config(options, base, phekda::IndexType::INDEX_HNSW_FLAT, 16, 200));
+        if (!rs.ok()) {
+            return rs;
+        }
+        rs = add_all(flat, base, options.threads);
+        if (!rs.ok()) {
+            return rs;
+        }
+        truth.assign(queries.n * options.k, -1);
+        std::atomic<bool> failed{false};
+        parallel_for(queries.n, options.threads, [&](size_t q) {
+            auto context = flat.create_search_context();
+            context.with_top_k(options.k).with_query(queries.row(q));
+            if (!flat.search(context).ok()) {
+                failed = true;
+                return;
+            }
+            for (size_t i = 0; i < context.results.size(); ++i) {
+                truth[q * options.k + i] = static_cast<int32_t>(context.results[i].label);
+            }
+        });
+        return failed ? turbo::internal_error("flat search failed") : turbo::OkStatus();
+    }
+
+    turbo::Status load_ground_truth(const Options &options, size_t nq, std::vector<int32_t> &truth) {
+        size_t n, dim;
+        std::vector<int32_t> raw;
+        auto rs = read_vecs<int32_t>(options.ground_truth, nq, n, dim, raw);
+        if (!rs.ok()) {
+            return rs;
+        }
+        if (n < nq || dim < options.k) {
+            return turbo::invalid_argument_error("ground truth has fewer queries or neighbors than needed");
+        }
+        // keep the first k of each row
+        truth.resize(nq * options.k);
+        for (size_t q = 0; q < nq; ++q) {
+            std::copy_n(raw.begin() + q * dim, options.k, truth.begin() + q * options.k);
+        }
+        return turbo::OkStatus();
+    }
+
+    // recall@k and latency of one ef over all queries
+    turbo::Status sweep_ef(const Options &options, phekda::HnswIndex &index, const Dataset &queries,
+                           const std::vector<int32_t> &truth, size_t ef, Row &row) {
+        phekda::LatencyHistogram latency;
+        std::atomic<size_t> hits{0};
+        std::atomic<bool> failed{false};
+        auto start = turbo::Time::current_time();
+        parallel_for(queries.n, options.search_threads, [&](size_t q) {
+            auto context = index.create_search_context();
+            context.with_top_k(options.k).with_search_list_size(ef).with_query(queries.row(q));
+            auto begin = turbo::Time::current_time();
+            if (!index.search(context).ok()) {
+                failed = true;
+                return;
+            }
+            latency.record(turbo::Time::current_time() - begin);
+            std::unordered_set<int32_t> expected(truth.begin() + q * options.k, truth.begin() + (q + 1) * options.k);
+            size_t found = 0;
+            for (auto &r: context.results) {
+                found += expected.count(static_cast<int32_t>(r.label));
+            }
+            hits += found;
+        });
+        if (failed) {
+            return turbo::internal_error("search failed");
+        }
+        auto seconds = (turbo::Time::current_time() - start).to_seconds();
+        row.ef = ef;
+        row.recall = static_cast<double>(hits) / static_cast<double>(queries.n * options.k);
+        row.qps = seconds > 0 ? static_cast<double>(queries.n) / seconds : 0.0;
+        row.latency = latency.snapshot();
+        return turbo::OkStatus();
+    }
+
+    void write_rows(const Options &options, const std::string &dataset, const Dataset &base,
+                    const std::vector<Row> &rows, std::ostream &out) {
+        auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+        if (options.format == "csv") {
+            out << "dataset,n,dim,k,M,ef_construction,ef,recall,qps,mean_us,p50_us,p99_us,build_s,memory_bytes\n";
+            for (auto &r: rows) {
+                out << dataset << ',' << base.n << ',' << base.dim << ',' << options.k << ',' << r.M << ','
+                    << r.ef_construction << ',' << r.ef << ',' << r.recall << ',' << r.qps << ','
+                    << r.latency.mean() / 1000.0 << ',' << us(r.latency.p50) << ',' << us(r.latency.p99) << ','
+                    << r.build_seconds << ',' << r.memory_bytes << '\n';
+            }
+            return;
+        }
+        out << "[\n";
+        for (size_t i = 0; i < rows.size(); ++i) {
+            auto &r = rows[i];
+            out << "  {\"dataset\": \"" << dataset << "\", \"n\": " << base.n << ", \"dim\": " << base.dim
+                << ", \"k\": " << options.k << ", \"M\": " << r.M << ", \"ef_construction\": " << r.ef_construction
+                << ", \"ef\": " << r.ef << ", \"recall\": " << r.recall << ", \"qps\": " << r.qps
+                << ", \"mean_us\": " << r.latency.mean() / 1000.0 << ", \"p50_us\": " << us(r.latency.p50)
+                << ", \"p99_us\": " << us(r.latency.p99) << ", \"build_s\": " << r.build_seconds
+                << ", \"memory_bytes\": " << r.memory_bytes << "}" << (i + 1 < rows.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+    }
+
+    turbo::Status run(const Options &options) {
+        Dataset base;
+        Dataset queries;
+        std::string dataset;
+        if (options.base.empty()) {
+            base = synthetic(options.synthetic, options.dim, options.seed);
+            queries = synthetic(options.queries, options.dim, options.seed + 1);
+            dataset = "synthetic";
+        } else {
+            auto rs = read_dataset(options.base, options.max_base, base);
+            if (!rs.ok()) {
+                return rs;
+            }
+            rs = read_dataset(options.query, 0, queries);
+            if (!rs.ok()) {
+                return rs;
+            }
+            if (queries.dim != base.dim) {
+                return turbo::invalid_argument_error("base and query dimensions differ");
+            }
+            dataset = options.base.substr(options.base.find_last_of('/') + 1);
+        }
+        if (options.k > base.n) {
+            return turbo::invalid_argument_error("k is larger than the base set");
+        }
+        std::cerr << dataset << ": " << base.n << " base, " << queries.n << " queries, dim " << base.dim << std::endl;
+
+        std::vector<int32_t> truth;
+        auto start = turbo::Time::current_time();
+        // a ground truth file only matches the full base set
+        bool load_truth = !options.ground_truth.empty() && options.max_base == 0;
+        auto rs = load_truth ? load_ground_truth(options, queries.n, truth) : ground_truth(options, base, queries, truth);
+        if (!rs.ok()) {
+            return rs;
+        }
+        std::cerr << "ground truth: " << (turbo::Time::current_time() - start).to_seconds() << "s" << std::endl;
+        if (!load_truth && !options.save_ground_truth.empty()) {
+            rs = write_ivecs(options.save_ground_truth, truth, options.k);
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+
+        std::vector<Row> rows;
+        for (auto M: options.M) {
+            for (auto ef_construction: options.ef_construction) {
+                phekda::HnswIndex index;
+                rs = index.initialize(index_config(options, base, phekda::IndexType::INDEX_HNSWLIB, M, ef_construction));
+                if (!rs.ok()) {
+                    return rs;
+                }
+                start = turbo::Time::current_time();
+                rs = add_all(index, base, options.threads);
+                if (!rs.ok()) {
+                    return rs;
+                }
+                Row row;
+                row.M = M;
+                row.ef_construction = ef_construction;
+                row.build_seconds = (turbo::Time::current_time() - start).to_seconds();
+                auto metrics = index.metrics();
+                row.memory_bytes = metrics.ok() ? metrics.value().memory_bytes : 0;
+                std::cerr << "M " << M << " ef_construction " << ef_construction << ": built in "
+                          << row.build_seconds << "s" << std::endl;
+                for (auto ef: options.ef) {
+                    rs = sweep_ef(options, index, queries, truth, ef, row);
+                    if (!rs.ok()) {
+                        return rs;
+                    }
+                    rows.push_back(row);
+                }
+            }
+        }
+
+        if (options.output.empty()) {
+            write_rows(options, dataset, base, rows, std::cout);
+            return turbo::OkStatus();
+        }
+        std::ofstream out(options.output);
+        if (!out) {
+            return turbo::internal_error("cannot write " + options.output);
+        }
+        write_rows(options, dataset, base, rows, out);
+        return turbo::OkStatus();
+    }
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    auto rs = parse_options(argc, argv, options);
+    if (rs.ok()) {
+        rs = run(options);
+    }
+    if (!rs.ok()) {
+        std::cerr << "ann_eval: " << rs.message() << std::endl;
+        return 1;
+    }
+    return 0;
+}
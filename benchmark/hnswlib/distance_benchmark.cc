@@ -0,0 +1,167 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-27.
+//
+// every distance kernel over a range of dimensions, plus the kernel each
+// space picks for the dimension. pairs rotate over a small pool of vectors
+// so the loads are not all the same cache lines. args: dimension
+#include "synthetic_data.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+    constexpr size_t kPool = 256;
+
+    template<typename T>
+    using Kernel = T (*)(const void *, const void *, const void *);
+
+    // uint8 vectors for the integer kernels
+    std::vector<uint8_t> random_bytes(size_t n) {
+        std::mt19937 rng(47);
+        std::uniform_int_distribution<int> distrib(0, 255);
+        std::vector<uint8_t> data(n);
+        for (auto &v: data) {
+            v = static_cast<uint8_t>(distrib(rng));
+        }
+        return data;
+    }
+
+    template<typename T, typename E>
+    void run_kernel(benchmark::State &state, Kernel<T> kernel, const E *data, size_t dim) {
+        size_t i = 0;
+        for (auto _: state) {
+            const E *a = data + (i % kPool) * dim;
+            const E *b = data + ((i + 1) % kPool) * dim;
+            benchmark::DoNotOptimize(kernel(a, b, &dim));
+            ++i;
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * 2 * dim * sizeof(E)));
+    }
+
+    void BM_float_kernel(benchmark::State &state, Kernel<float> kernel, bool supported) {
+        if (!supported) {
+            state.SkipWithError("kernel not supported by the cpu");
+            return;
+        }
+        size_t dim = state.range(0);
+        auto data = phekda::bench::random_vectors(kPool, dim);
+        run_kernel(state, kernel, data.data(), dim);
+    }
+
+    void BM_int_kernel(benchmark::State &state, Kernel<int> kernel) {
+        size_t dim = state.range(0);
+        auto data = random_bytes(kPool * dim);
+        run_kernel(state, kernel, data.data(), dim);
+    }
+
+    // the kernel the index really uses for the dimension
+    template<typename Space>
+    void BM_space(benchmark::State &state) {
+        size_t dim = state.range(0);
+        Space space(dim);
+        auto data = phekda::bench::random_vectors(kPool, dim);
+        run_kernel(state, space.get_dist_func(), data.data(), dim);
+    }
+
+    void BM_space_int(benchmark::State &state) {
+        size_t dim = state.range(0);
+        phekda::L2SpaceI space(dim);
+        auto data = random_bytes(kPool * dim);
+        run_kernel(state, space.get_dist_func(), data.data(), dim);
+    }
+
+    // all dimensions, the multiples of 16 and 4, and the residual cases
+    void all_dims(benchmark::internal::Benchmark *b) {
+        for (int dim: {4, 7, 16, 17, 32, 50, 64, 100, 128, 200, 256, 384, 768, 960, 1536}) {
+            b->Arg(dim);
+        }
+    }
+
+    void dims16(benchmark::internal::Benchmark *b) {
+        for (int dim: {16, 32, 64, 128, 256, 384, 768, 960, 1536}) {
+            b->Arg(dim);
+        }
+    }
+
+    void dims4(benchmark::internal::Benchmark *b) {
+        for (int dim: {4, 20, 36, 100, 132, 196, 772}) {
+            b->Arg(dim);
+        }
+    }
+
+    void residual_dims16(benchmark::internal::Benchmark *b) {
+        for (int dim: {17, 50, 101, 129, 200, 777}) {
+            b->Arg(dim);
+        }
+    }
+
+    void residual_dims4(benchmark::internal::Benchmark *b) {
+        for (int dim: {5, 7, 9, 13, 15}) {
+            b->Arg(dim);
+        }
+    }
+
+}  // namespace
+
+BENCHMARK_CAPTURE(BM_float_kernel, L2Sqr, phekda::L2Sqr, true)->Apply(all_dims);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistance, phekda::InnerProductDistance, true)->Apply(all_dims);
+BENCHMARK_CAPTURE(BM_int_kernel, L2SqrI, phekda::L2SqrI)->Apply(all_dims);
+BENCHMARK_CAPTURE(BM_int_kernel, L2SqrI4x, phekda::L2SqrI4x)->Apply(dims4);
+
+#if defined(USE_SSE)
+BENCHMARK_CAPTURE(BM_float_kernel, L2SqrSIMD16ExtSSE, phekda::L2SqrSIMD16ExtSSE, true)->Apply(dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, L2SqrSIMD4Ext, phekda::L2SqrSIMD4Ext, true)->Apply(dims4);
+BENCHMARK_CAPTURE(BM_float_kernel, L2SqrSIMD4ExtResiduals, phekda::L2SqrSIMD4ExtResiduals, true)
+        ->Apply(residual_dims4);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD16ExtSSE, phekda::InnerProductDistanceSIMD16ExtSSE, true)
+        ->Apply(dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD4ExtSSE, phekda::InnerProductDistanceSIMD4ExtSSE, true)
+        ->Apply(dims4);
+#endif
+
+#if defined(USE_SSE) || defined(USE_AVX) || defined(USE_AVX512)
+// dispatched to the widest 16 wide kernel the cpu has, see the space constructors
+BENCHMARK_CAPTURE(BM_float_kernel, L2SqrSIMD16ExtResiduals, phekda::L2SqrSIMD16ExtResiduals, true)
+        ->Apply(residual_dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD16ExtResiduals,
+                  phekda::InnerProductDistanceSIMD16ExtResiduals, true)->Apply(residual_dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD4ExtResiduals,
+                  phekda::InnerProductDistanceSIMD4ExtResiduals, true)->Apply(residual_dims4);
+#endif
+
+#if defined(USE_AVX)
+BENCHMARK_CAPTURE(BM_float_kernel, L2SqrSIMD16ExtAVX, phekda::L2SqrSIMD16ExtAVX, AVXCapable())
+        ->Apply(dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD16ExtAVX, phekda::InnerProductDistanceSIMD16ExtAVX,
+                  AVXCapable())->Apply(dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD4ExtAVX, phekda::InnerProductDistanceSIMD4ExtAVX,
+                  AVXCapable())->Apply(dims4);
+#endif
+
+#if defined(USE_AVX512)
+BENCHMARK_CAPTURE(BM_float_kernel, L2SqrSIMD16ExtAVX512, phekda::L2SqrSIMD16ExtAVX512, AVX512Capable())
+        ->Apply(dims16);
+BENCHMARK_CAPTURE(BM_float_kernel, InnerProductDistanceSIMD16ExtAVX512,
+                  phekda::InnerProductDistanceSIMD16ExtAVX512, AVX512Capable())->Apply(dims16);
+#endif
+
+BENCHMARK_TEMPLATE(BM_space, phekda::L2Space)->Apply(all_dims);
+BENCHMARK_TEMPLATE(BM_space, phekda::InnerProductSpace)->Apply(all_dims);
+BENCHMARK(BM_space_int)->Apply(all_dims);
@@ -0,0 +1,93 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-27.
+//
+// filter checks on their own and inside a search, a fraction of the labels
+// is excluded. args: excluded per mille
+#include "synthetic_data.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+    constexpr size_t kElements = 20000;
+    constexpr size_t kDim = 64;
+    constexpr size_t kQueries = 1000;
+
+    std::unique_ptr<phekda::BitmapCondition> make_condition(size_t per_mille) {
+        auto condition = std::make_unique<phekda::BitmapCondition>();
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<size_t> distrib(0, 999);
+        for (phekda::LabelType label = 0; label < kElements; ++label) {
+            if (distrib(rng) < per_mille) {
+                (void) condition->exclude(label);
+            }
+        }
+        return condition;
+    }
+
+    void BM_is_exclude(benchmark::State &state) {
+        auto condition = make_condition(state.range(0));
+        // through the base class, as the search calls it
+        const phekda::SearchCondition *base = condition.get();
+        // scattered labels as a graph walk sees them
+        std::mt19937 rng(47);
+        std::vector<phekda::LabelType> labels(4096);
+        for (auto &label: labels) {
+            label = rng() % kElements;
+        }
+        size_t i = 0;
+        for (auto _: state) {
+            benchmark::DoNotOptimize(base->is_exclude(labels[i++ % labels.size()]));
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    }
+
+    struct Fixture {
+        std::vector<float> data;
+        std::unique_ptr<phekda::HnswIndex> index;
+    };
+
+    Fixture &get_fixture() {
+        static std::unique_ptr<Fixture> fixture;
+        if (!fixture) {
+            fixture = std::make_unique<Fixture>();
+            fixture->data = phekda::bench::random_vectors(kElements + kQueries, kDim);
+            fixture->index = phekda::bench::build_index(fixture->data, kElements, kDim, kElements);
+        }
+        return *fixture;
+    }
+
+    void BM_filtered_search(benchmark::State &state) {
+        auto &fixture = get_fixture();
+        auto condition = make_condition(state.range(0));
+        auto context = fixture.index->create_search_context();
+        context.with_top_k(10).with_condition(state.range(0) > 0 ? condition.get() : nullptr);
+        size_t q = 0;
+        for (auto _: state) {
+            auto query = fixture.data.data() + (kElements + q++ % kQueries) * kDim;
+            context.with_query(reinterpret_cast<const uint8_t *>(query));
+            benchmark::DoNotOptimize(fixture.index->search(context));
+        }
+        state.counters["qps"] = benchmark::Counter(static_cast<double>(q), benchmark::Counter::kIsRate);
+    }
+
+}  // namespace
+
+BENCHMARK(BM_is_exclude)->Arg(0)->Arg(10)->Arg(100)->Arg(500)->Arg(900);
+BENCHMARK(BM_filtered_search)->Arg(0)->Arg(10)->Arg(100)->Arg(500)->Arg(900)->Unit(benchmark::kMicrosecond);
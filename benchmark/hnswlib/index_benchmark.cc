@@ -0,0 +1,96 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-27.
+//
+// single query search and single vector insert at several index sizes.
+// args: index size, dimension
+#include "synthetic_data.h"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <utility>
+
+namespace {
+
+    constexpr size_t kQueries = 1000;
+
+    struct Fixture {
+        std::vector<float> data;
+        std::unique_ptr<phekda::HnswIndex> index;
+    };
+
+    Fixture &get_fixture(size_t n, size_t dim) {
+        static std::map<std::pair<size_t, size_t>, std::unique_ptr<Fixture>> fixtures;
+        auto &fixture = fixtures[{n, dim}];
+        if (!fixture) {
+            fixture = std::make_unique<Fixture>();
+            fixture->data = phekda::bench::random_vectors(n + kQueries, dim);
+            fixture->index = phekda::bench::build_index(fixture->data, n, dim, n);
+        }
+        return *fixture;
+    }
+
+    void BM_search(benchmark::State &state) {
+        size_t n = state.range(0);
+        size_t dim = state.range(1);
+        auto &fixture = get_fixture(n, dim);
+        auto context = fixture.index->create_search_context();
+        context.with_top_k(10);
+        size_t q = 0;
+        for (auto _: state) {
+            auto query = fixture.data.data() + (n + q++ % kQueries) * dim;
+            context.with_query(reinterpret_cast<const uint8_t *>(query));
+            benchmark::DoNotOptimize(fixture.index->search(context));
+        }
+        state.counters["qps"] = benchmark::Counter(static_cast<double>(q), benchmark::Counter::kIsRate);
+    }
+
+    // inserts into an index already holding n vectors, rebuilt off the clock
+    // when the batch of new labels is used up
+    void BM_insert(benchmark::State &state) {
+        constexpr size_t kBatch = 1000;
+        size_t n = state.range(0);
+        size_t dim = state.range(1);
+        auto data = phekda::bench::random_vectors(n + kBatch, dim);
+        std::unique_ptr<phekda::HnswIndex> index;
+        size_t i = kBatch;
+        for (auto _: state) {
+            if (i == kBatch) {
+                state.PauseTiming();
+                index = phekda::bench::build_index(data, n, dim, n + kBatch);
+                i = 0;
+                state.ResumeTiming();
+            }
+            auto vec = reinterpret_cast<const uint8_t *>(data.data() + (n + i) * dim);
+            benchmark::DoNotOptimize(index->add_vector(vec, n + i, {}));
+            ++i;
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    }
+
+}  // namespace
+
+BENCHMARK(BM_search)
+        ->ArgNames({"size", "dim"})
+        ->ArgsProduct({{1000, 10000, 100000}, {32, 128}})
+        ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_insert)
+        ->ArgNames({"size", "dim"})
+        ->ArgsProduct({{1000, 10000, 100000}, {32, 128}})
+        ->Iterations(1000)
+        ->Unit(benchmark::kMicrosecond);
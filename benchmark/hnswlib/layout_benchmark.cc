@@ -0,0 +1,113 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+// packed vs cache line aligned vs split element layout, reports graph hops
+// per second. args: alignment (0 is packed), dimension, split layout
+#include <phekda/hnswlib/index.h>
+#include <benchmark/benchmark.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+    constexpr size_t kElements = 50000;
+    constexpr size_t kQueries = 1000;
+
+    struct Fixture {
+        std::unique_ptr<phekda::L2Space> space;
+        phekda::HierarchicalNSW alg;
+        std::vector<float> queries;
+    };
+
+    Fixture &get_fixture(size_t alignment, size_t dim, bool split) {
+        static std::map<std::tuple<size_t, size_t, bool>, std::unique_ptr<Fixture>> fixtures;
+        auto &fixture = fixtures[{alignment, dim, split}];
+        if (fixture) {
+            return *fixture;
+        }
+        fixture = std::make_unique<Fixture>();
+        fixture->space = std::make_unique<phekda::L2Space>(dim);
+        phekda::CoreConfig core_config;
+        core_config.max_elements = kElements;
+        core_config.dimension = dim;
+        core_config.data = phekda::DataType::FLOAT32;
+        core_config.metric = phekda::MetricType::METRIC_L2;
+        core_config.index_type = phekda::IndexType::INDEX_HNSWLIB;
+        phekda::HnswlibConfig config;
+        config.M = 16;
+        config.ef_construction = 100;
+        config.alignment = alignment;
+        config.split_layout = split;
+        config.space = fixture->space.get();
+        auto rs = fixture->alg.initialize(core_config, config);
+        if (!rs.ok()) {
+            std::abort();
+        }
+
+        // same data for every layout
+        std::mt19937 rng(47);
+        std::uniform_real_distribution<float> distrib;
+        std::vector<float> vec(dim);
+        for (size_t i = 0; i < kElements; ++i) {
+            for (auto &v: vec) {
+                v = distrib(rng);
+            }
+            fixture->alg.addPoint(vec.data(), i, phekda::kHnswNotReplaceDeleted);
+        }
+        fixture->queries.resize(kQueries * dim);
+        for (auto &v: fixture->queries) {
+            v = distrib(rng);
+        }
+        return *fixture;
+    }
+
+    void BM_SearchLayout(benchmark::State &state) {
+        size_t alignment = state.range(0);
+        size_t dim = state.range(1);
+        auto &fixture = get_fixture(alignment, dim, state.range(2));
+        fixture.alg.setEf(64);
+        auto begin = fixture.alg.getSearchStats();
+        size_t q = 0;
+        for (auto _: state) {
+            auto res = fixture.alg.searchKnn(fixture.queries.data() + q * dim, 10);
+            benchmark::DoNotOptimize(res);
+            q = (q + 1) % kQueries;
+        }
+        auto end = fixture.alg.getSearchStats();
+        state.counters["hops"] = benchmark::Counter(double(end.hops - begin.hops), benchmark::Counter::kIsRate);
+        state.counters["distances"] = benchmark::Counter(double(end.distance_computations - begin.distance_computations),
+                                                         benchmark::Counter::kIsRate);
+        state.counters["stride"] = double(fixture.alg.size_data_per_element_);
+    }
+
+}  // namespace
+
+BENCHMARK(BM_SearchLayout)
+        ->ArgNames({"alignment", "dim", "split"})
+        ->Args({0, 100, 0})
+        ->Args({64, 100, 0})
+        ->Args({0, 100, 1})
+        ->Args({64, 100, 1})
+        ->Args({0, 128, 0})
+        ->Args({64, 128, 0})
+        ->Args({64, 128, 1});
@@ -0,0 +1,127 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-28.
+//
+// concurrent search, add_vector and lazy_delete against one HnswIndex, the
+// mix production sees. reports search latency percentiles and write
+// throughput, so contention on the label, global and link list locks shows
+// up as numbers. args: search, insert and delete percent of the operations
+#include "synthetic_data.h"
+#include <phekda/core/latency_histogram.h>
+#include <benchmark/benchmark.h>
+#include <atomic>
+
+namespace {
+
+    constexpr size_t kElements = 20000;
+    constexpr size_t kDim = 64;
+    // fresh vectors for the inserts and the queries, reused round robin
+    constexpr size_t kPool = 20000;
+
+    struct Shared {
+        std::vector<float> data;
+        std::unique_ptr<phekda::HnswIndex> index;
+        std::atomic<phekda::LabelType> next_label{0};
+        phekda::LatencyHistogram search;
+        phekda::LatencyHistogram insert;
+        phekda::LatencyHistogram remove;
+    };
+
+    std::unique_ptr<Shared> shared;
+
+    void setup() {
+        shared = std::make_unique<Shared>();
+        shared->data = phekda::bench::random_vectors(kElements + kPool, kDim);
+        auto conf = phekda::bench::hnsw_config(kDim, kElements);
+        conf.with_auto_grow(true);
+        shared->index = std::make_unique<phekda::HnswIndex>();
+        if (!shared->index->initialize(conf).ok()) {
+            std::abort();
+        }
+        for (size_t i = 0; i < kElements; ++i) {
+            if (!shared->index->add_vector(reinterpret_cast<const uint8_t *>(shared->data.data() + i * kDim), i,
+                                           {}).ok()) {
+                std::abort();
+            }
+        }
+        shared->next_label = kElements;
+    }
+
+    void BM_mixed(benchmark::State &state) {
+        if (state.thread_index() == 0) {
+            setup();
+        }
+        int search_pct = static_cast<int>(state.range(0));
+        int insert_pct = static_cast<int>(state.range(1));
+        std::mt19937 rng(47 + state.thread_index());
+        std::uniform_int_distribution<int> pick(0, 99);
+        size_t searches = 0;
+        size_t writes = 0;
+        for (auto _: state) {
+            auto &s = *shared;
+            int op = pick(rng);
+            const float *vec = s.data.data() + (kElements + rng() % kPool) * kDim;
+            auto start = turbo::Time::current_time();
+            if (op < search_pct) {
+                auto context = s.index->create_search_context();
+                context.with_top_k(10).with_query(reinterpret_cast<const uint8_t *>(vec));
+                benchmark::DoNotOptimize(s.index->search(context));
+                s.search.record(turbo::Time::current_time() - start);
+                ++searches;
+            } else if (op < search_pct + insert_pct) {
+                auto label = s.next_label.fetch_add(1, std::memory_order_relaxed);
+                benchmark::DoNotOptimize(s.index->add_vector(reinterpret_cast<const uint8_t *>(vec), label, {}));
+                s.insert.record(turbo::Time::current_time() - start);
+                ++writes;
+            } else {
+                // may hit a label already deleted, the lookup still contends
+                auto label = rng() % s.next_label.load(std::memory_order_relaxed);
+                benchmark::DoNotOptimize(s.index->lazy_delete(label));
+                s.remove.record(turbo::Time::current_time() - start);
+                ++writes;
+            }
+        }
+        state.counters["searches"] = benchmark::Counter(static_cast<double>(searches), benchmark::Counter::kIsRate);
+        state.counters["writes"] = benchmark::Counter(static_cast<double>(writes), benchmark::Counter::kIsRate);
+        if (state.thread_index() == 0) {
+            // counters of all threads are summed, only the first reports the shared ones
+            auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+            auto search = shared->search.snapshot();
+            state.counters["search_p50_us"] = us(search.p50);
+            state.counters["search_p99_us"] = us(search.p99);
+            state.counters["search_p999_us"] = us(search.p999);
+            auto insert = shared->insert.snapshot();
+            state.counters["insert_p99_us"] = us(insert.p99);
+            auto remove = shared->remove.snapshot();
+            state.counters["delete_p99_us"] = us(remove.p99);
+        }
+    }
+
+}  // namespace
+
+BENCHMARK(BM_mixed)
+        ->ArgNames({"search", "insert", "delete"})
+        ->Args({100, 0, 0})
+        ->Args({95, 4, 1})
+        ->Args({80, 15, 5})
+        ->Args({50, 40, 10})
+        ->ThreadRange(1, 16)
+        ->UseRealTime()
+        ->MinTime(1.0)
+        ->Unit(benchmark::kMicrosecond);
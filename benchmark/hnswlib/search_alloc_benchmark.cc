@@ -0,0 +1,123 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-24.
+//
+// heap allocations and latency of a steady state search, reports allocs
+// per query. args: top k
+#include <phekda/hnswlib/index.h>
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+namespace {
+    std::atomic<size_t> allocations{0};
+}  // namespace
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace {
+
+    constexpr size_t kElements = 20000;
+    constexpr size_t kDim = 64;
+    constexpr size_t kQueries = 1000;
+
+    struct Fixture {
+        phekda::HnswIndex index;
+        std::vector<float> data;
+    };
+
+    Fixture &get_fixture() {
+        static std::unique_ptr<Fixture> fixture;
+        if (fixture) {
+            return *fixture;
+        }
+        fixture = std::make_unique<Fixture>();
+        std::mt19937 rng(47);
+        std::uniform_real_distribution<float> distrib;
+        fixture->data.resize((kElements + kQueries) * kDim);
+        for (auto &v: fixture->data) {
+            v = distrib(rng);
+        }
+        phekda::HnswlibConfig config;
+        config.M = 16;
+        config.ef_construction = 100;
+        phekda::IndexConfig conf;
+        conf.with_dimension(kDim)
+                .with_metric(phekda::MetricType::METRIC_L2)
+                .with_data_type(phekda::DataType::FLOAT32)
+                .with_max_elements(kElements)
+                .with_index(config);
+        conf.core.index_type = phekda::IndexType::INDEX_HNSWLIB;
+        if (!fixture->index.initialize(conf).ok()) {
+            std::abort();
+        }
+        for (size_t i = 0; i < kElements; ++i) {
+            auto vec = reinterpret_cast<const uint8_t *>(fixture->data.data() + i * kDim);
+            if (!fixture->index.add_vector(vec, i, {}).ok()) {
+                std::abort();
+            }
+        }
+        return *fixture;
+    }
+
+    const uint8_t *query(Fixture &fixture, size_t q) {
+        return reinterpret_cast<const uint8_t *>(fixture.data.data() + (kElements + q % kQueries) * kDim);
+    }
+
+    void BM_search(benchmark::State &state) {
+        auto &fixture = get_fixture();
+        auto context = fixture.index.create_search_context();
+        context.with_top_k(state.range(0));
+        // warm up the scratch pools and the result vector
+        for (size_t q = 0; q < 10; ++q) {
+            context.with_query(query(fixture, q));
+            (void) fixture.index.search(context);
+        }
+        size_t q = 0;
+        size_t before = allocations.load(std::memory_order_relaxed);
+        for (auto _: state) {
+            context.with_query(query(fixture, q++));
+            benchmark::DoNotOptimize(fixture.index.search(context));
+        }
+        size_t allocs = allocations.load(std::memory_order_relaxed) - before;
+        state.counters["allocs_per_query"] = static_cast<double>(allocs) / static_cast<double>(q);
+        state.counters["qps"] = benchmark::Counter(static_cast<double>(q), benchmark::Counter::kIsRate);
+    }
+
+    BENCHMARK(BM_search)->Arg(1)->Arg(10)->Arg(100)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
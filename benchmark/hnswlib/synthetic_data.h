@@ -0,0 +1,74 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-27.
+//
+// synthetic datasets shared by the benchmarks, generated with a fixed seed
+// so runs compare against each other
+#pragma once
+
+#include <phekda/hnswlib/index.h>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace phekda {
+    namespace bench {
+
+        // n vectors of dim uniform floats in [0, 1)
+        inline std::vector<float> random_vectors(size_t n, size_t dim, uint32_t seed = 47) {
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> distrib;
+            std::vector<float> data(n * dim);
+            for (auto &v: data) {
+                v = distrib(rng);
+            }
+            return data;
+        }
+
+        inline IndexConfig hnsw_config(size_t dim, size_t max_elements, MetricType metric = MetricType::METRIC_L2) {
+            HnswlibConfig config;
+            config.M = 16;
+            config.ef_construction = 100;
+            IndexConfig conf;
+            conf.with_dimension(dim)
+                    .with_metric(metric)
+                    .with_data_type(DataType::FLOAT32)
+                    .with_max_elements(max_elements)
+                    .with_index(config);
+            conf.core.index_type = IndexType::INDEX_HNSWLIB;
+            return conf;
+        }
+
+        // hnsw index holding the first n vectors of data, labels are the row numbers
+        inline std::unique_ptr<HnswIndex> build_index(const std::vector<float> &data, size_t n, size_t dim,
+                                                      size_t max_elements) {
+            auto index = std::make_unique<HnswIndex>();
+            if (!index->initialize(hnsw_config(dim, max_elements)).ok()) {
+                std::abort();
+            }
+            for (size_t i = 0; i < n; ++i) {
+                if (!index->add_vector(reinterpret_cast<const uint8_t *>(data.data() + i * dim), i, {}).ok()) {
+                    std::abort();
+                }
+            }
+            return index;
+        }
+    }  // namespace bench
+}  // namespace phekda
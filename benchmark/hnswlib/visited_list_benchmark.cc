@@ -0,0 +1,58 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-27.
+//
+// VisitedListPool acquire and release, single threaded and contended.
+// args: elements covered by a list
+#include <phekda/hnswlib/visited_list_pool.h>
+#include <benchmark/benchmark.h>
+#include <memory>
+
+namespace {
+
+    void BM_acquire_release(benchmark::State &state) {
+        static std::unique_ptr<phekda::VisitedListPool> pool;
+        if (state.thread_index() == 0) {
+            pool = std::make_unique<phekda::VisitedListPool>(1, static_cast<int>(state.range(0)));
+        }
+        // a search marks a handful of elements, keep the list from being optimized away
+        size_t i = 0;
+        for (auto _: state) {
+            auto *vl = pool->getFreeVisitedList();
+            vl->mass[i++ % vl->numelements] = vl->curV;
+            benchmark::DoNotOptimize(vl->mass);
+            pool->releaseVisitedList(vl);
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    }
+
+    // the reset on wrap around clears the whole list once every 65535 uses
+    void BM_reset(benchmark::State &state) {
+        phekda::VisitedList vl(static_cast<int>(state.range(0)));
+        for (auto _: state) {
+            vl.reset();
+            benchmark::DoNotOptimize(vl.curV);
+        }
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    }
+
+}  // namespace
+
+BENCHMARK(BM_acquire_release)->Arg(10000)->Arg(1000000)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_reset)->Arg(10000)->Arg(1000000);
@@ -0,0 +1,114 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+
+#include <phekda/hnswlib/index.h>
+#include <phekda/unified.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+// search every query once, return queries per second
+static double measure_qps(phekda::UnifiedIndex *index, const std::vector<float> &queries, uint32_t dim, uint32_t k) {
+    size_t nq = queries.size() / dim;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nq; i++) {
+        auto context = index->create_search_context();
+        context.with_query(reinterpret_cast<const uint8_t *>(queries.data() + i * dim)).with_top_k(k);
+        auto rs = index->search(context);
+        if (!rs.ok()) {
+            std::cout << "Error: " << rs.message() << std::endl;
+            exit(1);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return nq / seconds;
+}
+
+int main() {
+    phekda::CoreConfig core_config;
+    core_config.max_elements = 200000;
+    core_config.dimension = 32;
+    core_config.data = phekda::DataType::FLOAT32;
+    core_config.metric = phekda::MetricType::METRIC_L2;
+    core_config.index_type = phekda::IndexType::INDEX_HNSWLIB;
+
+    phekda::HnswlibConfig config;
+    config.M = 16;
+    config.ef_construction = 100;
+    config.random_seed = 123;
+
+    auto index = phekda::UnifiedIndex::create_index(core_config.index_type);
+    auto rs = index->initialize({core_config, config});
+    if (!rs.ok()) {
+        std::cout << "Error: " << rs.message() << std::endl;
+        return 1;
+    }
+
+    // random data, the insertion order has no locality at all
+    std::mt19937 rng(47);
+    std::uniform_real_distribution<> distrib_real;
+    std::vector<float> data(core_config.dimension * core_config.max_elements);
+    for (auto &v: data) {
+        v = distrib_real(rng);
+    }
+    std::vector<float> queries(core_config.dimension * 10000);
+    for (auto &v: queries) {
+        v = distrib_real(rng);
+    }
+    for (uint32_t i = 0; i < core_config.max_elements; i++) {
+        rs = index->add_vector(reinterpret_cast<const uint8_t *>(data.data() + i * core_config.dimension), i, {});
+        if (!rs.ok()) {
+            std::cout << "Error: " << rs.message() << std::endl;
+            return 1;
+        }
+    }
+    double qps_before = measure_qps(index, queries, core_config.dimension, 10);
+
+    // write a reordered copy and serve from it
+    for (auto type: {phekda::ReorderType::REORDER_BFS, phekda::ReorderType::REORDER_RCM}) {
+        phekda::ReorderReport report;
+        phekda::HnswlibBuildConfig build_conf;
+        build_conf.reorder = type;
+        build_conf.path = "reordered_index";
+        build_conf.report = &report;
+        rs = index->build(build_conf);
+        if (!rs.ok()) {
+            std::cout << "Error: " << rs.message() << std::endl;
+            return 1;
+        }
+        auto reordered = phekda::UnifiedIndex::create_index(core_config.index_type);
+        rs = reordered->load("reordered_index", {core_config, config});
+        if (!rs.ok()) {
+            std::cout << "Error: " << rs.message() << std::endl;
+            return 1;
+        }
+        double qps_after = measure_qps(reordered, queries, core_config.dimension, 10);
+        std::cout << (type == phekda::ReorderType::REORDER_BFS ? "bfs" : "rcm")
+                  << " reorder of " << report.elements << " elements in " << report.elapsed_seconds << "s\n"
+                  << "  avg neighbor id distance: " << report.avg_neighbor_distance_before
+                  << " -> " << report.avg_neighbor_distance_after << "\n"
+                  << "  qps: " << qps_before << " -> " << qps_after
+                  << " (" << (qps_after / qps_before - 1.0) * 100 << "%)\n";
+        delete reordered;
+    }
+    delete index;
+    return 0;
+}
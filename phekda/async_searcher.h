@@ -0,0 +1,199 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-28.
+//
+
+#pragma once
+
+#include <phekda/unified.h>
+#include <phekda/core/numa_worker_pool.h>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace phekda {
+
+    /**
+     * @class AsyncSearcher
+     * @brief runs the searches of one index on a NumaWorkerPool, so event
+     *        driven callers are not blocked by compute. completes through a
+     *        callback or a future and bounds the searches in flight, a query
+     *        over the bound is rejected with resource_exhausted instead of
+     *        queueing without limit
+     *
+     * @code
+     * AsyncSearcher searcher(&index, 1024);
+     * searcher.start();
+     * auto context = index.create_search_context();
+     * context.with_top_k(10).with_query(query);
+     * auto rs = searcher.search_async(std::move(context), [](turbo::Status status, SearchContext &done) {
+     *     // on a worker thread, keep it short
+     * });
+     * @endcode
+     *
+     * the index must outlive the searcher.
+     */
+    class AsyncSearcher {
+    public:
+        // called on the worker with the status of the search and the context
+        // holding the results, the callback may move the context away. an
+        // exception thrown by the callback is dropped
+        using Callback = std::function<void(turbo::Status, SearchContext &)>;
+
+        struct Result {
+            turbo::Status status;
+            SearchContext context;
+        };
+
+        // max_in_flight bounds the queued and running searches, 0 is unbounded
+        explicit AsyncSearcher(UnifiedIndex *index, size_t max_in_flight = 1024)
+                : index_(index), max_in_flight_(max_in_flight) {}
+
+        // finishes the accepted searches
+        ~AsyncSearcher() {
+            stop();
+        }
+
+        AsyncSearcher(const AsyncSearcher &) = delete;
+
+        AsyncSearcher &operator=(const AsyncSearcher &) = delete;
+
+        // threads_per_node workers on every numa node, 0 means one per cpu
+        turbo::Status start(size_t threads_per_node = 0) {
+            auto rs = pool_.start(threads_per_node);
+            if (rs.ok()) {
+                started_ = true;
+            }
+            return rs;
+        }
+
+        // run the accepted searches to completion and join the workers, must
+        // not race with search_async
+        void stop() {
+            started_ = false;
+            pool_.stop();
+        }
+
+        // the context is taken only if the search is accepted, on an error
+        // it is left with the caller and the callback is not called
+        turbo::Status search_async(SearchContext &&context, Callback done) {
+            if (!done) {
+                return turbo::invalid_argument_error("callback is empty");
+            }
+            auto rs = admit();
+            if (!rs.ok()) {
+                return rs;
+            }
+            auto task = std::make_shared<Task>(Task{std::move(context), std::move(done)});
+            pool_.submit([this, task] {
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                Finish finish{this};
+                auto status = index_->search(task->context);
+                task->done(status, task->context);
+            });
+            return turbo::OkStatus();
+        }
+
+        // the future is ready at once with the error if the search is not accepted
+        std::future<Result> search_async(SearchContext &&context) {
+            auto promise = std::make_shared<std::promise<Result>>();
+            auto future = promise->get_future();
+            auto rs = admit();
+            if (!rs.ok()) {
+                promise->set_value(Result{rs, std::move(context)});
+                return future;
+            }
+            auto task = std::make_shared<Task>(Task{std::move(context), nullptr});
+            pool_.submit([this, task, promise] {
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                turbo::Status status;
+                {
+                    // counted before the future is ready
+                    Finish finish{this};
+                    status = index_->search(task->context);
+                }
+                promise->set_value(Result{status, std::move(task->context)});
+            });
+            return future;
+        }
+
+        // accepted searches not started yet
+        size_t queue_depth() const {
+            return queued_.load(std::memory_order_relaxed);
+        }
+
+        // accepted searches not completed yet
+        size_t in_flight() const {
+            return in_flight_.load(std::memory_order_acquire);
+        }
+
+        size_t completed() const {
+            return completed_.load(std::memory_order_relaxed);
+        }
+
+        size_t rejected() const {
+            return rejected_.load(std::memory_order_relaxed);
+        }
+
+        size_t max_in_flight() const {
+            return max_in_flight_;
+        }
+
+    private:
+        struct Task {
+            SearchContext context;
+            Callback done;
+        };
+
+        // frees the slot of a search when its task leaves, even by a throw
+        struct Finish {
+            AsyncSearcher *searcher;
+
+            ~Finish() {
+                searcher->completed_.fetch_add(1, std::memory_order_relaxed);
+                searcher->in_flight_.fetch_sub(1, std::memory_order_release);
+            }
+        };
+
+        turbo::Status admit() {
+            if (!started_) {
+                return turbo::failed_precondition_error("async searcher not started");
+            }
+            auto before = in_flight_.fetch_add(1, std::memory_order_acq_rel);
+            if (max_in_flight_ != 0 && before >= max_in_flight_) {
+                in_flight_.fetch_sub(1, std::memory_order_relaxed);
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return turbo::resource_exhausted_error("too many searches in flight");
+            }
+            queued_.fetch_add(1, std::memory_order_relaxed);
+            return turbo::OkStatus();
+        }
+
+        UnifiedIndex *index_;
+        size_t max_in_flight_;
+        std::atomic<bool> started_{false};
+        std::atomic<size_t> in_flight_{0};
+        std::atomic<size_t> queued_{0};
+        std::atomic<size_t> completed_{0};
+        std::atomic<size_t> rejected_{0};
+        NumaWorkerPool pool_;
+    };
+
+}  // namespace phekda
@@ -0,0 +1,227 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-23.
+//
+
+#pragma once
+
+#include <phekda/core/defines.h>
+#include <phekda/core/search_stats.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace phekda {
+
+    /**
+     * @class BinaryHeap
+     * @brief vector backed binary heap, clear() keeps the capacity so a heap
+     *        reused across queries stops allocating once it has grown
+     *
+     * top() is the greatest element by Less, as std::priority_queue.
+     */
+    template<typename T, typename Less>
+    class BinaryHeap {
+    public:
+        void reserve(size_t n) {
+            data_.reserve(n);
+        }
+
+        void clear() {
+            data_.clear();
+        }
+
+        bool empty() const {
+            return data_.empty();
+        }
+
+        size_t size() const {
+            return data_.size();
+        }
+
+        const T &top() const {
+            return data_.front();
+        }
+
+        void push(const T &value) {
+            data_.push_back(value);
+            std::push_heap(data_.begin(), data_.end(), Less());
+        }
+
+        template<typename... Args>
+        void emplace(Args &&... args) {
+            push(T(std::forward<Args>(args)...));
+        }
+
+        void pop() {
+            std::pop_heap(data_.begin(), data_.end(), Less());
+            data_.pop_back();
+        }
+
+        // replace the top, cheaper than pop and push
+        void replace_top(const T &value) {
+            std::pop_heap(data_.begin(), data_.end(), Less());
+            data_.back() = value;
+            std::push_heap(data_.begin(), data_.end(), Less());
+        }
+
+        // elements in heap order
+        const std::vector<T> &data() const {
+            return data_;
+        }
+
+    private:
+        std::vector<T> data_;
+    };
+
+    // graph search candidate, ordered closer first
+    struct SearchCandidate {
+        SearchCandidate() = default;
+
+        SearchCandidate(DistanceType d, LocationType loc) : distance(d), location(loc) {}
+
+        DistanceType distance{0.0};
+        LocationType location{0};
+    };
+
+    struct GreaterCandidate {
+        bool operator()(const SearchCandidate &lhs, const SearchCandidate &rhs) const {
+            return lhs.distance > rhs.distance;
+        }
+    };
+
+    // top() is the closest candidate
+    using CandidateHeap = BinaryHeap<SearchCandidate, GreaterCandidate>;
+
+    /**
+     * @class ResultHeap
+     * @brief keeps the capacity closest results, top() is the furthest kept
+     */
+    class ResultHeap {
+    public:
+        // drop the results, the storage is kept
+        void reset(size_t capacity) {
+            capacity_ = capacity;
+            heap_.clear();
+            heap_.reserve(capacity + 1);
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        bool empty() const {
+            return heap_.empty();
+        }
+
+        size_t size() const {
+            return heap_.size();
+        }
+
+        bool full() const {
+            return heap_.size() >= capacity_;
+        }
+
+        const ResultEntity &top() const {
+            return heap_.top();
+        }
+
+        void pop() {
+            heap_.pop();
+        }
+
+        // keep the entity if it is closer than the furthest kept one
+        void push(const ResultEntity &entity) {
+            if (!full()) {
+                heap_.push(entity);
+            } else if (!heap_.empty() && entity.distance < heap_.top().distance) {
+                heap_.replace_top(entity);
+            }
+        }
+
+        void emplace(DistanceType distance, LabelType label, LocationType location) {
+            push(ResultEntity(distance, label, location));
+        }
+
+        // pop the closest k into out, closer first, reverse for further first
+        void pop_sorted(size_t k, bool reverse, ResultVector &out, bool with_location) {
+            while (heap_.size() > k) {
+                heap_.pop();
+            }
+            size_t base = out.size();
+            size_t n = heap_.size();
+            out.resize(base + n);
+            // the heap pops the furthest first
+            for (size_t i = n; i > 0; --i) {
+                auto &rez = heap_.top();
+                size_t pos = reverse ? base + n - i : base + i - 1;
+                out[pos] = ResultEntity(rez.distance, rez.label, with_location ? rez.location : 0);
+                heap_.pop();
+            }
+        }
+
+    private:
+        size_t capacity_{0};
+        BinaryHeap<ResultEntity, LessResultEntity> heap_;
+    };
+
+    // per query working memory of a graph search
+    struct SearchScratch {
+        CandidateHeap candidates;
+        ResultHeap results;
+        SearchStats stats;
+    };
+
+    /**
+     * @class SearchScratchPool
+     * @brief reusable SearchScratch for concurrent searches, like the
+     *        VisitedListPool, a steady state search allocates nothing
+     */
+    class SearchScratchPool {
+    public:
+        SearchScratch *get() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!free_.empty()) {
+                    auto *scratch = free_.back();
+                    free_.pop_back();
+                    return scratch;
+                }
+            }
+            auto owned = std::make_unique<SearchScratch>();
+            auto *scratch = owned.get();
+            std::lock_guard<std::mutex> lock(mutex_);
+            all_.push_back(std::move(owned));
+            free_.reserve(all_.size());
+            return scratch;
+        }
+
+        void release(SearchScratch *scratch) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(scratch);
+        }
+
+    private:
+        std::mutex mutex_;
+        std::vector<std::unique_ptr<SearchScratch>> all_;
+        std::vector<SearchScratch *> free_;
+    };
+
+}  // namespace phekda
@@ -0,0 +1,310 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-21.
+//
+
+#pragma once
+
+#include <phekda/core/aligned_allocator.h>
+#include <phekda/core/huge_page.h>
+#include <phekda/core/numa.h>
+#include <turbo/utility/status.h>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace phekda {
+
+    /**
+     * @class ChunkedArena
+     * @brief fixed stride element storage growing in fixed size chunks
+     *
+     * Elements live in chunks of chunk_elements() elements, a chunk never moves
+     * once allocated, so pointers to elements stay valid while the arena grows.
+     * Readers resolve an element through the chunk directory without any lock,
+     * writers growing the arena are serialized by an internal mutex. When the
+     * directory itself is full, a larger copy is published and the old one is
+     * retired until the arena is released, only chunk pointers are copied.
+     *
+     * With huge pages the chunks are carved from blocks of whole huge pages,
+     * a chunk smaller than a page does not pin a page of its own.
+     */
+    class ChunkedArena {
+    public:
+        static constexpr size_t kDefaultChunkElements = 65536;
+        static constexpr size_t kMinChunkElements = 1024;
+
+        ChunkedArena() = default;
+
+        ~ChunkedArena() {
+            release();
+        }
+
+        ChunkedArena(const ChunkedArena &) = delete;
+
+        ChunkedArena &operator=(const ChunkedArena &) = delete;
+
+        // chunk_elements is rounded up to power of two, alignment is
+        // the alignment of each chunk, zeroed chunks are memset to 0,
+        // huge_pages picks the page backing of the chunks
+        turbo::Status initialize(size_t stride, size_t chunk_elements, size_t alignment = 64, bool zeroed = false,
+                                 HugePageMode huge_pages = HugePageMode::HUGE_PAGE_NONE) {
+            release();
+            if (stride == 0) {
+                return turbo::invalid_argument_error("chunked arena stride should not be 0");
+            }
+            size_t n = 1;
+            chunk_shift_ = 0;
+            while (n < chunk_elements) {
+                n <<= 1;
+                ++chunk_shift_;
+            }
+            chunk_mask_ = n - 1;
+            stride_ = stride;
+            alignment_ = std::max(alignment, sizeof(void *));
+            zeroed_ = zeroed;
+            huge_pages_ = huge_pages;
+            return turbo::OkStatus();
+        }
+
+        // numa placement of the chunks allocated from now on
+        void set_numa(NumaPolicy policy, int node) {
+            std::lock_guard<std::mutex> lock(grow_mutex_);
+            numa_policy_ = policy;
+            numa_node_ = node;
+        }
+
+        // make room for at least n elements, init(chunk, elements) is called
+        // for every new chunk before it becomes visible to readers
+        template<typename Fn>
+        turbo::Status reserve(size_t n, Fn &&init) {
+            if (n <= capacity()) {
+                return turbo::OkStatus();
+            }
+            std::lock_guard<std::mutex> lock(grow_mutex_);
+            size_t need = (n + chunk_mask_) >> chunk_shift_;
+            if (need > dir_capacity_) {
+                size_t new_cap = std::max<size_t>(dir_capacity_ * 2, 16);
+                while (new_cap < need) {
+                    new_cap <<= 1;
+                }
+                auto dir = std::make_unique<std::atomic<char *>[]>(new_cap);
+                for (size_t i = 0; i < new_cap; ++i) {
+                    dir[i].store(i < num_chunks_ ? chunk(i) : nullptr, std::memory_order_relaxed);
+                }
+                directory_.store(dir.get(), std::memory_order_release);
+                directories_.push_back(std::move(dir));
+                dir_capacity_ = new_cap;
+            }
+            auto *dir = directory_.load(std::memory_order_relaxed);
+            size_t bytes = chunk_bytes();
+            while (num_chunks_ < need) {
+                char *ptr = carve(bytes);
+                if (ptr == nullptr) {
+                    return turbo::resource_exhausted_error("Not enough memory: chunked arena failed to allocate chunk");
+                }
+                // before the pages are touched, best effort like madvise
+                (void) numa_place(ptr, bytes, numa_policy_, numa_node_);
+                // mapped pages come zeroed, touching them would fault them all in
+                if (zeroed_ && blocks_.back().backing == PageBacking::PAGE_MALLOC) {
+                    memset(ptr, 0, bytes);
+                }
+                init(ptr, chunk_elements());
+                dir[num_chunks_].store(ptr, std::memory_order_release);
+                ++num_chunks_;
+                capacity_.store(num_chunks_ << chunk_shift_, std::memory_order_release);
+            }
+            return turbo::OkStatus();
+        }
+
+        turbo::Status reserve(size_t n) {
+            return reserve(n, [](char *, size_t) {});
+        }
+
+        inline char *at(size_t i) const {
+            auto *dir = directory_.load(std::memory_order_acquire);
+            return dir[i >> chunk_shift_].load(std::memory_order_relaxed) + (i & chunk_mask_) * stride_;
+        }
+
+        inline char *chunk(size_t c) const {
+            return directory_.load(std::memory_order_acquire)[c].load(std::memory_order_acquire);
+        }
+
+        // number of elements the allocated chunks can hold
+        size_t capacity() const {
+            return capacity_.load(std::memory_order_acquire);
+        }
+
+        size_t num_chunks() const {
+            return capacity() >> chunk_shift_;
+        }
+
+        size_t chunk_elements() const {
+            return chunk_mask_ + 1;
+        }
+
+        size_t chunk_bytes() const {
+            return chunk_elements() * stride_;
+        }
+
+        size_t stride() const {
+            return stride_;
+        }
+
+        size_t memory_usage() const {
+            return num_chunks() * chunk_bytes();
+        }
+
+        // bytes reserved for the chunks and how many of them are on huge pages
+        PageStats page_stats() const {
+            std::vector<PageBlock> blocks;
+            {
+                std::lock_guard<std::mutex> lock(grow_mutex_);
+                blocks = blocks_;
+            }
+            return phekda::page_stats(blocks);
+        }
+
+        // visit the first n elements chunk by chunk, fn(ptr, elements)
+        template<typename Fn>
+        void for_each_chunk(size_t n, Fn &&fn) const {
+            for (size_t c = 0; n > 0; ++c) {
+                size_t elements = std::min(n, chunk_elements());
+                fn(chunk(c), elements);
+                n -= elements;
+            }
+        }
+
+        // not thread safe, callers should make sure no one is using the arena
+        template<typename Fn>
+        void release(Fn &&fini) {
+            for (size_t c = 0; c < num_chunks_; ++c) {
+                fini(chunk(c), chunk_elements());
+            }
+            for (auto &block: blocks_) {
+                page_free(block);
+            }
+            blocks_.clear();
+            block_used_ = 0;
+            directories_.clear();
+            directory_.store(nullptr, std::memory_order_relaxed);
+            capacity_.store(0, std::memory_order_relaxed);
+            num_chunks_ = 0;
+            dir_capacity_ = 0;
+        }
+
+        void release() {
+            release([](char *, size_t) {});
+        }
+
+    private:
+        // room for a chunk of bytes in the last block, a new block of whole
+        // huge pages when it is full. guarded by grow_mutex_
+        char *carve(size_t bytes) {
+            size_t need = (bytes + alignment_ - 1) / alignment_ * alignment_;
+            if (blocks_.empty() || blocks_.back().bytes - block_used_ < need) {
+                size_t page = huge_page_size(huge_pages_);
+                size_t request = page ? detail::page_round_up(need, page) : need;
+                PageBlock block = page_alloc(request, alignment_, huge_pages_);
+                if (block.ptr == nullptr) {
+                    return nullptr;
+                }
+                blocks_.push_back(block);
+                block_used_ = 0;
+            }
+            char *ptr = static_cast<char *>(blocks_.back().ptr) + block_used_;
+            block_used_ += need;
+            return ptr;
+        }
+
+        size_t stride_{0};
+        size_t chunk_shift_{0};
+        size_t chunk_mask_{0};
+        size_t alignment_{64};
+        bool zeroed_{false};
+        HugePageMode huge_pages_{HugePageMode::HUGE_PAGE_NONE};
+        std::atomic<std::atomic<char *> *> directory_{nullptr};
+        std::atomic<size_t> capacity_{0};
+        // guarded by grow_mutex_
+        mutable std::mutex grow_mutex_;
+        size_t num_chunks_{0};
+        size_t dir_capacity_{0};
+        std::vector<PageBlock> blocks_;
+        // bytes of the last block handed out to chunks
+        size_t block_used_{0};
+        NumaPolicy numa_policy_{NumaPolicy::NUMA_NONE};
+        int numa_node_{0};
+        std::vector<std::unique_ptr<std::atomic<char *>[]>> directories_;
+    };
+
+    /**
+     * @class ChunkedVector
+     * @brief ChunkedArena of default constructed T, the elements keep their
+     *        address when growing, so it can hold non movable types like mutex
+     */
+    template<typename T>
+    class ChunkedVector {
+    public:
+        ChunkedVector() = default;
+
+        ~ChunkedVector() {
+            release();
+        }
+
+        ChunkedVector(const ChunkedVector &) = delete;
+
+        ChunkedVector &operator=(const ChunkedVector &) = delete;
+
+        turbo::Status initialize(size_t chunk_elements) {
+            release();
+            return arena_.initialize(sizeof(T), chunk_elements, std::max(alignof(T), sizeof(void *)));
+        }
+
+        turbo::Status reserve(size_t n) {
+            return arena_.reserve(n, [](char *ptr, size_t elements) {
+                for (size_t i = 0; i < elements; ++i) {
+                    new(ptr + i * sizeof(T)) T();
+                }
+            });
+        }
+
+        inline T &operator[](size_t i) const {
+            return *reinterpret_cast<T *>(arena_.at(i));
+        }
+
+        size_t capacity() const {
+            return arena_.capacity();
+        }
+
+        void release() {
+            arena_.release([](char *ptr, size_t elements) {
+                for (size_t i = 0; i < elements; ++i) {
+                    reinterpret_cast<T *>(ptr + i * sizeof(T))->~T();
+                }
+            });
+        }
+
+    private:
+        ChunkedArena arena_;
+    };
+
+}  // namespace phekda
@@ -34,6 +34,9 @@ namespace phekda {
         uint32_t dimension{0};
         uint32_t worker_num{0};
         uint32_t max_elements{0};
+        // grow the storage in chunks when max_elements is reached
+        // instead of rejecting the add, max_elements is updated
+        bool auto_grow{false};
     };
 
     struct IndexConfig {
@@ -71,6 +74,11 @@ namespace phekda {
             core.max_elements = max_elements;
             return *this;
         }
+
+        IndexConfig &with_auto_grow(bool auto_grow) {
+            core.auto_grow = auto_grow;
+            return *this;
+        }
     };
 
 }  // namespace phekda
@@ -0,0 +1,196 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace phekda {
+
+    /**
+     * @class SnapshotGate
+     * @brief shared by the writers, closed by a save to start and end its
+     *        snapshot. a closing save holds up new writers so it is not
+     *        starved by a steady stream of them, unlike std::shared_mutex
+     *
+     * writers must not take it twice, a save closing in between would
+     * wait for the first and hold up the second.
+     */
+    class SnapshotGate {
+    public:
+        void lock_shared() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !closed_; });
+            ++writers_;
+        }
+
+        void unlock_shared() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--writers_ == 0 && closed_) {
+                cv_.notify_all();
+            }
+        }
+
+        // wait for the writers inside to leave, new ones wait until unlock
+        void lock() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return !closed_; });
+            closed_ = true;
+            cv_.wait(lock, [this] { return writers_ == 0; });
+        }
+
+        void unlock() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = false;
+            cv_.notify_all();
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        size_t writers_{0};
+        bool closed_{false};
+    };
+
+    /**
+     * @class CowSnapshot
+     * @brief point in time view of the elements [0, count) of an index for
+     *        a save running next to the writers.
+     *
+     * A writer calls preserve(id) before changing an element, the first
+     * change of an element the saver has not read yet keeps its old bytes
+     * aside. The saver reads every element once with take(id), getting the
+     * kept bytes or, for an element not changed since begin(), the live
+     * ones. An element being read by the saver holds up its writer until
+     * the read is done, nothing else is blocked.
+     *
+     * begin() and end() must not run while a writer is inside an operation,
+     * the index guards them with a SnapshotGate.
+     */
+    class CowSnapshot {
+    public:
+        bool active() const {
+            return active_.load(std::memory_order_acquire);
+        }
+
+        size_t count() const {
+            return count_;
+        }
+
+        void begin(size_t count) {
+            count_ = count;
+            states_.reset(new std::atomic<uint8_t>[count]);
+            for (size_t i = 0; i < count; ++i) {
+                states_[i].store(kPending, std::memory_order_relaxed);
+            }
+            kept_bytes_.store(0, std::memory_order_relaxed);
+            active_.store(true, std::memory_order_release);
+        }
+
+        void end() {
+            active_.store(false, std::memory_order_release);
+            states_.reset();
+            count_ = 0;
+            std::lock_guard<std::mutex> lock(kept_mutex_);
+            kept_.clear();
+        }
+
+        // writers, before changing element id
+        template<typename Fn>
+        void preserve(size_t id, Fn &&copy) {
+            if (!active() || id >= count_) {
+                return;
+            }
+            if (!claim(id)) {
+                return;
+            }
+            std::vector<char> bytes;
+            copy(id, bytes);
+            kept_bytes_.fetch_add(bytes.size(), std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(kept_mutex_);
+                kept_[id] = std::move(bytes);
+            }
+            states_[id].store(kKept, std::memory_order_release);
+        }
+
+        // the saver, once per element
+        template<typename Fn>
+        void take(size_t id, std::vector<char> &bytes, Fn &&copy) {
+            if (claim(id)) {
+                copy(id, bytes);
+                states_[id].store(kDone, std::memory_order_release);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(kept_mutex_);
+            auto it = kept_.find(id);
+            bytes = std::move(it->second);
+            kept_.erase(it);
+            states_[id].store(kDone, std::memory_order_release);
+        }
+
+        // bytes kept aside by the writers since begin()
+        size_t kept_bytes() const {
+            return kept_bytes_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr uint8_t kPending = 0;
+        static constexpr uint8_t kBusy = 1;
+        static constexpr uint8_t kKept = 2;
+        static constexpr uint8_t kDone = 3;
+
+        // true if the element was untouched and is now ours to copy, false
+        // once it is kept or done, waits while the other side copies it
+        bool claim(size_t id) {
+            auto &state = states_[id];
+            uint8_t s = state.load(std::memory_order_acquire);
+            while (true) {
+                if (s == kKept || s == kDone) {
+                    return false;
+                }
+                if (s == kBusy) {
+                    std::this_thread::yield();
+                    s = state.load(std::memory_order_acquire);
+                    continue;
+                }
+                if (state.compare_exchange_weak(s, kBusy, std::memory_order_acq_rel)) {
+                    return true;
+                }
+            }
+        }
+
+        std::atomic<bool> active_{false};
+        size_t count_{0};
+        std::unique_ptr<std::atomic<uint8_t>[]> states_;
+        std::mutex kept_mutex_;
+        std::unordered_map<size_t, std::vector<char>> kept_;
+        std::atomic<size_t> kept_bytes_{0};
+    };
+
+}  // namespace phekda
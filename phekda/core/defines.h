@@ -73,6 +73,8 @@ namespace phekda {
     static constexpr uint32_t aligned_bytes = 64;
 #elif defined(__AVX2__)
     static constexpr uint32_t aligned_bytes = 32;
+#else
+    static constexpr uint32_t aligned_bytes = 16;
 #endif
 
     static constexpr uint32_t dimension_alignment(DataType data_type) {
@@ -88,7 +90,11 @@ namespace phekda {
     enum class IndexType {
         INDEX_NONE,
         INDEX_HNSW_FLAT,
-        INDEX_HNSWLIB
+        INDEX_HNSWLIB,
+        // several indexes of one of the types above, see ShardedIndex
+        INDEX_SHARDED,
+        // a mutable head and sealed segments, see SegmentedIndex
+        INDEX_SEGMENTED
     };
 
     struct ConsolidationReport {
@@ -0,0 +1,239 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+
+#pragma once
+
+#include <phekda/core/aligned_allocator.h>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+namespace phekda {
+
+    // page backing of large index memory, cuts the TLB misses of random
+    // graph hops on big indexes
+    enum class HugePageMode {
+        HUGE_PAGE_NONE,
+        // madvise(MADV_HUGEPAGE), the kernel backs what it can with 2MB pages
+        HUGE_PAGE_TRANSPARENT,
+        // explicit hugetlb pages reserved by vm.nr_hugepages, falls back to
+        // transparent huge pages when the pool is exhausted
+        HUGE_PAGE_2MB,
+        HUGE_PAGE_1GB
+    };
+
+    // how a block ended up backed
+    enum class PageBacking {
+        PAGE_MALLOC,
+        PAGE_TRANSPARENT,
+        PAGE_HUGETLB
+    };
+
+    static constexpr size_t kHugePage2MB = size_t(2) << 20;
+    static constexpr size_t kHugePage1GB = size_t(1) << 30;
+
+    // page size asked for by mode, 0 for plain memory
+    inline size_t huge_page_size(HugePageMode mode) {
+        switch (mode) {
+            case HugePageMode::HUGE_PAGE_NONE:
+                return 0;
+            case HugePageMode::HUGE_PAGE_1GB:
+                return kHugePage1GB;
+            default:
+                return kHugePage2MB;
+        }
+    }
+
+    struct PageBlock {
+        void *ptr{nullptr};
+        // bytes reserved for the block, rounded up to the page size
+        size_t bytes{0};
+        PageBacking backing{PageBacking::PAGE_MALLOC};
+    };
+
+    struct PageStats {
+        size_t bytes{0};
+        // bytes on hugetlb pages plus the transparent huge pages the kernel
+        // really used, the latter read from /proc/self/smaps
+        size_t huge_page_bytes{0};
+
+        PageStats &operator+=(const PageStats &other) {
+            bytes += other.bytes;
+            huge_page_bytes += other.huge_page_bytes;
+            return *this;
+        }
+    };
+
+    namespace detail {
+        inline size_t page_round_up(size_t bytes, size_t page_size) {
+            return (bytes + page_size - 1) & ~(page_size - 1);
+        }
+
+#ifdef __linux__
+        // mmap a 2MB aligned range and ask for transparent huge pages
+        inline PageBlock transparent_alloc(size_t bytes) {
+            PageBlock block;
+            size_t size = page_round_up(bytes, kHugePage2MB);
+            void *raw = mmap(nullptr, size + kHugePage2MB, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) {
+                return block;
+            }
+            auto start = reinterpret_cast<uintptr_t>(raw);
+            auto aligned = page_round_up(start, kHugePage2MB);
+            if (aligned > start) {
+                munmap(raw, aligned - start);
+            }
+            size_t tail = start + size + kHugePage2MB - (aligned + size);
+            if (tail > 0) {
+                munmap(reinterpret_cast<void *>(aligned + size), tail);
+            }
+            // not fatal, the range is still usable with normal pages
+            madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+            block.ptr = reinterpret_cast<void *>(aligned);
+            block.bytes = size;
+            block.backing = PageBacking::PAGE_TRANSPARENT;
+            return block;
+        }
+
+        inline PageBlock hugetlb_alloc(size_t bytes, size_t page_size, int page_flag) {
+            PageBlock block;
+            size_t size = page_round_up(bytes, page_size);
+            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_flag, -1, 0);
+            if (ptr == MAP_FAILED) {
+                return block;
+            }
+            block.ptr = ptr;
+            block.bytes = size;
+            block.backing = PageBacking::PAGE_HUGETLB;
+            return block;
+        }
+
+        // AnonHugePages of the mappings overlapping the blocks, a mapping
+        // shared with other memory is counted by its overlapping share
+        inline size_t transparent_huge_bytes(const std::vector<PageBlock> &blocks) {
+            FILE *fp = fopen("/proc/self/smaps", "r");
+            if (fp == nullptr) {
+                return 0;
+            }
+            size_t total = 0;
+            size_t overlap = 0;
+            uintptr_t vma_start = 0;
+            uintptr_t vma_end = 0;
+            char line[512];
+            while (fgets(line, sizeof(line), fp)) {
+                unsigned long start, end, kb;
+                // mapping lines start with the lower case hex range, fields with a name
+                bool mapping = (line[0] >= '0' && line[0] <= '9') || (line[0] >= 'a' && line[0] <= 'f');
+                if (mapping && sscanf(line, "%lx-%lx", &start, &end) == 2) {
+                    vma_start = start;
+                    vma_end = end;
+                    overlap = 0;
+                    for (auto &block: blocks) {
+                        auto begin = reinterpret_cast<uintptr_t>(block.ptr);
+                        auto lo = std::max<uintptr_t>(begin, vma_start);
+                        auto hi = std::min<uintptr_t>(begin + block.bytes, vma_end);
+                        if (lo < hi) {
+                            overlap += hi - lo;
+                        }
+                    }
+                } else if (overlap > 0 && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+                    total += static_cast<size_t>(static_cast<double>(kb) * 1024 * overlap / (vma_end - vma_start));
+                }
+            }
+            fclose(fp);
+            return total;
+        }
+#endif
+    }  // namespace detail
+
+    // allocate bytes backed as asked by mode, falls back from hugetlb to
+    // transparent huge pages to plain aligned memory. mmap backed blocks
+    // come zeroed, ptr is nullptr if all of them failed
+    inline PageBlock page_alloc(size_t bytes, size_t alignment, HugePageMode mode) {
+        PageBlock block;
+#ifdef __linux__
+        if (mode == HugePageMode::HUGE_PAGE_1GB) {
+            block = detail::hugetlb_alloc(bytes, kHugePage1GB, MAP_HUGE_1GB);
+        } else if (mode == HugePageMode::HUGE_PAGE_2MB) {
+            block = detail::hugetlb_alloc(bytes, kHugePage2MB, MAP_HUGE_2MB);
+        }
+        if (block.ptr == nullptr && mode != HugePageMode::HUGE_PAGE_NONE) {
+            block = detail::transparent_alloc(bytes);
+        }
+        if (block.ptr != nullptr) {
+            return block;
+        }
+#endif
+        block.ptr = aligned_malloc(bytes, std::max(alignment, sizeof(void *)));
+        block.bytes = bytes;
+        block.backing = PageBacking::PAGE_MALLOC;
+        return block;
+    }
+
+    inline void page_free(const PageBlock &block) {
+        if (block.ptr == nullptr) {
+            return;
+        }
+#ifdef __linux__
+        if (block.backing != PageBacking::PAGE_MALLOC) {
+            munmap(block.ptr, block.bytes);
+            return;
+        }
+#endif
+        aligned_free(block.ptr);
+    }
+
+    inline PageStats page_stats(const std::vector<PageBlock> &blocks) {
+        PageStats stats;
+        std::vector<PageBlock> transparent;
+        for (auto &block: blocks) {
+            stats.bytes += block.bytes;
+            if (block.backing == PageBacking::PAGE_HUGETLB) {
+                stats.huge_page_bytes += block.bytes;
+            } else if (block.backing == PageBacking::PAGE_TRANSPARENT) {
+                transparent.push_back(block);
+            }
+        }
+#ifdef __linux__
+        if (!transparent.empty()) {
+            stats.huge_page_bytes += detail::transparent_huge_bytes(transparent);
+        }
+#endif
+        return stats;
+    }
+
+}  // namespace phekda
@@ -0,0 +1,169 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-26.
+//
+
+#pragma once
+
+#include <phekda/core/latency_histogram.h>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+namespace phekda {
+
+    // point in time view of the metrics of an index
+    struct MetricsSnapshot {
+        // since the index was created or the metrics reset
+        turbo::Duration uptime;
+        // from create_search_context to the index starting the search
+        HistogramSnapshot queue_wait;
+        HistogramSnapshot search;
+        HistogramSnapshot insert;
+        HistogramSnapshot remove;
+        HistogramSnapshot save;
+        HistogramSnapshot load;
+        uint64_t search_errors{0};
+        uint64_t insert_errors{0};
+        // searches stopped by their budget, see SearchContext::partial
+        uint64_t partial_searches{0};
+        // searches per second over the uptime, diff two snapshots for a window
+        double qps{0.0};
+        size_t elements{0};
+        size_t deleted{0};
+        double deleted_ratio{0.0};
+        size_t memory_bytes{0};
+        size_t huge_page_bytes{0};
+
+        // visit every metric as a flat name and value, latencies in microseconds
+        void for_each(const std::function<void(const std::string &, double)> &fn) const {
+            auto histogram = [&fn](const std::string &name, const HistogramSnapshot &h) {
+                fn(name + "_count", static_cast<double>(h.count));
+                fn(name + "_mean_us", h.mean() / 1000.0);
+                fn(name + "_p50_us", static_cast<double>(h.p50) / 1000.0);
+                fn(name + "_p90_us", static_cast<double>(h.p90) / 1000.0);
+                fn(name + "_p99_us", static_cast<double>(h.p99) / 1000.0);
+                fn(name + "_p999_us", static_cast<double>(h.p999) / 1000.0);
+                fn(name + "_max_us", static_cast<double>(h.max) / 1000.0);
+            };
+            fn("uptime_s", uptime.to_seconds());
+            histogram("queue_wait", queue_wait);
+            histogram("search", search);
+            histogram("insert", insert);
+            histogram("remove", remove);
+            histogram("save", save);
+            histogram("load", load);
+            fn("search_errors", static_cast<double>(search_errors));
+            fn("insert_errors", static_cast<double>(insert_errors));
+            fn("partial_searches", static_cast<double>(partial_searches));
+            fn("qps", qps);
+            fn("elements", static_cast<double>(elements));
+            fn("deleted", static_cast<double>(deleted));
+            fn("deleted_ratio", deleted_ratio);
+            fn("memory_bytes", static_cast<double>(memory_bytes));
+            fn("huge_page_bytes", static_cast<double>(huge_page_bytes));
+        }
+
+        // one "name value" line per metric
+        std::string to_string() const {
+            std::string text;
+            for_each([&text](const std::string &name, double value) {
+                char buf[64];
+                snprintf(buf, sizeof(buf), " %.6g\n", value);
+                text += name;
+                text += buf;
+            });
+            return text;
+        }
+    };
+
+    /**
+     * @class IndexMetrics
+     * @brief latency histograms and counters an index records on every call,
+     *        lock free so they can stay on in production
+     */
+    class IndexMetrics {
+    public:
+        LatencyHistogram queue_wait;
+        LatencyHistogram search;
+        LatencyHistogram insert;
+        LatencyHistogram remove;
+        LatencyHistogram save;
+        LatencyHistogram load;
+        std::atomic<uint64_t> search_errors{0};
+        std::atomic<uint64_t> insert_errors{0};
+        std::atomic<uint64_t> partial_searches{0};
+
+        // the latency part of the snapshot, the index fills in its sizes
+        MetricsSnapshot snapshot() const {
+            MetricsSnapshot snap;
+            snap.uptime = turbo::Time::current_time() - start_time_;
+            snap.queue_wait = queue_wait.snapshot();
+            snap.search = search.snapshot();
+            snap.insert = insert.snapshot();
+            snap.remove = remove.snapshot();
+            snap.save = save.snapshot();
+            snap.load = load.snapshot();
+            snap.search_errors = search_errors.load(std::memory_order_relaxed);
+            snap.insert_errors = insert_errors.load(std::memory_order_relaxed);
+            snap.partial_searches = partial_searches.load(std::memory_order_relaxed);
+            double seconds = snap.uptime.to_seconds();
+            if (seconds > 0) {
+                snap.qps = static_cast<double>(snap.search.count) / seconds;
+            }
+            return snap;
+        }
+
+        void reset() {
+            queue_wait.reset();
+            search.reset();
+            insert.reset();
+            remove.reset();
+            save.reset();
+            load.reset();
+            search_errors.store(0, std::memory_order_relaxed);
+            insert_errors.store(0, std::memory_order_relaxed);
+            partial_searches.store(0, std::memory_order_relaxed);
+            start_time_ = turbo::Time::current_time();
+        }
+
+    private:
+        turbo::Time start_time_{turbo::Time::current_time()};
+    };
+
+    // records the time from construction to destruction into a histogram
+    class ScopedLatency {
+    public:
+        explicit ScopedLatency(LatencyHistogram &histogram)
+                : histogram_(histogram), start_(turbo::Time::current_time()) {}
+
+        ~ScopedLatency() {
+            histogram_.record(turbo::Time::current_time() - start_);
+        }
+
+        ScopedLatency(const ScopedLatency &) = delete;
+
+        ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+    private:
+        LatencyHistogram &histogram_;
+        turbo::Time start_;
+    };
+
+}  // namespace phekda
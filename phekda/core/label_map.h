@@ -0,0 +1,367 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-20.
+//
+
+#pragma once
+
+#include <phekda/core/defines.h>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <vector>
+#include <limits>
+#include <cassert>
+#include <algorithm>
+
+namespace phekda {
+
+    /**
+     * @class LabelMap
+     * @brief concurrent label -> location map
+     *
+     * The map is split into power of two shards, each shard is an open addressing
+     * table with linear probing guarded by its own shared mutex, so lookups only
+     * contend with writers of the same shard and concurrent inserts scale with
+     * the shard count.
+     *
+     * A slot is packed to 12 bytes (8 bytes label + 4 bytes location), the two
+     * largest location values are reserved to mark empty and erased slots.
+     */
+    class LabelMap {
+    public:
+        static constexpr LocationType kEmpty = std::numeric_limits<LocationType>::max();
+        static constexpr LocationType kErased = kEmpty - 1;
+        // the max location can be stored in the map
+        static constexpr LocationType kMaxLocation = kErased - 1;
+        static constexpr size_t kDefaultShards = 64;
+
+#pragma pack(push, 4)
+        struct Slot {
+            LabelType label;
+            LocationType location;
+        };
+#pragma pack(pop)
+        static_assert(sizeof(Slot) == 12, "label map slot should be 12 bytes");
+
+        explicit LabelMap(size_t num_shards = kDefaultShards) {
+            size_t n = 1;
+            while (n < num_shards) {
+                n <<= 1;
+            }
+            shard_bits_ = 0;
+            while ((size_t(1) << shard_bits_) < n) {
+                ++shard_bits_;
+            }
+            shards_ = std::make_unique<Shard[]>(n);
+            num_shards_ = n;
+        }
+
+        LabelMap(const LabelMap &) = delete;
+
+        LabelMap &operator=(const LabelMap &) = delete;
+
+        // pre-size the shards for about n labels, avoid rehash while building
+        void reserve(size_t n) {
+            size_t per_shard = n / num_shards_ + 1;
+            for (size_t i = 0; i < num_shards_; ++i) {
+                std::unique_lock<std::shared_mutex> lock(shards_[i].mutex);
+                shards_[i].rehash(capacity_for(per_shard));
+            }
+        }
+
+        // return true and set the location if label found
+        bool find(LabelType label, LocationType &location) const {
+            auto hash = hash_label(label);
+            auto &shard = shards_[shard_of(hash)];
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto *slot = shard.lookup(label, hash);
+            if (slot == nullptr) {
+                return false;
+            }
+            location = slot->location;
+            return true;
+        }
+
+        // look up n labels at once, the labels of a shard are resolved under
+        // one lock. locations[i] is kEmpty if labels[i] is not found,
+        // return the number found
+        size_t find_batch(const LabelType *labels, size_t n, LocationType *locations) const {
+            // (shard, index) so each shard is locked once
+            std::vector<std::pair<size_t, size_t>> order(n);
+            std::vector<uint64_t> hashes(n);
+            for (size_t i = 0; i < n; ++i) {
+                hashes[i] = hash_label(labels[i]);
+                order[i] = {shard_of(hashes[i]), i};
+            }
+            std::sort(order.begin(), order.end());
+            size_t found = 0;
+            for (size_t begin = 0; begin < n;) {
+                size_t end = begin;
+                while (end < n && order[end].first == order[begin].first) {
+                    ++end;
+                }
+                auto &shard = shards_[order[begin].first];
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                for (size_t k = begin; k < end; ++k) {
+                    size_t i = order[k].second;
+                    auto *slot = shard.lookup(labels[i], hashes[i]);
+                    if (slot == nullptr) {
+                        locations[i] = kEmpty;
+                    } else {
+                        locations[i] = slot->location;
+                        ++found;
+                    }
+                }
+                begin = end;
+            }
+            return found;
+        }
+
+        bool contains(LabelType label) const {
+            LocationType dummy;
+            return find(label, dummy);
+        }
+
+        // insert or overwrite the location of label
+        void insert_or_assign(LabelType label, LocationType location) {
+            assert(location <= kMaxLocation);
+            auto hash = hash_label(label);
+            auto &shard = shards_[shard_of(hash)];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            bool inserted;
+            shard.upsert(label, hash, location, true, inserted);
+            if (inserted) {
+                size_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // insert if absent, return the location stored in the map
+        // and set inserted to true if the label is new
+        LocationType try_emplace(LabelType label, LocationType location, bool &inserted) {
+            assert(location <= kMaxLocation);
+            auto hash = hash_label(label);
+            auto &shard = shards_[shard_of(hash)];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto stored = shard.upsert(label, hash, location, false, inserted);
+            if (inserted) {
+                size_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return stored;
+        }
+
+        // return true if the label was present
+        bool erase(LabelType label) {
+            auto hash = hash_label(label);
+            auto &shard = shards_[shard_of(hash)];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto *slot = const_cast<Slot *>(shard.lookup(label, hash));
+            if (slot == nullptr) {
+                return false;
+            }
+            slot->location = kErased;
+            --shard.size;
+            ++shard.erased;
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        // erase label only if it still maps to location,
+        // return true if it was erased
+        bool erase(LabelType label, LocationType location) {
+            auto hash = hash_label(label);
+            auto &shard = shards_[shard_of(hash)];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            auto *slot = const_cast<Slot *>(shard.lookup(label, hash));
+            if (slot == nullptr || slot->location != location) {
+                return false;
+            }
+            slot->location = kErased;
+            --shard.size;
+            ++shard.erased;
+            size_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void clear() {
+            for (size_t i = 0; i < num_shards_; ++i) {
+                std::unique_lock<std::shared_mutex> lock(shards_[i].mutex);
+                std::vector<Slot>().swap(shards_[i].slots);
+                shards_[i].size = 0;
+                shards_[i].erased = 0;
+            }
+            size_.store(0, std::memory_order_relaxed);
+        }
+
+        size_t size() const {
+            return size_.load(std::memory_order_relaxed);
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        // bytes used by the slots of all shards
+        size_t memory_usage() const {
+            size_t bytes = 0;
+            for (size_t i = 0; i < num_shards_; ++i) {
+                std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+                bytes += shards_[i].slots.capacity() * sizeof(Slot);
+            }
+            return bytes;
+        }
+
+        // visit all the entries, shard by shard, the shard being
+        // visited is read locked, fn should not modify the map
+        template<typename Fn>
+        void for_each(Fn &&fn) const {
+            for (size_t i = 0; i < num_shards_; ++i) {
+                std::shared_lock<std::shared_mutex> lock(shards_[i].mutex);
+                for (auto &slot: shards_[i].slots) {
+                    if (slot.location < kErased) {
+                        fn(slot.label, slot.location);
+                    }
+                }
+            }
+        }
+
+    private:
+        static uint64_t hash_label(LabelType label) {
+            // murmur3 finalizer, labels are often dense integers
+            uint64_t h = label;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdULL;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ULL;
+            h ^= h >> 33;
+            return h;
+        }
+
+        size_t shard_of(uint64_t hash) const {
+            return shard_bits_ == 0 ? 0 : static_cast<size_t>(hash >> (64 - shard_bits_));
+        }
+
+        // keep load factor under 3/4
+        static size_t capacity_for(size_t n) {
+            size_t cap = 16;
+            while (cap * 3 < n * 4) {
+                cap <<= 1;
+            }
+            return cap;
+        }
+
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            std::vector<Slot> slots;
+            size_t size{0};
+            size_t erased{0};
+
+            const Slot *lookup(LabelType label, uint64_t hash) const {
+                if (slots.empty()) {
+                    return nullptr;
+                }
+                size_t mask = slots.size() - 1;
+                for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                    auto &slot = slots[i];
+                    if (slot.location == kEmpty) {
+                        return nullptr;
+                    }
+                    if (slot.location != kErased && slot.label == label) {
+                        return &slot;
+                    }
+                }
+            }
+
+            LocationType upsert(LabelType label, uint64_t hash, LocationType location, bool overwrite,
+                                bool &inserted) {
+                if (slots.empty() || (size + erased + 1) * 4 > slots.size() * 3) {
+                    // if the table is full of erased slots, rehash in place
+                    rehash(capacity_for(size + 1));
+                }
+                size_t mask = slots.size() - 1;
+                Slot *reuse = nullptr;
+                for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                    auto &slot = slots[i];
+                    if (slot.location == kEmpty) {
+                        break;
+                    }
+                    if (slot.location == kErased) {
+                        if (reuse == nullptr) {
+                            reuse = &slot;
+                        }
+                        continue;
+                    }
+                    if (slot.label == label) {
+                        inserted = false;
+                        if (overwrite) {
+                            slot.location = location;
+                        }
+                        return slot.location;
+                    }
+                }
+                // not found, the first reusable slot is either the erased one
+                // on the probe path or the empty one terminating it
+                if (reuse == nullptr) {
+                    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+                        if (slots[i].location == kEmpty) {
+                            reuse = &slots[i];
+                            break;
+                        }
+                    }
+                } else {
+                    --erased;
+                }
+                reuse->label = label;
+                reuse->location = location;
+                ++size;
+                inserted = true;
+                return location;
+            }
+
+            void rehash(size_t new_cap) {
+                if (new_cap <= slots.size() && erased == 0) {
+                    return;
+                }
+                new_cap = std::max(new_cap, capacity_for(size));
+                std::vector<Slot> old(new_cap, Slot{0, kEmpty});
+                old.swap(slots);
+                erased = 0;
+                size_t mask = slots.size() - 1;
+                for (auto &slot: old) {
+                    if (slot.location >= kErased) {
+                        continue;
+                    }
+                    for (size_t i = hash_label(slot.label) & mask;; i = (i + 1) & mask) {
+                        if (slots[i].location == kEmpty) {
+                            slots[i] = slot;
+                            break;
+                        }
+                    }
+                }
+            }
+        };
+
+        size_t shard_bits_{0};
+        size_t num_shards_{0};
+        std::unique_ptr<Shard[]> shards_;
+        std::atomic<size_t> size_{0};
+    };
+
+}  // namespace phekda
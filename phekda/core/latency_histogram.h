@@ -0,0 +1,142 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-26.
+//
+
+#pragma once
+
+#include <turbo/times/time.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace phekda {
+
+    struct HistogramSnapshot {
+        uint64_t count{0};
+        // in nanoseconds
+        uint64_t sum{0};
+        uint64_t max{0};
+        uint64_t p50{0};
+        uint64_t p90{0};
+        uint64_t p99{0};
+        uint64_t p999{0};
+
+        double mean() const {
+            return count == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(count);
+        }
+    };
+
+    /**
+     * @class LatencyHistogram
+     * @brief lock free log linear histogram of latencies in nanoseconds, in the
+     *        spirit of HdrHistogram: every power of two is split in 16 linear
+     *        buckets, so a percentile is off by less than 1/16 of its value.
+     *        recording is one relaxed add on the bucket of the value
+     */
+    class LatencyHistogram {
+    public:
+        static constexpr int kSubBits = 4;
+        static constexpr uint64_t kSubBuckets = uint64_t(1) << kSubBits;
+        // values from 2^kMaxBits ns on, about 39 hours, share the last bucket
+        static constexpr int kMaxBits = 47;
+        static constexpr size_t kBuckets = (kMaxBits - kSubBits + 2) * kSubBuckets;
+
+        void record(uint64_t nanos) {
+            buckets_[bucket_of(nanos)].fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(nanos, std::memory_order_relaxed);
+            auto seen = max_.load(std::memory_order_relaxed);
+            while (nanos > seen && !max_.compare_exchange_weak(seen, nanos, std::memory_order_relaxed)) {
+            }
+        }
+
+        void record(turbo::Duration duration) {
+            record(static_cast<uint64_t>(std::max<int64_t>(duration.to_nanoseconds(), 0)));
+        }
+
+        // counts read bucket by bucket, a snapshot taken while recording may
+        // be off by the records in flight
+        HistogramSnapshot snapshot() const {
+            HistogramSnapshot snap;
+            uint64_t counts[kBuckets];
+            for (size_t i = 0; i < kBuckets; ++i) {
+                counts[i] = buckets_[i].load(std::memory_order_relaxed);
+                snap.count += counts[i];
+            }
+            snap.sum = sum_.load(std::memory_order_relaxed);
+            snap.max = max_.load(std::memory_order_relaxed);
+            if (snap.count == 0) {
+                return snap;
+            }
+            struct Target {
+                double quantile;
+                uint64_t *value;
+            };
+            Target targets[] = {{0.5, &snap.p50}, {0.9, &snap.p90}, {0.99, &snap.p99}, {0.999, &snap.p999}};
+            uint64_t seen = 0;
+            size_t t = 0;
+            for (size_t i = 0; i < kBuckets && t < 4; ++i) {
+                seen += counts[i];
+                while (t < 4 && seen >= targets[t].quantile * static_cast<double>(snap.count)) {
+                    // the highest value of the bucket, never above the max seen
+                    *targets[t].value = std::min(bucket_upper(i), snap.max);
+                    ++t;
+                }
+            }
+            return snap;
+        }
+
+        // not atomic with respect to concurrent records
+        void reset() {
+            for (auto &bucket: buckets_) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+            sum_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        static size_t bucket_of(uint64_t value) {
+            if (value < kSubBuckets) {
+                return static_cast<size_t>(value);
+            }
+            int msb = 63 - __builtin_clzll(value);
+            if (msb > kMaxBits) {
+                return kBuckets - 1;
+            }
+            int shift = msb - kSubBits;
+            return static_cast<size_t>((shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1)));
+        }
+
+        // highest value falling in bucket i
+        static uint64_t bucket_upper(size_t i) {
+            if (i < kSubBuckets) {
+                return i;
+            }
+            uint64_t shift = i / kSubBuckets - 1;
+            uint64_t sub = i % kSubBuckets;
+            return ((kSubBuckets + sub + 1) << shift) - 1;
+        }
+
+    private:
+        std::atomic<uint64_t> buckets_[kBuckets]{};
+        std::atomic<uint64_t> sum_{0};
+        std::atomic<uint64_t> max_{0};
+    };
+
+}  // namespace phekda
@@ -0,0 +1,190 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-23.
+//
+
+#pragma once
+
+#include <turbo/utility/status.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+namespace phekda {
+
+    // placement of index memory on multi socket machines, talks to the
+    // kernel directly so no libnuma is needed
+    enum class NumaPolicy {
+        NUMA_NONE,
+        // pages spread round robin over all nodes
+        NUMA_INTERLEAVE,
+        // pages on one node, see numa_node in the index config
+        NUMA_BIND,
+        // a read only copy of the index per node, searches use the copy of
+        // the node they run on. a single copy is placed like NUMA_BIND
+        NUMA_REPLICATE
+    };
+
+    namespace detail {
+        // parse a kernel cpu or node list like "0-3,8,10-11"
+        inline std::vector<int> parse_id_list(const std::string &list) {
+            std::vector<int> ids;
+            size_t pos = 0;
+            while (pos < list.size()) {
+                size_t end = list.find(',', pos);
+                if (end == std::string::npos) {
+                    end = list.size();
+                }
+                auto item = list.substr(pos, end - pos);
+                int lo, hi;
+                if (sscanf(item.c_str(), "%d-%d", &lo, &hi) == 2) {
+                    for (int i = lo; i <= hi; ++i) {
+                        ids.push_back(i);
+                    }
+                } else if (sscanf(item.c_str(), "%d", &lo) == 1) {
+                    ids.push_back(lo);
+                }
+                pos = end + 1;
+            }
+            return ids;
+        }
+
+        inline std::string read_sys_line(const std::string &path) {
+            std::string line;
+            FILE *fp = fopen(path.c_str(), "r");
+            if (fp == nullptr) {
+                return line;
+            }
+            char buf[4096];
+            if (fgets(buf, sizeof(buf), fp)) {
+                line = buf;
+            }
+            fclose(fp);
+            while (!line.empty() && (line.back() == '\n' || line.back() == ' ')) {
+                line.pop_back();
+            }
+            return line;
+        }
+    }  // namespace detail
+
+    // online nodes, node ids are assumed dense from 0, at least one
+    inline int numa_num_nodes() {
+        static const int nodes = [] {
+            auto ids = detail::parse_id_list(detail::read_sys_line("/sys/devices/system/node/online"));
+            return ids.empty() ? 1 : ids.back() + 1;
+        }();
+        return nodes;
+    }
+
+    // cpus of the node, empty if unknown
+    inline std::vector<int> numa_node_cpus(int node) {
+        return detail::parse_id_list(
+                detail::read_sys_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    }
+
+    // node of the cpu the calling thread runs on. on the search path, so the
+    // cpu comes from sched_getcpu, served by the vdso without a kernel entry,
+    // and the node from a cpu to node table read once
+    inline int numa_current_node() {
+#ifdef __linux__
+        static const std::vector<int> cpu_nodes = [] {
+            std::vector<int> nodes;
+            for (int node = 0; node < numa_num_nodes(); ++node) {
+                for (auto cpu: numa_node_cpus(node)) {
+                    if (static_cast<size_t>(cpu) >= nodes.size()) {
+                        nodes.resize(cpu + 1, 0);
+                    }
+                    nodes[cpu] = node;
+                }
+            }
+            return nodes;
+        }();
+        int cpu = sched_getcpu();
+        if (cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes.size()) {
+            return cpu_nodes[cpu];
+        }
+#endif
+        return 0;
+    }
+
+    // set the placement of the pages in [ptr, ptr + bytes) not faulted in yet,
+    // the range is widened to whole pages
+    inline turbo::Status numa_place(void *ptr, size_t bytes, NumaPolicy policy, int node) {
+        if (policy == NumaPolicy::NUMA_NONE || ptr == nullptr || bytes == 0) {
+            return turbo::OkStatus();
+        }
+#if defined(__linux__) && defined(SYS_mbind)
+        int nodes = numa_num_nodes();
+        if (node < 0 || node >= nodes) {
+            return turbo::invalid_argument_error("numa node out of range");
+        }
+        std::vector<unsigned long> mask((nodes + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)), 0);
+        auto set_node = [&](int n) {
+            mask[n / (8 * sizeof(unsigned long))] |= 1UL << (n % (8 * sizeof(unsigned long)));
+        };
+        int mode = MPOL_BIND;
+        if (policy == NumaPolicy::NUMA_INTERLEAVE) {
+            mode = MPOL_INTERLEAVE;
+            for (int n = 0; n < nodes; ++n) {
+                set_node(n);
+            }
+        } else {
+            set_node(node);
+        }
+        auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<uintptr_t>(ptr) & ~(page - 1);
+        auto end = (reinterpret_cast<uintptr_t>(ptr) + bytes + page - 1) & ~(page - 1);
+        if (syscall(SYS_mbind, begin, end - begin, mode, mask.data(), nodes + 1, 0) != 0) {
+            return turbo::internal_error("mbind failed");
+        }
+#endif
+        return turbo::OkStatus();
+    }
+
+    // run the calling thread only on the cpus of node
+    inline turbo::Status numa_pin_thread(int node) {
+        if (node < 0 || node >= numa_num_nodes()) {
+            return turbo::invalid_argument_error("numa node out of range");
+        }
+#ifdef __linux__
+        auto cpus = numa_node_cpus(node);
+        if (cpus.empty()) {
+            return turbo::not_found_error("no cpu found on the numa node");
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu: cpus) {
+            CPU_SET(cpu, &set);
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            return turbo::internal_error("sched_setaffinity failed");
+        }
+#endif
+        return turbo::OkStatus();
+    }
+
+}  // namespace phekda
@@ -0,0 +1,154 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-23.
+//
+
+#pragma once
+
+#include <phekda/core/numa.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace phekda {
+
+    /**
+     * @class NumaWorkerPool
+     * @brief worker threads pinned per numa node, a task submitted to a node
+     *        runs on the cpus of that node, so a search reads the replica or
+     *        the shard placed on the same node
+     */
+    class NumaWorkerPool {
+    public:
+        NumaWorkerPool() = default;
+
+        ~NumaWorkerPool() {
+            stop();
+        }
+
+        NumaWorkerPool(const NumaWorkerPool &) = delete;
+
+        NumaWorkerPool &operator=(const NumaWorkerPool &) = delete;
+
+        // threads_per_node workers on every node, 0 means one per cpu of the node
+        turbo::Status start(size_t threads_per_node = 0) {
+            if (!threads_.empty()) {
+                return turbo::already_exists_error("numa worker pool already started");
+            }
+            int nodes = numa_num_nodes();
+            for (int node = 0; node < nodes; ++node) {
+                queues_.push_back(std::make_unique<NodeQueue>());
+            }
+            for (int node = 0; node < nodes; ++node) {
+                size_t n = threads_per_node;
+                if (n == 0) {
+                    n = std::max<size_t>(numa_node_cpus(node).size(), 1);
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    threads_.emplace_back([this, node] { run(node); });
+                }
+            }
+            return turbo::OkStatus();
+        }
+
+        // finish the queued tasks and join the workers
+        void stop() {
+            for (auto &queue: queues_) {
+                std::lock_guard<std::mutex> lock(queue->mutex);
+                queue->stopping = true;
+                queue->cv.notify_all();
+            }
+            for (auto &thread: threads_) {
+                thread.join();
+            }
+            threads_.clear();
+            queues_.clear();
+        }
+
+        // run task on a worker of node, node out of range wraps around. a pool
+        // not started or stopped runs the task on the caller
+        std::future<void> submit(int node, std::function<void()> task) {
+            std::packaged_task<void()> packaged(std::move(task));
+            auto future = packaged.get_future();
+            if (queues_.empty()) {
+                packaged();
+                return future;
+            }
+            auto &queue = *queues_[static_cast<size_t>(node) % queues_.size()];
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(std::move(packaged));
+            }
+            queue.cv.notify_one();
+            return future;
+        }
+
+        // run task on the nodes in turn
+        std::future<void> submit(std::function<void()> task) {
+            return submit(static_cast<int>(next_node_.fetch_add(1, std::memory_order_relaxed)), std::move(task));
+        }
+
+        int num_nodes() const {
+            return static_cast<int>(queues_.size());
+        }
+
+        size_t num_threads() const {
+            return threads_.size();
+        }
+
+    private:
+        struct NodeQueue {
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::packaged_task<void()>> tasks;
+            bool stopping{false};
+        };
+
+        void run(int node) {
+            // not fatal, the worker still runs, just not node local
+            (void) numa_pin_thread(node);
+            auto &queue = *queues_[node];
+            while (true) {
+                std::packaged_task<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(queue.mutex);
+                    queue.cv.wait(lock, [&] { return queue.stopping || !queue.tasks.empty(); });
+                    if (queue.tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        std::vector<std::unique_ptr<NodeQueue>> queues_;
+        std::vector<std::thread> threads_;
+        std::atomic<size_t> next_node_{0};
+    };
+
+}  // namespace phekda
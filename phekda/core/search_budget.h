@@ -0,0 +1,70 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-29.
+//
+
+#pragma once
+
+#include <phekda/core/search_stats.h>
+#include <turbo/times/time.h>
+#include <cstdint>
+
+namespace phekda {
+
+    /**
+     * @struct SearchBudget
+     * @brief per query limits on the work of a search. a search running out
+     *        of budget stops and returns the best results found so far,
+     *        flagged as partial, so overload costs recall and not answers
+     *
+     * a zero limit, and a default Time() deadline, is no limit.
+     */
+    struct SearchBudget {
+        // the clock is read once every kClockInterval hops
+        static constexpr uint64_t kClockInterval = 16;
+
+        turbo::Time deadline;
+        // hops of the whole search, the upper layers included
+        uint64_t max_hops{0};
+        uint64_t max_distance_computations{0};
+
+        bool limited() const {
+            return deadline != turbo::Time() || max_hops != 0 || max_distance_computations != 0;
+        }
+
+        // checked once per hop with the work counted so far
+        bool exhausted(const SearchStats &stats) const {
+            if (max_hops != 0 && stats.hops >= max_hops) {
+                return true;
+            }
+            if (max_distance_computations != 0 && stats.distance_computations >= max_distance_computations) {
+                return true;
+            }
+            return deadline != turbo::Time() && stats.hops % kClockInterval == 0 &&
+                   turbo::Time::current_time() >= deadline;
+        }
+
+        void clear() {
+            deadline = turbo::Time();
+            max_hops = 0;
+            max_distance_computations = 0;
+        }
+    };
+
+}  // namespace phekda
@@ -43,8 +43,8 @@ namespace phekda {
             return false;
         }
 
-        // if the search condition should explain the search process
-        // now not used
+        // if the search condition should explain the search process,
+        // the index then records a SearchTrace into the search context
         virtual bool should_explain() const {
             return false;
         }
@@ -24,8 +24,15 @@
 #include <vector>
 #include <phekda/core/defines.h>
 #include <phekda/core/search_condition.h>
+#include <phekda/core/bounded_heap.h>
+#include <phekda/core/search_trace.h>
+#include <phekda/core/search_budget.h>
 #include <turbo/times/time.h>
+#include <turbo/container/span.h>
+#include <turbo/utility/status.h>
 #include <any>
+#include <cstdint>
+#include <memory>
 
 namespace phekda {
 
@@ -58,9 +65,12 @@ namespace phekda {
 
         // query vector
         AlingedQueryVector query;
+        // borrowed query set by with_query_view, owned by the caller and
+        // used in place of query while not nullptr
+        const uint8_t *query_view{nullptr};
         // top k search result
         uint32_t top_k{0};
-        // search list size
+        // search list size, ef of a hnsw search, 0 keeps the ef of the index
         uint32_t search_list_size{0};
         // if true, search result will take location into account
         // this mostly used in debug mode
@@ -99,8 +109,48 @@ namespace phekda {
         // if with_location is true, the location field will be filled
         // otherwise, the location field always be 0
         std::vector<ResultEntity> results;
-        // raw vectors if with_raw_vector is true
-        std::vector<std::vector<uint8_t>> raw_vectors;
+        // raw vectors if with_raw_vector is true, one contiguous buffer of
+        // results.size() rows of data_size bytes, row i is the vector of results[i]
+        std::vector<uint8_t> raw_vectors;
+        // working memory of the index search, kept with the context so a
+        // reused context searches without touching the index's shared pool.
+        // nullptr means the index uses its own pool
+        std::unique_ptr<SearchScratch> scratch;
+        // limits on the work of the search, none by default
+        SearchBudget budget;
+        // work done by the last search, filled by the index
+        SearchStats stats;
+        // the last search ran out of budget, results are the best found
+        // until then and may miss closer vectors
+        bool partial{false};
+        // how the last search went, only recorded when the condition
+        // should_explain(), nullptr otherwise
+        std::unique_ptr<SearchTrace> trace;
+
+        // clear the per query state, keep the buffers and the basic
+        // information set by UnifiedIndex. the context is as returned by
+        // create_search_context, apart from the capacity it holds
+        void reset() {
+            worker_num = 1;
+            query.clear();
+            query_view = nullptr;
+            top_k = 0;
+            search_list_size = 0;
+            with_location = false;
+            with_raw_vector = false;
+            index_conf.reset();
+            reverse_result = false;
+            start_time = turbo::Time::current_time();
+            schedule_time = turbo::Time();
+            end_time = turbo::Time();
+            condition = nullptr;
+            results.clear();
+            raw_vectors.clear();
+            budget.clear();
+            stats = SearchStats();
+            partial = false;
+            trace.reset();
+        }
 
         /// builder section
         SearchContext& with_worker_num(uint32_t num) {
@@ -109,10 +159,32 @@ namespace phekda {
         }
 
         SearchContext& with_query(const turbo::Nonnull<const uint8_t *> query_ptr) {
+            this->query_view = nullptr;
             this->query.assign(query_ptr, query_ptr + data_size);
             return *this;
         }
 
+        // borrow the query without a copy, the buffer must stay valid until
+        // the search returns. a buffer not aligned to aligned_bytes is copied
+        // into query instead, the search kernels expect aligned data.
+        // eg. each row of an aligned batch matrix, with a row stride that is
+        // a multiple of aligned_bytes
+        turbo::Status with_query_view(turbo::span<const uint8_t> view) {
+            if (view.data() == nullptr || view.size() < data_size) {
+                return turbo::invalid_argument_error("query view smaller than the query size");
+            }
+            if (reinterpret_cast<uintptr_t>(view.data()) % aligned_bytes != 0) {
+                with_query(view.data());
+                return turbo::OkStatus();
+            }
+            this->query_view = view.data();
+            return turbo::OkStatus();
+        }
+
+        TURBO_MUST_USE_RESULT bool is_query_borrowed() const {
+            return query_view != nullptr;
+        }
+
         SearchContext& with_top_k(uint32_t k) {
             this->top_k = k;
             return *this;
@@ -138,22 +210,57 @@ namespace phekda {
             return *this;
         }
 
+        SearchContext& with_reverse_result(bool flags) {
+            this->reverse_result = flags;
+            return *this;
+        }
+
         SearchContext& with_condition(turbo::Nullable<SearchCondition*> cond) {
             this->condition = cond;
             return *this;
         }
 
+        SearchContext& with_deadline(turbo::Time deadline) {
+            this->budget.deadline = deadline;
+            return *this;
+        }
+
+        // deadline relative to start_time, the time spent queued counts
+        SearchContext& with_timeout(turbo::Duration timeout) {
+            this->budget.deadline = start_time + timeout;
+            return *this;
+        }
+
+        SearchContext& with_max_hops(uint64_t hops) {
+            this->budget.max_hops = hops;
+            return *this;
+        }
+
+        SearchContext& with_max_distance_computations(uint64_t computations) {
+            this->budget.max_distance_computations = computations;
+            return *this;
+        }
+
         TURBO_MUST_USE_RESULT const void* get_query() const {
-            return query.data();
+            return query_view != nullptr ? static_cast<const void *>(query_view) : query.data();
         }
 
         // some index need normalized query
         // to the corresponding metric space
         // eg. cosine space, l2 space
+        // a borrowed query is copied first, the caller's buffer is never written
         void * mutable_query() {
+            if (query_view != nullptr) {
+                with_query(query_view);
+            }
             return query.data();
         }
 
+        // raw vector of results[i], only valid if with_raw_vector is true
+        TURBO_MUST_USE_RESULT const uint8_t *raw_vector(size_t i) const {
+            return raw_vectors.data() + i * data_size;
+        }
+
         TURBO_MUST_USE_RESULT bool has_condition() const {
             return condition != nullptr;
         }
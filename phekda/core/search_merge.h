@@ -0,0 +1,106 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+
+#pragma once
+
+#include <phekda/core/search_context.h>
+#include <phekda/core/bounded_heap.h>
+#include <algorithm>
+#include <vector>
+
+namespace phekda {
+
+    namespace detail {
+        // head of the sorted results of one part in the merge
+        struct MergeHead {
+            DistanceType distance;
+            size_t part;
+            size_t pos;
+        };
+
+        struct FurtherHead {
+            bool operator()(const MergeHead &lhs, const MergeHead &rhs) const {
+                return lhs.distance > rhs.distance;
+            }
+        };
+    }  // namespace detail
+
+    // set up sub, created by the index of a part, to search the query of
+    // context, the query is borrowed. the caller may replace the condition
+    inline turbo::Status prepare_part_search(const SearchContext &context, SearchContext &sub) {
+        turbo::span<const uint8_t> query(static_cast<const uint8_t *>(context.get_query()), context.data_size);
+        auto rs = sub.with_query_view(query);
+        if (!rs.ok()) {
+            return rs;
+        }
+        sub.with_top_k(context.top_k)
+                .with_search_list_size(context.search_list_size)
+                .with_condition(context.condition)
+                .with_with_location(context.with_location)
+                .with_with_raw_vector(context.with_raw_vector);
+        sub.budget = context.budget;
+        sub.start_time = context.start_time;
+        return turbo::OkStatus();
+    }
+
+    // merge the top k of searches of one query over disjoint parts of an
+    // index, each sorted closer first, into context. stats are summed and
+    // the search is partial if any part was
+    inline void merge_part_results(const std::vector<SearchContext> &subs, SearchContext &context) {
+        BinaryHeap<detail::MergeHead, detail::FurtherHead> heads;
+        context.stats = SearchStats();
+        context.partial = false;
+        for (size_t i = 0; i < subs.size(); ++i) {
+            if (!subs[i].results.empty()) {
+                heads.push({subs[i].results[0].distance, i, 0});
+            }
+            context.stats += subs[i].stats;
+            context.partial = context.partial || subs[i].partial;
+        }
+        context.stats.queries = 1;
+        context.results.clear();
+        context.raw_vectors.clear();
+        size_t data_size = context.data_size;
+        while (!heads.empty() && context.results.size() < context.top_k) {
+            auto head = heads.top();
+            heads.pop();
+            auto &sub = subs[head.part];
+            context.results.push_back(sub.results[head.pos]);
+            if (context.with_raw_vector) {
+                auto *row = sub.raw_vector(head.pos);
+                context.raw_vectors.insert(context.raw_vectors.end(), row, row + data_size);
+            }
+            if (head.pos + 1 < sub.results.size()) {
+                heads.push({sub.results[head.pos + 1].distance, head.part, head.pos + 1});
+            }
+        }
+        if (context.reverse_result) {
+            std::reverse(context.results.begin(), context.results.end());
+            size_t n = context.with_raw_vector ? context.results.size() : 0;
+            for (size_t i = 0; i < n / 2; ++i) {
+                std::swap_ranges(context.raw_vectors.begin() + i * data_size,
+                                 context.raw_vectors.begin() + (i + 1) * data_size,
+                                 context.raw_vectors.begin() + (n - 1 - i) * data_size);
+            }
+        }
+    }
+
+}  // namespace phekda
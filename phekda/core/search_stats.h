@@ -0,0 +1,115 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-25.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace phekda {
+
+    // work done by a search, per query in SearchContext::stats or summed
+    // over the queries of an index
+    struct SearchStats {
+        // queries, 1 for a single query
+        uint64_t queries{0};
+        // graph nodes whose neighbor list was read
+        uint64_t hops{0};
+        uint64_t distance_computations{0};
+        // candidates close enough for the results but rejected by the
+        // search condition or the delete mark
+        uint64_t filtered_out{0};
+        // nodes marked in the visited list
+        uint64_t visited{0};
+
+        SearchStats &operator+=(const SearchStats &other) {
+            queries += other.queries;
+            hops += other.hops;
+            distance_computations += other.distance_computations;
+            filtered_out += other.filtered_out;
+            visited += other.visited;
+            return *this;
+        }
+    };
+
+    /**
+     * @class StripedSearchStats
+     * @brief search totals of an index. each thread adds its finished queries
+     *        to its own cache line stripe, so concurrent searches do not
+     *        bounce a shared counter; reading sums the stripes
+     */
+    class StripedSearchStats {
+    public:
+        static constexpr size_t kStripes = 32;
+
+        void add(const SearchStats &stats) {
+            auto &stripe = stripes_[stripe_index()];
+            stripe.queries.fetch_add(stats.queries, std::memory_order_relaxed);
+            stripe.hops.fetch_add(stats.hops, std::memory_order_relaxed);
+            stripe.distance_computations.fetch_add(stats.distance_computations, std::memory_order_relaxed);
+            stripe.filtered_out.fetch_add(stats.filtered_out, std::memory_order_relaxed);
+            stripe.visited.fetch_add(stats.visited, std::memory_order_relaxed);
+        }
+
+        SearchStats total() const {
+            SearchStats stats;
+            for (auto &stripe: stripes_) {
+                stats.queries += stripe.queries.load(std::memory_order_relaxed);
+                stats.hops += stripe.hops.load(std::memory_order_relaxed);
+                stats.distance_computations += stripe.distance_computations.load(std::memory_order_relaxed);
+                stats.filtered_out += stripe.filtered_out.load(std::memory_order_relaxed);
+                stats.visited += stripe.visited.load(std::memory_order_relaxed);
+            }
+            return stats;
+        }
+
+        // not atomic with respect to concurrent adds
+        void reset() {
+            for (auto &stripe: stripes_) {
+                stripe.queries.store(0, std::memory_order_relaxed);
+                stripe.hops.store(0, std::memory_order_relaxed);
+                stripe.distance_computations.store(0, std::memory_order_relaxed);
+                stripe.filtered_out.store(0, std::memory_order_relaxed);
+                stripe.visited.store(0, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        // threads take the stripes in turn, shared by all indexes
+        static size_t stripe_index() {
+            static std::atomic<size_t> next{0};
+            thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+            return index;
+        }
+
+        struct alignas(64) Stripe {
+            std::atomic<uint64_t> queries{0};
+            std::atomic<uint64_t> hops{0};
+            std::atomic<uint64_t> distance_computations{0};
+            std::atomic<uint64_t> filtered_out{0};
+            std::atomic<uint64_t> visited{0};
+        };
+
+        Stripe stripes_[kStripes];
+    };
+
+}  // namespace phekda
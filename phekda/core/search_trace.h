@@ -0,0 +1,79 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-26.
+//
+
+#pragma once
+
+#include <phekda/core/defines.h>
+#include <turbo/times/time.h>
+#include <vector>
+
+namespace phekda {
+
+    // a greedy move to a closer node in the upper layers
+    struct SearchTraceStep {
+        int level{0};
+        LocationType from{0};
+        LocationType to{0};
+        // distance of the query to `to`
+        DistanceType distance{0.0};
+    };
+
+    // state of the level 0 search when a candidate is expanded
+    struct SearchTraceSample {
+        LocationType node{0};
+        // distance of the expanded candidate
+        DistanceType distance{0.0};
+        // furthest result kept, the bound a new candidate has to beat
+        DistanceType lower_bound{0.0};
+        size_t candidates{0};
+        size_t results{0};
+        // candidates rejected so far
+        uint64_t filtered_out{0};
+    };
+
+    /**
+     * @struct SearchTrace
+     * @brief how a search went, recorded into SearchContext::trace when the
+     *        search condition asks to explain. searches not asking run code
+     *        compiled without any of the recording
+     */
+    struct SearchTrace {
+        // top level and entry point of the graph, distance to the query
+        int max_level{0};
+        LocationType entry_point{0};
+        DistanceType entry_distance{0.0};
+        // the greedy path from the entry point down to level 1
+        std::vector<SearchTraceStep> upper_path;
+        // hops per level, index is the level
+        std::vector<uint64_t> level_hops;
+        // level 0 entry, the end of the upper path
+        LocationType level0_entry{0};
+        // one sample per expanded level 0 candidate, in expansion order
+        std::vector<SearchTraceSample> level0;
+        // candidates rejected by the search condition or the delete mark
+        uint64_t filtered_out{0};
+        // time per phase
+        turbo::Duration upper_layers_time;
+        turbo::Duration level0_time;
+        turbo::Duration results_time;
+    };
+
+}  // namespace phekda
@@ -0,0 +1,95 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace phekda {
+
+    /**
+     * @class ByteSpinLock
+     * @brief one byte spin lock, meant to be placed inside existing memory
+     *
+     * The lock is a single byte, 0 means unlocked, so a zeroed byte is a valid
+     * unlocked lock and it can be embedded into an element header. Use it with
+     * std::unique_lock / std::lock_guard through ByteSpinLock::at(ptr).
+     * Waiters spin for a short while and then yield, so long holders do not
+     * burn a whole core.
+     */
+    class ByteSpinLock {
+    public:
+        ByteSpinLock() = default;
+
+        ByteSpinLock(const ByteSpinLock &) = delete;
+
+        ByteSpinLock &operator=(const ByteSpinLock &) = delete;
+
+        // view the byte at ptr as a lock
+        static ByteSpinLock &at(void *ptr) {
+            return *reinterpret_cast<ByteSpinLock *>(ptr);
+        }
+
+        void lock() {
+            for (size_t spins = 0; flag_.exchange(1, std::memory_order_acquire) != 0;) {
+                while (flag_.load(std::memory_order_relaxed) != 0) {
+                    if (++spins < kSpinLimit) {
+                        pause();
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+
+        bool try_lock() {
+            return flag_.load(std::memory_order_relaxed) == 0 &&
+                   flag_.exchange(1, std::memory_order_acquire) == 0;
+        }
+
+        void unlock() {
+            flag_.store(0, std::memory_order_release);
+        }
+
+        bool is_locked() const {
+            return flag_.load(std::memory_order_relaxed) != 0;
+        }
+
+    private:
+        static constexpr size_t kSpinLimit = 128;
+
+        static void pause() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+
+        std::atomic<uint8_t> flag_{0};
+    };
+
+    static_assert(sizeof(ByteSpinLock) == 1, "ByteSpinLock should be one byte");
+
+}  // namespace phekda
@@ -20,8 +20,13 @@
 //
 #pragma once
 
-#include <unordered_map>
+#include <phekda/core/label_map.h>
+#include <phekda/core/chunked_arena.h>
+#include <phekda/core/bounded_heap.h>
+#include <phekda/core/cow_snapshot.h>
+#include <atomic>
 #include <mutex>
+#include <shared_mutex>
 #include <algorithm>
 #include <assert.h>
 #include <turbo/log/logging.h>
@@ -30,33 +35,49 @@ namespace phekda {
 
     class BruteforceSearch : public AlgorithmInterface {
     public:
-        char *data_;
-        size_t cur_element_count;
+        // data and label of each element, grows in chunks
+        ChunkedArena data_;
+        std::atomic<size_t> cur_element_count;
+        // max number of elements, raised when adding in auto grow mode
+        std::atomic<size_t> max_elements_{0};
         size_t size_per_element_;
         uint64_t snapshot_id_{0};
 
         size_t data_size_;
         DISTFUNC<DistanceType> fstdistfunc_;
         void *dist_func_param_;
-        std::mutex index_lock;
+        // shared by point operations, exclusive by markDelete which moves elements
+        std::shared_mutex index_lock;
+        // serializes the allocation of new slots
+        std::mutex append_lock;
+        // the rows as they were when the running save started, writers
+        // preserve a row before changing it
+        CowSnapshot snapshot_;
+        // shared by the writers, closed to start and end a snapshot
+        SnapshotGate snapshot_gate_;
+        // one save at a time
+        std::mutex save_lock_;
 
         HnswlibConfig hnsw_conf;
         CoreConfig core_conf;
 
-        std::unordered_map<LabelType, size_t> dict_external_to_internal;
+        LabelMap dict_external_to_internal;
+
+        // search totals, per query numbers go to SearchContext::stats
+        mutable StripedSearchStats search_stats_;
+        // elements scanned between two budget checks, a stride is a hop
+        // for SearchBudget::max_hops
+        static constexpr size_t kScanStride = 64;
 
 
         BruteforceSearch()
-                : data_(nullptr),
-                  cur_element_count(0),
+                : cur_element_count(0),
                   size_per_element_(0),
                   data_size_(0),
                   dist_func_param_(nullptr) {
         }
 
-        ~BruteforceSearch() {
-            free(data_);
-        }
+        ~BruteforceSearch() = default;
 
         turbo::Status initialize(const CoreConfig &config, const HnswlibConfig &hnswlib_config) override {
             hnsw_conf = hnswlib_config;
@@ -64,13 +85,16 @@ namespace phekda {
             if(!hnswlib_config.space) {
                 return turbo::invalid_argument_error("space is null");
             }
+            if (hnswlib_config.dense_label) {
+                return turbo::invalid_argument_error("dense label mode is not supported by BruteforceSearch");
+            }
             data_size_ = hnswlib_config.space->get_data_size();
             fstdistfunc_ = hnswlib_config.space->get_dist_func();
             dist_func_param_ = hnswlib_config.space->get_dist_func_param();
             size_per_element_ = data_size_ + sizeof(LabelType);
-            data_ = (char *) malloc(core_conf.max_elements * size_per_element_);
-            if (data_ == nullptr) {
-                return turbo::resource_exhausted_error("Not enough memory: BruteforceSearch failed to allocate data");
+            auto rs = initStorage(core_conf.max_elements);
+            if (!rs.ok()) {
+                return rs;
             }
             cur_element_count = 0;
             return turbo::OkStatus();
@@ -81,7 +105,32 @@ namespace phekda {
         }
 
         CoreConfig get_core_config() const override {
-            return core_conf;
+            CoreConfig conf = core_conf;
+            conf.max_elements = static_cast<uint32_t>(max_elements_.load());
+            return conf;
+        }
+
+        turbo::Status initStorage(size_t max_elements) {
+            size_t chunk_elements = hnsw_conf.chunk_elements;
+            if (chunk_elements == 0) {
+                chunk_elements = std::min(std::max(max_elements, ChunkedArena::kMinChunkElements),
+                                          ChunkedArena::kDefaultChunkElements);
+            }
+            if (hnsw_conf.numa_policy != NumaPolicy::NUMA_NONE &&
+                (hnsw_conf.numa_node < 0 || hnsw_conf.numa_node >= numa_num_nodes())) {
+                return turbo::invalid_argument_error("numa node out of range");
+            }
+            auto rs = data_.initialize(size_per_element_, chunk_elements, 64, false, hnsw_conf.huge_pages);
+            if (!rs.ok()) {
+                return rs;
+            }
+            data_.set_numa(hnsw_conf.numa_policy, hnsw_conf.numa_node);
+            rs = data_.reserve(max_elements);
+            if (!rs.ok()) {
+                return rs;
+            }
+            max_elements_ = max_elements;
+            return turbo::OkStatus();
         }
 
         uint64_t snapshot_id() const override {
@@ -89,40 +138,63 @@ namespace phekda {
         }
 
         turbo::Status addPoint(const void *datapoint, LabelType label, HnswlibWriteConfig wconf) override {
-            int idx;
-            {
-                std::unique_lock<std::mutex> lock(index_lock);
-
-                auto search = dict_external_to_internal.find(label);
-                if (search != dict_external_to_internal.end()) {
-                    idx = search->second;
-                } else {
-                    if (cur_element_count >= core_conf.max_elements) {
-                        return turbo::resource_exhausted_error(
-                                "The number of elements exceeds the specified limit [%d:%d]", cur_element_count,
-                                core_conf.max_elements);
-                    }
-                    idx = cur_element_count;
-                    dict_external_to_internal[label] = idx;
-                    cur_element_count++;
+            std::shared_lock<SnapshotGate> gate(snapshot_gate_);
+            std::shared_lock<std::shared_mutex> lock(index_lock);
+            LocationType idx;
+            if (dict_external_to_internal.find(label, idx)) {
+                preserveRow(idx);
+                memcpy(data_.at(idx), datapoint, data_size_);
+                return turbo::OkStatus();
+            }
+            std::unique_lock<std::mutex> append(append_lock);
+            if (dict_external_to_internal.find(label, idx)) {
+                preserveRow(idx);
+                memcpy(data_.at(idx), datapoint, data_size_);
+                return turbo::OkStatus();
+            }
+            if (cur_element_count >= max_elements_) {
+                if (!core_conf.auto_grow) {
+                    return turbo::resource_exhausted_error(
+                            "The number of elements exceeds the specified limit [%d:%d]", cur_element_count.load(),
+                            max_elements_.load());
+                }
+                // new chunks never move the old ones, searches go on
+                auto rs = data_.reserve(cur_element_count + 1);
+                if (!rs.ok()) {
+                    return rs;
                 }
+                max_elements_ = data_.capacity();
             }
-            memcpy(data_ + size_per_element_ * idx + data_size_, &label, sizeof(LabelType));
-            memcpy(data_ + size_per_element_ * idx, datapoint, data_size_);
+            idx = cur_element_count;
+            // below the saved count once a delete moved the last row away
+            preserveRow(idx);
+            memcpy(data_.at(idx) + data_size_, &label, sizeof(LabelType));
+            memcpy(data_.at(idx), datapoint, data_size_);
+            dict_external_to_internal.insert_or_assign(label, idx);
+            cur_element_count++;
             return turbo::OkStatus();
         }
 
 
         turbo::Status markDelete(LabelType cur_external) override{
-            size_t cur_c = dict_external_to_internal[cur_external];
+            std::shared_lock<SnapshotGate> gate(snapshot_gate_);
+            std::unique_lock<std::shared_mutex> lock(index_lock);
+            LocationType cur_c;
+            if (!dict_external_to_internal.find(cur_external, cur_c)) {
+                return turbo::not_found_error("label not found");
+            }
 
             dict_external_to_internal.erase(cur_external);
 
-            LabelType label = *((LabelType *) (data_ + size_per_element_ * (cur_element_count - 1) + data_size_));
-            dict_external_to_internal[label] = cur_c;
-            memcpy(data_ + size_per_element_ * cur_c,
-                   data_ + size_per_element_ * (cur_element_count - 1),
-                   data_size_ + sizeof(LabelType));
+            LocationType last = cur_element_count - 1;
+            if (cur_c != last) {
+                LabelType label = *((LabelType *) (data_.at(last) + data_size_));
+                dict_external_to_internal.insert_or_assign(label, cur_c);
+                preserveRow(cur_c);
+                memcpy(data_.at(cur_c),
+                       data_.at(last),
+                       data_size_ + sizeof(LabelType));
+            }
             cur_element_count--;
             return turbo::OkStatus();
         }
@@ -134,8 +206,8 @@ namespace phekda {
             std::priority_queue<std::pair<DistanceType, LabelType >> topResults;
             if (cur_element_count == 0) return topResults;
             for (int i = 0; i < k; i++) {
-                DistanceType dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-                LabelType label = *((LabelType *) (data_ + size_per_element_ * i + data_size_));
+                DistanceType dist = fstdistfunc_(query_data, data_.at(i), dist_func_param_);
+                LabelType label = *((LabelType *) (data_.at(i) + data_size_));
                 if ((!isIdAllowed) || (*isIdAllowed)(label)) {
                     topResults.push(std::pair<DistanceType, LabelType>(dist, label));
                 }
@@ -143,9 +215,10 @@ namespace phekda {
             DistanceType lastdist = topResults.empty() ? std::numeric_limits<DistanceType>::max()
                                                        : topResults.top().first;
             for (int i = k; i < cur_element_count; i++) {
-                DistanceType dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-                if (dist <= lastdist) {
-                    LabelType label = *((LabelType *) (data_ + size_per_element_ * i + data_size_));
+                DistanceType dist = fstdistfunc_(query_data, data_.at(i), dist_func_param_);
+                // a filter may leave the heap short of k, keep filling it
+                if (topResults.size() < k || dist <= lastdist) {
+                    LabelType label = *((LabelType *) (data_.at(i) + data_size_));
                     if ((!isIdAllowed) || (*isIdAllowed)(label)) {
                         topResults.push(std::pair<DistanceType, LabelType>(dist, label));
                     }
@@ -162,86 +235,205 @@ namespace phekda {
 
         turbo::Status search(SearchContext &context) override {
             context.schedule_time = turbo::Time::current_time();
-            MaxResultQueue topResults;
+            context.partial = false;
             if (cur_element_count == 0) {
                 context.end_time = turbo::Time::current_time();
                 return turbo::OkStatus();
             }
+            // a context carrying its own scratch reuses its result heap
+            SearchScratch local;
+            ResultHeap &topResults = context.scratch ? context.scratch->results : local.results;
+            topResults.reset(context.top_k);
             auto query_data = context.get_query();
-            for (int i = 0; i < context.top_k; i++) {
-                DistanceType dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-                LabelType label = *((LabelType *) (data_ + size_per_element_ * i + data_size_));
-                if (!context.is_exclude(label)) {
-                    topResults.push({dist, label, i});
-                }
+            size_t count = cur_element_count;
+            SearchStats stats;
+            stats.queries = 1;
+            // a flat scan has no path to trace, only the phase times and the filter
+            bool explain = context.should_explain();
+            if (explain) {
+                context.trace = std::make_unique<SearchTrace>();
+            } else {
+                context.trace.reset();
             }
-            DistanceType lastdist = topResults.empty() ? std::numeric_limits<DistanceType>::max()
-                                                       : topResults.top().distance;
-            for (int i = context.top_k; i < cur_element_count; i++) {
-                DistanceType dist = fstdistfunc_(query_data, data_ + size_per_element_ * i, dist_func_param_);
-                if (dist <= lastdist) {
-                    LabelType label = *((LabelType *) (data_ + size_per_element_ * i + data_size_));
-                    if (!context.is_exclude(label)) {
-                        topResults.push({dist, label, i});
+            auto phase_start = turbo::Time::current_time();
+            // a scan has no hops, the budget is checked once per stride
+            const SearchBudget *budget = context.budget.limited() ? &context.budget : nullptr;
+            size_t scanned = count;
+            for (size_t i = 0; i < count; i++) {
+                if (budget != nullptr && i % kScanStride == 0 && i > 0) {
+                    stats.hops = i / kScanStride;
+                    stats.distance_computations = i;
+                    if (budget->exhausted(stats)) {
+                        context.partial = true;
+                        scanned = i;
+                        break;
                     }
-                    if (topResults.size() > context.top_k)
-                        topResults.pop();
-
-                    if (!topResults.empty()) {
-                        lastdist = topResults.top().distance;
+                }
+                DistanceType dist = fstdistfunc_(query_data, data_.at(i), dist_func_param_);
+                // a top_k of 0 is full while empty
+                if (!topResults.full() || (!topResults.empty() && dist < topResults.top().distance)) {
+                    LabelType label = *((LabelType *) (data_.at(i) + data_size_));
+                    if (!context.is_exclude(label)) {
+                        topResults.emplace(dist, label, static_cast<LocationType>(i));
+                    } else {
+                        stats.filtered_out++;
                     }
                 }
             }
-            auto with_location = context.with_location;
-            if(context.reverse_result) {
-                context.results.reserve(topResults.size());
-                while (!topResults.empty()) {
-                    auto rez = topResults.top();
-                    context.results.emplace_back(rez.distance, rez.label, with_location ? rez.location: 0);
-                    topResults.pop();
-                }
-            } else {
-                context.results.resize(topResults.size());
-                for(int i = topResults.size() - 1; i >= 0; i--) {
-                    auto rez = topResults.top();
-                    context.results[i] = ResultEntity(rez.distance, rez.label, with_location ? rez.location: 0);
-                    topResults.pop();
+            stats.hops = 0;
+            stats.distance_computations = scanned;
+            stats.visited = scanned;
+            context.stats = stats;
+            search_stats_.add(stats);
+            if (explain) {
+                auto now = turbo::Time::current_time();
+                context.trace->level0_time = now - phase_start;
+                context.trace->filtered_out = stats.filtered_out;
+                phase_start = now;
+            }
+            context.results.clear();
+            topResults.pop_sorted(context.top_k, context.reverse_result, context.results,
+                                  context.with_location || context.with_raw_vector);
+            if (context.with_raw_vector) {
+                // one contiguous buffer, row i is the vector of results[i]
+                context.raw_vectors.resize(context.results.size() * data_size_);
+                uint8_t *out = context.raw_vectors.data();
+                for (auto &rez: context.results) {
+                    memcpy(out, data_.at(rez.location), data_size_);
+                    out += data_size_;
+                    if (!context.with_location) {
+                        rez.location = 0;
+                    }
                 }
             }
+            if (explain) {
+                context.trace->results_time = turbo::Time::current_time() - phase_start;
+            }
             context.end_time = turbo::Time::current_time();
             return turbo::OkStatus();
         }
 
         virtual turbo::Status getVector(LabelType label, void *data) override{
-            std::unique_lock<std::mutex> lock(index_lock);
-            auto search = dict_external_to_internal.find(label);
-            if (search == dict_external_to_internal.end()) {
+            std::shared_lock<std::shared_mutex> lock(index_lock);
+            LocationType idx;
+            if (!dict_external_to_internal.find(label, idx)) {
                 return turbo::not_found_error("label not found");
             }
-            size_t idx = search->second;
-            memcpy(data, data_ + size_per_element_ * idx, data_size_);
+            memcpy(data, data_.at(idx), data_size_);
             return turbo::OkStatus();
         }
 
+        size_t getCurrentElementCount() const override {
+            return cur_element_count;
+        }
+
+        // deleted elements are removed at once
+        size_t getDeletedCount() const override {
+            return 0;
+        }
+
+        PageStats getPageStats() const override {
+            return data_.page_stats();
+        }
+
+        SearchStats getSearchStats() const override {
+            return search_stats_.total();
+        }
+
+        void resetSearchStats() override {
+            search_stats_.reset();
+        }
+
+        // one shared lock for the batch, copied in internal id order
+        size_t getVectors(const LabelType *labels, size_t n, void *data, bool *found) override {
+            std::shared_lock<std::shared_mutex> lock(index_lock);
+            std::vector<LocationType> locations(n);
+            dict_external_to_internal.find_batch(labels, n, locations.data());
+            std::vector<std::pair<LocationType, size_t>> order;
+            order.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                found[i] = locations[i] != LabelMap::kEmpty;
+                if (found[i]) {
+                    order.emplace_back(locations[i], i);
+                }
+            }
+            std::sort(order.begin(), order.end());
+            for (auto &item: order) {
+                memcpy(static_cast<char *>(data) + item.second * data_size_, data_.at(item.first), data_size_);
+            }
+            return order.size();
+        }
+
+        void preserveRow(size_t idx) {
+            snapshot_.preserve(idx, [this](size_t id, std::vector<char> &bytes) {
+                bytes.assign(data_.at(id), data_.at(id) + size_per_element_);
+            });
+        }
+
+        // a point in time copy of the rows, writers go on while it is written
         turbo::Status saveIndex(const std::string &location, uint64_t snapshot) override {
+            return saveIndex(location, snapshot, nullptr);
+        }
+
+        turbo::Status saveIndex(const std::string &location, uint64_t snapshot,
+                                const std::function<void()> &on_snapshot) override {
+            std::lock_guard<std::mutex> save_lock(save_lock_);
+            size_t count;
+            size_t max_elements;
+            {
+                std::unique_lock<SnapshotGate> gate(snapshot_gate_);
+                count = cur_element_count;
+                max_elements = max_elements_;
+                snapshot_.begin(count);
+                snapshot_id_ = snapshot;
+                if (on_snapshot) {
+                    on_snapshot();
+                }
+            }
+            auto rs = writeSnapshot(location, count, max_elements);
+            std::unique_lock<SnapshotGate> gate(snapshot_gate_);
+            snapshot_.end();
+            return rs;
+        }
+
+        turbo::Status writeSnapshot(const std::string &location, size_t count, size_t max_elements) {
+            constexpr size_t kBatchRows = 1024;
             try {
                 std::ofstream output(location, std::ios::binary);
-                std::streampos position;
-                snapshot_id_ = snapshot;
                 // save core config
                 writeBinaryPOD(output, static_cast<uint32_t>(core_conf.index_type));
                 writeBinaryPOD(output, static_cast<uint32_t>(core_conf.data));
                 writeBinaryPOD(output, static_cast<uint32_t>(core_conf.metric));
                 writeBinaryPOD(output, core_conf.dimension);
                 writeBinaryPOD(output, core_conf.worker_num);
-                writeBinaryPOD(output, core_conf.max_elements);
+                writeBinaryPOD(output, static_cast<uint32_t>(max_elements));
                 writeBinaryPOD(output, snapshot_id_);
                 writeBinaryPOD(output, size_per_element_);
-                writeBinaryPOD(output, cur_element_count);
-
-                output.write(data_, core_conf.max_elements * size_per_element_);
-
+                writeBinaryPOD(output, count);
+
+                std::vector<char> batch;
+                std::vector<char> row;
+                auto copy = [this](size_t id, std::vector<char> &bytes) {
+                    bytes.assign(data_.at(id), data_.at(id) + size_per_element_);
+                };
+                for (size_t i = 0; i < count; i++) {
+                    snapshot_.take(i, row, copy);
+                    batch.insert(batch.end(), row.begin(), row.end());
+                    if (batch.size() >= kBatchRows * size_per_element_) {
+                        output.write(batch.data(), batch.size());
+                        batch.clear();
+                    }
+                }
+                output.write(batch.data(), batch.size());
+                // the file keeps room for max_elements rows, the unused ones are zero
+                batch.assign(std::min(max_elements - count, kBatchRows) * size_per_element_, 0);
+                for (size_t i = count; i < max_elements; i += kBatchRows) {
+                    output.write(batch.data(), std::min(max_elements - i, kBatchRows) * size_per_element_);
+                }
                 output.close();
+                if (!output) {
+                    return turbo::internal_error("can not write " + location);
+                }
             } catch (std::exception &e) {
                 return turbo::internal_error(e.what());
             }
@@ -265,23 +457,33 @@ namespace phekda {
             readBinaryPOD(input, tmp_core_conf.dimension);
             readBinaryPOD(input, tmp_core_conf.worker_num);
             readBinaryPOD(input, tmp_core_conf.max_elements);
+            tmp_core_conf.auto_grow = config.auto_grow;
             core_conf = tmp_core_conf;
             readBinaryPOD(input, snapshot_id_);
             readBinaryPOD(input, size_per_element_);
-            readBinaryPOD(input, cur_element_count);
+            size_t count;
+            readBinaryPOD(input, count);
+            cur_element_count = count;
             hnsw_conf = hnswlib_config;
             data_size_ = hnswlib_config.space->get_data_size();
             fstdistfunc_ = hnswlib_config.space->get_dist_func();
             dist_func_param_ = hnswlib_config.space->get_dist_func_param();
             size_per_element_ = data_size_ + sizeof(LabelType);
-            data_ = (char *) malloc(core_conf.max_elements * size_per_element_);
-            if (data_ == nullptr) {
-                return turbo::resource_exhausted_error("Not enough memory: loadIndex failed to allocate data");
+            auto rs = initStorage(core_conf.max_elements);
+            if (!rs.ok()) {
+                return rs;
             }
-
-            input.read(data_, core_conf.max_elements * size_per_element_);
+            data_.for_each_chunk(core_conf.max_elements, [&](char *chunk, size_t n) {
+                input.read(chunk, n * size_per_element_);
+            });
 
             input.close();
+            dict_external_to_internal.clear();
+            dict_external_to_internal.reserve(count);
+            for (size_t i = 0; i < count; i++) {
+                LabelType label = *((LabelType *) (data_.at(i) + data_size_));
+                dict_external_to_internal.insert_or_assign(label, i);
+            }
             return turbo::OkStatus();
         }
     };
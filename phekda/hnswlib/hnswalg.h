@@ -22,8 +22,15 @@
 
 #include <phekda/hnswlib/visited_list_pool.h>
 #include <phekda/hnswlib/hnswlib.h>
+#include <phekda/core/label_map.h>
+#include <phekda/core/chunked_arena.h>
+#include <phekda/core/spin_lock.h>
+#include <phekda/core/bounded_heap.h>
+#include <phekda/core/cow_snapshot.h>
 #include <atomic>
 #include <random>
+#include <shared_mutex>
+#include <thread>
 #include <stdlib.h>
 #include <assert.h>
 #include <unordered_set>
@@ -35,12 +42,31 @@ namespace phekda {
     class HierarchicalNSW : public AlgorithmInterface {
     public:
         static const LocationType MAX_LABEL_OPERATION_LOCKS = 65536;
+        static const LocationType MIN_LABEL_OPERATION_LOCKS = 1024;
         static const unsigned char DELETE_MARK = 0x01;
+        // set when the slot holds an element, only checked in dense label mode
+        static const unsigned char PRESENT_MARK = 0x02;
+        // byte of the level 0 header holding the link list lock of the element
+        static const size_t LINK_LOCK_OFFSET = 3;
+        // layout flags saved in the index file
+        static const uint32_t LAYOUT_DENSE_LABEL = 0x01;
+        static const uint32_t LAYOUT_SPLIT = 0x02;
+        // log2 of the element alignment is kept in bits 8-15, 0 means packed
+        static const uint32_t LAYOUT_ALIGNMENT_SHIFT = 8;
+        static const uint32_t LAYOUT_ALIGNMENT_MASK = 0xff00;
+        // marks the flags word in the upper 16 bits, files saved before the
+        // flags have the first level 0 element there, whose upper 16 bits
+        // hold the delete mark and a zero byte
+        static const uint32_t LAYOUT_MAGIC = 0x50480000;
+        static const uint32_t LAYOUT_MAGIC_MASK = 0xffff0000;
 
         mutable std::atomic<size_t> cur_element_count{0};  // current number of elements
         size_t size_data_per_element_{0};
         size_t size_links_per_element_{0};
         mutable std::atomic<size_t> num_deleted_{0};  // number of deleted elements
+        // elements in their slots, in dense label mode cur_element_count is
+        // the high water mark of the labels and vacant slots lie below it
+        std::atomic<size_t> num_present_{0};
         size_t maxM_{0};
         size_t maxM0_{0};
         size_t ef_{0};
@@ -53,50 +79,70 @@ namespace phekda {
         int maxlevel_{0};
 
         VisitedListPool *visited_list_pool_{nullptr};
+        // candidate and result heaps of the searches
+        mutable SearchScratchPool scratch_pool_;
 
         // Locks operations with element by label value
         mutable std::vector<std::mutex> label_op_locks_;
+        size_t label_op_lock_mask_{0};
 
         std::mutex global;
-        std::vector<std::mutex> link_list_locks_;
 
         LocationType enterpoint_node_{0};
 
         size_t size_links_level0_{0};
         size_t offsetData_{0}, offsetLevel0_{0}, label_offset_{0};
 
-        char *data_level0_memory_{nullptr};
-        char **linkLists_{nullptr};
-        std::vector<int> element_levels_;  // keeps level of each element
+        // level 0 links, data and label of each element, grows in chunks
+        // so elements never move and readers need no lock
+        ChunkedArena data_level0_;
+        // vectors and labels in split layout, the level 0 element only
+        // holds the header and links then
+        ChunkedArena vectors_;
+        ChunkedArena labels_;
+        // where vectors and labels are read from, data_level0_ or the split arenas
+        ChunkedArena *vector_arena_{&data_level0_};
+        ChunkedArena *label_arena_{&data_level0_};
+        ChunkedVector<char *> linkLists_;
+        ChunkedVector<int> element_levels_;  // keeps level of each element
+        // max number of elements, raised by growStorage in auto grow mode
+        std::atomic<size_t> max_elements_{0};
+        std::mutex grow_lock_;
 
         size_t data_size_{0};
 
         DISTFUNC<DistanceType> fstdistfunc_;
         void *dist_func_param_{nullptr};
 
-        mutable std::mutex label_lookup_lock;  // lock for label_lookup_
-        std::unordered_map<LabelType, LocationType> label_lookup_;
+        // sharded label -> internal id map, safe for concurrent use
+        LabelMap label_lookup_;
 
         std::default_random_engine level_generator_;
         std::default_random_engine update_probability_generator_;
 
-        mutable std::atomic<long> metric_distance_computations{0};
-        mutable std::atomic<long> metric_hops{0};
+        // search totals, per query numbers go to SearchContext::stats
+        mutable StripedSearchStats search_stats_;
 
         std::mutex deleted_elements_lock;  // lock for deleted_elements
         std::unordered_set<LocationType> deleted_elements;  // contains internal ids of deleted elements
 
+        // the elements as they were when the running save started, writers
+        // preserve an element before changing it
+        CowSnapshot snapshot_;
+        // shared by the writers, exclusive to start and end a snapshot
+        SnapshotGate snapshot_gate_;
+        // one save at a time
+        std::mutex save_lock_;
+
 
         HierarchicalNSW() {
         }
 
         ~HierarchicalNSW() {
-            free(data_level0_memory_);
             for (LocationType i = 0; i < cur_element_count; i++) {
                 if (element_levels_[i] > 0)
                     free(linkLists_[i]);
             }
-            free(linkLists_);
             delete visited_list_pool_;
         }
 
@@ -106,11 +152,7 @@ namespace phekda {
                 return turbo::invalid_argument_error("SpaceInterface is not set");
             }
             core_conf = config;
-            std::vector<std::mutex> tmp(core_conf.max_elements);
-            link_list_locks_ = std::move(tmp);
-            std::vector<std::mutex> label_op_locks_tmp(MAX_LABEL_OPERATION_LOCKS);
-            label_op_locks_ = std::move(label_op_locks_tmp);
-            element_levels_.resize(core_conf.max_elements);
+            initLabelOpLocks();
             num_deleted_ = 0;
             data_size_ = hnsw_conf.space->get_data_size();
             fstdistfunc_ = hnsw_conf.space->get_dist_func();
@@ -123,29 +165,25 @@ namespace phekda {
             level_generator_.seed(hnsw_conf.random_seed);
             update_probability_generator_.seed(hnsw_conf.random_seed + 1);
 
+            if (hnsw_conf.alignment & (hnsw_conf.alignment - 1)) {
+                return turbo::invalid_argument_error("alignment should be power of two");
+            }
             size_links_level0_ = maxM0_ * sizeof(LocationType) + sizeof(LocationType);
-            size_data_per_element_ = size_links_level0_ + data_size_ + sizeof(LabelType);
-            offsetData_ = size_links_level0_;
-            label_offset_ = size_links_level0_ + data_size_;
             offsetLevel0_ = 0;
+            setupLayout();
 
-            data_level0_memory_ = (char *) malloc(core_conf.max_elements * size_data_per_element_);
-            if (data_level0_memory_ == nullptr) {
-                return turbo::resource_exhausted_error("Not enough memory: HierarchicalNSW failed to allocate data");
+            auto rs = initStorage(core_conf.max_elements);
+            if (!rs.ok()) {
+                return rs;
             }
 
             cur_element_count = 0;
-
-            visited_list_pool_ = new VisitedListPool(1, core_conf.max_elements);
+            num_present_ = 0;
 
             // initializations for special treatment of the first node
             enterpoint_node_ = -1;
             maxlevel_ = -1;
 
-            linkLists_ = (char **) malloc(sizeof(void *) * core_conf.max_elements);
-            if (linkLists_ == nullptr) {
-                return turbo::resource_exhausted_error("Not enough memory: HierarchicalNSW failed to allocate linklists");
-            }
             size_links_per_element_ = maxM_ * sizeof(LocationType) + sizeof(LocationType);
             mult_ = 1 / log(1.0 * hnsw_conf.M);
             revSize_ = 1.0 / mult_;
@@ -157,7 +195,9 @@ namespace phekda {
         }
 
         CoreConfig  get_core_config() const override {
-            return core_conf;
+            CoreConfig conf = core_conf;
+            conf.max_elements = static_cast<uint32_t>(max_elements_.load());
+            return conf;
         }
 
         uint64_t snapshot_id() const override {
@@ -177,34 +217,95 @@ namespace phekda {
         }
 
 
+        // stripe the label locks by the hardware threads, enough to keep
+        // collisions of concurrent writers rare without a lock per label
+        void initLabelOpLocks() {
+            size_t want = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 64;
+            size_t n = MIN_LABEL_OPERATION_LOCKS;
+            while (n < want && n < MAX_LABEL_OPERATION_LOCKS) {
+                n <<= 1;
+            }
+            std::vector<std::mutex>(n).swap(label_op_locks_);
+            label_op_lock_mask_ = n - 1;
+        }
+
+
         inline std::mutex &getLabelOpMutex(LabelType label) const {
             // calculate hash
-            size_t lock_id = label & (MAX_LABEL_OPERATION_LOCKS - 1);
+            size_t lock_id = label & label_op_lock_mask_;
             return label_op_locks_[lock_id];
         }
 
 
+        // guards the link lists of all levels of the element, the lock
+        // lives in the level 0 header so it costs no extra memory
+        inline ByteSpinLock &getLinkListLock(LocationType internal_id) const {
+            return ByteSpinLock::at(data_level0_.at(internal_id) + offsetLevel0_ + LINK_LOCK_OFFSET);
+        }
+
+
         inline LabelType getExternalLabel(LocationType internal_id) const {
+            if (hnsw_conf.dense_label) {
+                return internal_id;
+            }
             LabelType return_label;
-            memcpy(&return_label, (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_),
-                   sizeof(LabelType));
+            memcpy(&return_label, label_arena_->at(internal_id) + label_offset_, sizeof(LabelType));
             return return_label;
         }
 
 
         inline void setExternalLabel(LocationType internal_id, LabelType label) const {
-            memcpy((data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_), &label,
-                   sizeof(LabelType));
+            if (hnsw_conf.dense_label) {
+                return;
+            }
+            memcpy(label_arena_->at(internal_id) + label_offset_, &label, sizeof(LabelType));
         }
 
 
+        // no inline label in dense label mode, return nullptr
         inline LabelType *getExternalLabeLp(LocationType internal_id) const {
-            return (LabelType *) (data_level0_memory_ + internal_id * size_data_per_element_ + label_offset_);
+            if (hnsw_conf.dense_label) {
+                return nullptr;
+            }
+            return (LabelType *) (label_arena_->at(internal_id) + label_offset_);
+        }
+
+
+        // resolve the internal id of label, return false if not found
+        inline bool getInternalId(LabelType label, LocationType &internal_id) const {
+            if (hnsw_conf.dense_label) {
+                if (label >= cur_element_count || !isPresent(label)) {
+                    return false;
+                }
+                internal_id = label;
+                return true;
+            }
+            return label_lookup_.find(label, internal_id);
         }
 
 
         inline char *getDataByInternalId(LocationType internal_id) const {
-            return (data_level0_memory_ + internal_id * size_data_per_element_ + offsetData_);
+            return vector_arena_->at(internal_id) + offsetData_;
+        }
+
+
+        // ids read past the end of a link list are garbage, resolving
+        // them through the chunk directory is only safe in range
+        inline void prefetchData(LocationType internal_id) const {
+#ifdef USE_SSE
+            if (internal_id < data_level0_.capacity()) {
+                _mm_prefetch(getDataByInternalId(internal_id), _MM_HINT_T0);
+            }
+#endif
+        }
+
+
+        inline void prefetchLinks(LocationType internal_id) const {
+#ifdef USE_SSE
+            if (internal_id < data_level0_.capacity()) {
+                _mm_prefetch((char *) get_linklist0(internal_id), _MM_HINT_T0);
+            }
+#endif
         }
 
 
@@ -215,14 +316,14 @@ namespace phekda {
         }
 
         size_t getMaxElements() {
-            return core_conf.max_elements;
+            return max_elements_;
         }
 
-        size_t getCurrentElementCount() {
-            return cur_element_count;
+        size_t getCurrentElementCount() const override {
+            return hnsw_conf.dense_label ? num_present_.load() : cur_element_count.load();
         }
 
-        size_t getDeletedCount() {
+        size_t getDeletedCount() const override {
             return num_deleted_;
         }
 
@@ -231,6 +332,8 @@ namespace phekda {
             VisitedList *vl = visited_list_pool_->getFreeVisitedList();
             vl_type *visited_array = vl->mass;
             vl_type visited_array_tag = vl->curV;
+            // elements added after the list was taken may be out of its range
+            size_t visited_limit = vl->numelements;
 
             std::priority_queue<std::pair<DistanceType, LocationType>, std::vector<std::pair<DistanceType, LocationType>>, CompareByFirst> top_candidates;
             std::priority_queue<std::pair<DistanceType, LocationType>, std::vector<std::pair<DistanceType, LocationType>>, CompareByFirst> candidateSet;
@@ -256,7 +359,7 @@ namespace phekda {
 
                 LocationType curNodeNum = curr_el_pair.second;
 
-                std::unique_lock<std::mutex> lock(link_list_locks_[curNodeNum]);
+                std::unique_lock<ByteSpinLock> lock(getLinkListLock(curNodeNum));
 
                 int *data;  // = (int *)(linkList0_ + curNodeNum * size_links_per_element0_);
                 if (layer == 0) {
@@ -270,18 +373,21 @@ namespace phekda {
 #ifdef USE_SSE
                 _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
                 _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-                _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
-                _mm_prefetch(getDataByInternalId(*(datal + 1)), _MM_HINT_T0);
+                prefetchData(*datal);
+                prefetchData(*(datal + 1));
 #endif
 
                 for (size_t j = 0; j < size; j++) {
                     LocationType candidate_id = *(datal + j);
 //                    if (candidate_id == 0) continue;
 #ifdef USE_SSE
-                    _mm_prefetch((char *) (visited_array + *(datal + j + 1)), _MM_HINT_T0);
-                    _mm_prefetch(getDataByInternalId(*(datal + j + 1)), _MM_HINT_T0);
+                    // upper layer lists have no slack after the last link
+                    if (j + 1 < size) {
+                        _mm_prefetch((char *) (visited_array + *(datal + j + 1)), _MM_HINT_T0);
+                        prefetchData(*(datal + j + 1));
+                    }
 #endif
-                    if (visited_array[candidate_id] == visited_array_tag) continue;
+                    if (candidate_id >= visited_limit || visited_array[candidate_id] == visited_array_tag) continue;
                     visited_array[candidate_id] = visited_array_tag;
                     char *currObj1 = (getDataByInternalId(candidate_id));
 
@@ -289,7 +395,7 @@ namespace phekda {
                     if (top_candidates.size() < hnsw_conf.ef_construction || lowerBound > dist1) {
                         candidateSet.emplace(-dist1, candidate_id);
 #ifdef USE_SSE
-                        _mm_prefetch(getDataByInternalId(candidateSet.top().second), _MM_HINT_T0);
+                        prefetchData(candidateSet.top().second);
 #endif
 
                         if (!isMarkedDeleted(candidate_id))
@@ -309,94 +415,131 @@ namespace phekda {
         }
 
 
-        template<bool has_deletions, bool collect_metrics = false>
-        std::priority_queue<std::pair<DistanceType, LocationType>, std::vector<std::pair<DistanceType, LocationType>>, CompareByFirst>
-        searchBaseLayerST(LocationType ep_id, const void *data_point, size_t ef,
-                          BaseFilterFunctor *isIdAllowed = nullptr) const {
+        // best first search on level 0 from ep_id, the ef closest elements
+        // passing allowed(label) are left in scratch.results. rejected elements
+        // are still walked through, filtered tells if allowed may reject any.
+        // the work done is added to scratch.stats, with explain every expanded
+        // candidate is also sampled into trace. a budget, which needs
+        // collect_metrics, is checked after every hop, false is returned if
+        // it ran out and the results are partial
+        template<bool has_deletions, bool collect_metrics, bool explain = false, typename Allowed>
+        bool searchLevel0(LocationType ep_id, const void *data_point, size_t ef, bool filtered,
+                          Allowed &&allowed, SearchScratch &scratch, SearchTrace *trace = nullptr,
+                          const SearchBudget *budget = nullptr) const {
             VisitedList *vl = visited_list_pool_->getFreeVisitedList();
             vl_type *visited_array = vl->mass;
             vl_type visited_array_tag = vl->curV;
+            // elements added after the list was taken may be out of its range
+            size_t visited_limit = vl->numelements;
 
-            std::priority_queue<std::pair<DistanceType, LocationType>, std::vector<std::pair<DistanceType, LocationType>>, CompareByFirst> top_candidates;
-            std::priority_queue<std::pair<DistanceType, LocationType>, std::vector<std::pair<DistanceType, LocationType>>, CompareByFirst> candidate_set;
+            CandidateHeap &candidate_set = scratch.candidates;
+            ResultHeap &top_candidates = scratch.results;
+            candidate_set.clear();
+            top_candidates.reset(ef);
 
+            SearchStats &stats = scratch.stats;
             DistanceType lowerBound;
-            if ((!has_deletions || !isMarkedDeleted(ep_id)) &&
-                ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(ep_id)))) {
+            auto ep_label = getExternalLabel(ep_id);
+            if ((!has_deletions || !isMarkedDeleted(ep_id)) && allowed(ep_label)) {
                 DistanceType dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
                 lowerBound = dist;
-                top_candidates.emplace(dist, ep_id);
-                candidate_set.emplace(-dist, ep_id);
+                top_candidates.emplace(dist, ep_label, ep_id);
+                candidate_set.emplace(dist, ep_id);
+                if (collect_metrics) {
+                    stats.distance_computations++;
+                }
             } else {
                 lowerBound = std::numeric_limits<DistanceType>::max();
-                candidate_set.emplace(-lowerBound, ep_id);
+                candidate_set.emplace(lowerBound, ep_id);
+                if (collect_metrics) {
+                    stats.filtered_out++;
+                }
+            }
+            if (collect_metrics) {
+                stats.visited++;
             }
 
             visited_array[ep_id] = visited_array_tag;
 
+            bool completed = true;
             while (!candidate_set.empty()) {
-                std::pair<DistanceType, LocationType> current_node_pair = candidate_set.top();
+                SearchCandidate current_node_pair = candidate_set.top();
 
-                if ((-current_node_pair.first) > lowerBound &&
-                    (top_candidates.size() == ef || (!isIdAllowed && !has_deletions))) {
+                if (current_node_pair.distance > lowerBound &&
+                    (top_candidates.full() || (!filtered && !has_deletions))) {
                     break;
                 }
                 candidate_set.pop();
 
-                LocationType current_node_id = current_node_pair.second;
+                LocationType current_node_id = current_node_pair.location;
                 int *data = (int *) get_linklist0(current_node_id);
                 size_t size = getListCount((LocationType *) data);
-//                bool cur_node_deleted = isMarkedDeleted(current_node_id);
                 if (collect_metrics) {
-                    metric_hops++;
-                    metric_distance_computations += size;
+                    stats.hops++;
+                }
+                if (explain) {
+                    trace->level_hops[0]++;
+                    trace->level0.push_back({current_node_id, current_node_pair.distance, lowerBound,
+                                             candidate_set.size(), top_candidates.size(), stats.filtered_out});
                 }
 
 #ifdef USE_SSE
                 _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
                 _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-                _mm_prefetch(data_level0_memory_ + (*(data + 1)) * size_data_per_element_ + offsetData_, _MM_HINT_T0);
+                prefetchData(*(data + 1));
                 _mm_prefetch((char *) (data + 2), _MM_HINT_T0);
 #endif
 
                 for (size_t j = 1; j <= size; j++) {
                     int candidate_id = *(data + j);
-//                    if (candidate_id == 0) continue;
 #ifdef USE_SSE
-                    _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
-                    _mm_prefetch(data_level0_memory_ + (*(data + j + 1)) * size_data_per_element_ + offsetData_,
-                                 _MM_HINT_T0);  ////////////
+                    // a full list in split layout ends with the element
+                    if (j < size) {
+                        _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
+                        prefetchData(*(data + j + 1));
+                    }
 #endif
-                    if (!(visited_array[candidate_id] == visited_array_tag)) {
+                    if ((size_t) candidate_id < visited_limit && !(visited_array[candidate_id] == visited_array_tag)) {
                         visited_array[candidate_id] = visited_array_tag;
 
                         char *currObj1 = (getDataByInternalId(candidate_id));
                         DistanceType dist = fstdistfunc_(data_point, currObj1, dist_func_param_);
+                        if (collect_metrics) {
+                            stats.visited++;
+                            stats.distance_computations++;
+                        }
 
-                        if (top_candidates.size() < ef || lowerBound > dist) {
-                            candidate_set.emplace(-dist, candidate_id);
+                        if (!top_candidates.full() || lowerBound > dist) {
+                            candidate_set.emplace(dist, candidate_id);
 #ifdef USE_SSE
-                            _mm_prefetch(data_level0_memory_ + candidate_set.top().second * size_data_per_element_ +
-                                         offsetLevel0_,  ///////////
-                                         _MM_HINT_T0);  ////////////////////////
+                            prefetchLinks(candidate_set.top().location);
 #endif
-
-                            if ((!has_deletions || !isMarkedDeleted(candidate_id)) &&
-                                ((!isIdAllowed) || (*isIdAllowed)(getExternalLabel(candidate_id))))
-                                top_candidates.emplace(dist, candidate_id);
-
-                            if (top_candidates.size() > ef)
-                                top_candidates.pop();
+                            bool accepted = false;
+                            if (!has_deletions || !isMarkedDeleted(candidate_id)) {
+                                auto candidate_label = getExternalLabel(candidate_id);
+                                if (allowed(candidate_label)) {
+                                    // the bounded heap drops the furthest once full
+                                    top_candidates.emplace(dist, candidate_label, candidate_id);
+                                    accepted = true;
+                                }
+                            }
+                            if (collect_metrics && !accepted) {
+                                stats.filtered_out++;
+                            }
 
                             if (!top_candidates.empty())
-                                lowerBound = top_candidates.top().first;
+                                lowerBound = top_candidates.top().distance;
                         }
                     }
                 }
+                if (budget != nullptr && budget->exhausted(stats)) {
+                    completed = false;
+                    break;
+                }
             }
 
             visited_list_pool_->releaseVisitedList(vl);
-            return top_candidates;
+            return completed;
         }
 
 
@@ -444,12 +587,7 @@ namespace phekda {
 
 
         LocationType *get_linklist0(LocationType internal_id) const {
-            return (LocationType *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
-        }
-
-
-        LocationType *get_linklist0(LocationType internal_id, char *data_level0_memory_) const {
-            return (LocationType *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
+            return (LocationType *) (data_level0_.at(internal_id) + offsetLevel0_);
         }
 
 
@@ -486,17 +624,18 @@ namespace phekda {
             {
                 // lock only during the update
                 // because during the addition the lock for cur_c is already acquired
-                std::unique_lock<std::mutex> lock(link_list_locks_[cur_c], std::defer_lock);
+                std::unique_lock<ByteSpinLock> lock(getLinkListLock(cur_c), std::defer_lock);
                 if (isUpdate) {
                     lock.lock();
                 }
+                preserveElement(cur_c);
                 LocationType *ll_cur;
                 if (level == 0)
                     ll_cur = get_linklist0(cur_c);
                 else
                     ll_cur = get_linklist(cur_c, level);
 
-                if (*ll_cur && !isUpdate) {
+                if (getListCount(ll_cur) && !isUpdate) {
                     throw std::runtime_error("The newly inserted element should have blank link list");
                 }
                 setListCount(ll_cur, selectedNeighbors.size());
@@ -512,7 +651,8 @@ namespace phekda {
             }
 
             for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
-                std::unique_lock<std::mutex> lock(link_list_locks_[selectedNeighbors[idx]]);
+                std::unique_lock<ByteSpinLock> lock(getLinkListLock(selectedNeighbors[idx]));
+                preserveElement(selectedNeighbors[idx]);
 
                 LocationType *ll_other;
                 if (level == 0)
@@ -592,68 +732,420 @@ namespace phekda {
         }
 
 
-        void resizeIndex(size_t new_max_elements) {
-            if (new_max_elements < cur_element_count)
-                throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
+        // level 0 element layout: stride, vector offset and label offset
+        struct ElementLayout {
+            size_t size;
+            size_t data_offset;
+            size_t label_offset;
+        };
+
+
+        // the interleaved layout, links, vector and label in one element.
+        // it is also the layout of the index file
+        ElementLayout interleavedLayout() const {
+            ElementLayout layout;
+            layout.data_offset = size_links_level0_;
+            if (hnsw_conf.alignment) {
+                layout.data_offset = ROUND_UP(layout.data_offset, hnsw_conf.alignment);
+            }
+            layout.label_offset = layout.data_offset + data_size_;
+            layout.size = layout.label_offset;
+            if (!hnsw_conf.dense_label) {
+                layout.size += sizeof(LabelType);
+            }
+            if (hnsw_conf.alignment) {
+                layout.size = ROUND_UP(layout.size, hnsw_conf.alignment);
+            }
+            return layout;
+        }
+
+
+        // set the in memory layout from the config, in split layout the
+        // offsets are into vectors_ and labels_
+        void setupLayout() {
+            if (!hnsw_conf.split_layout) {
+                auto layout = interleavedLayout();
+                size_data_per_element_ = layout.size;
+                offsetData_ = layout.data_offset;
+                label_offset_ = layout.label_offset;
+                vector_arena_ = &data_level0_;
+                label_arena_ = &data_level0_;
+                return;
+            }
+            size_data_per_element_ = size_links_level0_;
+            if (hnsw_conf.alignment) {
+                size_data_per_element_ = ROUND_UP(size_data_per_element_, hnsw_conf.alignment);
+            }
+            offsetData_ = 0;
+            label_offset_ = 0;
+            vector_arena_ = &vectors_;
+            label_arena_ = &labels_;
+        }
+
+
+        // copy the element to buf in the interleaved layout
+        void packElement(LocationType internal_id, char *buf, const ElementLayout &layout) const {
+            if (!hnsw_conf.split_layout) {
+                memcpy(buf, data_level0_.at(internal_id), layout.size);
+                return;
+            }
+            memset(buf, 0, layout.size);
+            memcpy(buf, data_level0_.at(internal_id), size_links_level0_);
+            memcpy(buf + layout.data_offset, getDataByInternalId(internal_id), data_size_);
+            if (!hnsw_conf.dense_label) {
+                memcpy(buf + layout.label_offset, label_arena_->at(internal_id), sizeof(LabelType));
+            }
+        }
+
+
+        void unpackElement(LocationType internal_id, const char *buf, const ElementLayout &layout) {
+            memcpy(data_level0_.at(internal_id), buf, size_links_level0_);
+            memcpy(getDataByInternalId(internal_id), buf + layout.data_offset, data_size_);
+            if (!hnsw_conf.dense_label) {
+                memcpy(label_arena_->at(internal_id), buf + layout.label_offset, sizeof(LabelType));
+            }
+        }
+
+
+        uint32_t layoutFlags() const {
+            uint32_t flags = hnsw_conf.dense_label ? LAYOUT_DENSE_LABEL : 0;
+            if (hnsw_conf.split_layout) {
+                flags |= LAYOUT_SPLIT;
+            }
+            if (hnsw_conf.alignment) {
+                uint32_t alignment_log = 0;
+                while ((size_t(1) << alignment_log) < hnsw_conf.alignment) {
+                    ++alignment_log;
+                }
+                flags |= alignment_log << LAYOUT_ALIGNMENT_SHIFT;
+            }
+            return flags;
+        }
+
 
+        // set up empty chunked storage with room for max_elements
+        turbo::Status initStorage(size_t max_elements) {
+            size_t chunk_elements = hnsw_conf.chunk_elements;
+            if (chunk_elements == 0) {
+                chunk_elements = std::min(std::max(max_elements, ChunkedArena::kMinChunkElements),
+                                          ChunkedArena::kDefaultChunkElements);
+            }
+            // dense label mode tells the vacant slots by the zeroed header
+            size_t alignment = std::max<size_t>(64, hnsw_conf.alignment);
+            if (hnsw_conf.numa_policy != NumaPolicy::NUMA_NONE &&
+                (hnsw_conf.numa_node < 0 || hnsw_conf.numa_node >= numa_num_nodes())) {
+                return turbo::invalid_argument_error("numa node out of range");
+            }
+            auto rs = data_level0_.initialize(size_data_per_element_, chunk_elements,
+                                              alignment, hnsw_conf.dense_label, hnsw_conf.huge_pages);
+            if (!rs.ok()) {
+                return rs;
+            }
+            data_level0_.set_numa(hnsw_conf.numa_policy, hnsw_conf.numa_node);
+            vectors_.release();
+            labels_.release();
+            if (hnsw_conf.split_layout) {
+                size_t vector_stride = data_size_;
+                if (hnsw_conf.alignment) {
+                    vector_stride = ROUND_UP(vector_stride, hnsw_conf.alignment);
+                }
+                rs = vectors_.initialize(vector_stride, chunk_elements, alignment, false, hnsw_conf.huge_pages);
+                if (!rs.ok()) {
+                    return rs;
+                }
+                vectors_.set_numa(hnsw_conf.numa_policy, hnsw_conf.numa_node);
+                if (!hnsw_conf.dense_label) {
+                    rs = labels_.initialize(sizeof(LabelType), chunk_elements, 64, false, hnsw_conf.huge_pages);
+                    if (!rs.ok()) {
+                        return rs;
+                    }
+                    labels_.set_numa(hnsw_conf.numa_policy, hnsw_conf.numa_node);
+                }
+            }
+            rs = linkLists_.initialize(chunk_elements);
+            if (!rs.ok()) {
+                return rs;
+            }
+            rs = element_levels_.initialize(chunk_elements);
+            if (!rs.ok()) {
+                return rs;
+            }
+            rs = reserveStorage(max_elements);
+            if (!rs.ok()) {
+                return rs;
+            }
             delete visited_list_pool_;
-            visited_list_pool_ = new VisitedListPool(1, new_max_elements);
+            visited_list_pool_ = new VisitedListPool(1, data_level0_.capacity(), hnsw_conf.huge_pages);
+            max_elements_ = max_elements;
+            return turbo::OkStatus();
+        }
+
+
+        // make room for n elements, the allocated chunks never move
+        // so searches running concurrently are not blocked
+        turbo::Status reserveStorage(size_t n) {
+            if (n > LabelMap::kMaxLocation) {
+                return turbo::out_of_range_error("The number of elements exceeds the location limit");
+            }
+            auto rs = data_level0_.reserve(n);
+            if (!rs.ok()) {
+                return rs;
+            }
+            if (hnsw_conf.split_layout) {
+                rs = vectors_.reserve(n);
+                if (!rs.ok()) {
+                    return rs;
+                }
+                if (!hnsw_conf.dense_label) {
+                    rs = labels_.reserve(n);
+                    if (!rs.ok()) {
+                        return rs;
+                    }
+                }
+            }
+            rs = linkLists_.reserve(n);
+            if (!rs.ok()) {
+                return rs;
+            }
+            rs = element_levels_.reserve(n);
+            if (!rs.ok()) {
+                return rs;
+            }
+            if (visited_list_pool_) {
+                visited_list_pool_->resize(data_level0_.capacity());
+            }
+            return turbo::OkStatus();
+        }
+
+
+        // memory of level 0 storage and idle visited lists, and how much of
+        // it is backed by huge pages
+        PageStats getPageStats() const override {
+            PageStats stats = data_level0_.page_stats();
+            stats += vectors_.page_stats();
+            stats += labels_.page_stats();
+            stats += visited_list_pool_->page_stats();
+            return stats;
+        }
+
+
+        // raise max elements to hold n elements, used in auto grow mode
+        turbo::Status growStorage(size_t n) {
+            std::lock_guard<std::mutex> lock(grow_lock_);
+            if (n <= max_elements_) {
+                return turbo::OkStatus();
+            }
+            auto rs = reserveStorage(n);
+            if (!rs.ok()) {
+                return rs;
+            }
+            // publish the new limit after the storage is ready
+            max_elements_ = std::min(data_level0_.capacity(), static_cast<size_t>(LabelMap::kMaxLocation));
+            return turbo::OkStatus();
+        }
+
+
+        // grow the index to hold new_max_elements, shrinking only lowers the limit
+        turbo::Status resizeIndex(size_t new_max_elements) {
+            std::lock_guard<std::mutex> lock(grow_lock_);
+            if (new_max_elements < cur_element_count) {
+                return turbo::invalid_argument_error("Cannot resize, max element is less than the current number of elements");
+            }
+            auto rs = reserveStorage(new_max_elements);
+            if (!rs.ok()) {
+                return rs;
+            }
+            max_elements_ = new_max_elements;
+            return turbo::OkStatus();
+        }
 
-            element_levels_.resize(new_max_elements);
+        // a point in time copy of the index, writers go on while it is
+        // written. the elements they change before the save reached them
+        // are preserved as they were when the save started
+        turbo::Status saveIndex(const std::string &location, uint64_t snapshot) override {
+            return saveIndex(location, snapshot, nullptr);
+        }
 
-            std::vector<std::mutex>(new_max_elements).swap(link_list_locks_);
+        turbo::Status saveIndex(const std::string &location, uint64_t snapshot,
+                                const std::function<void()> &on_snapshot) override {
+            std::lock_guard<std::mutex> save_lock(save_lock_);
+            size_t count;
+            size_t max_elements;
+            LocationType enterpoint;
+            int maxlevel;
+            {
+                std::unique_lock<SnapshotGate> gate(snapshot_gate_);
+                count = cur_element_count;
+                max_elements = max_elements_;
+                enterpoint = enterpoint_node_;
+                maxlevel = maxlevel_;
+                snapshot_.begin(count);
+                snapshot_id_ = snapshot;
+                if (on_snapshot) {
+                    on_snapshot();
+                }
+            }
+            auto rs = writeSnapshot(location, snapshot, count, max_elements, enterpoint, maxlevel);
+            std::unique_lock<SnapshotGate> gate(snapshot_gate_);
+            snapshot_.end();
+            return rs;
+        }
 
-            // Reallocate base layer
-            char *data_level0_memory_new = (char *) realloc(data_level0_memory_,
-                                                            new_max_elements * size_data_per_element_);
-            if (data_level0_memory_new == nullptr)
-                throw std::runtime_error("Not enough memory: resizeIndex failed to allocate base layer");
-            data_level0_memory_ = data_level0_memory_new;
+        // bytes kept aside by the writers for the running save
+        size_t snapshotKeptBytes() const {
+            return snapshot_.kept_bytes();
+        }
 
-            // Reallocate all other layers
-            char **linkLists_new = (char **) realloc(linkLists_, sizeof(void *) * new_max_elements);
-            if (linkLists_new == nullptr)
-                throw std::runtime_error("Not enough memory: resizeIndex failed to allocate other layers");
-            linkLists_ = linkLists_new;
+        // the element in the file layout followed by the size and the bytes
+        // of its upper level links
+        void snapshotElement(LocationType internal_id, std::vector<char> &bytes) const {
+            auto layout = interleavedLayout();
+            int level = element_levels_[internal_id];
+            unsigned int linkListSize = level > 0 ? size_links_per_element_ * level : 0;
+            bytes.resize(layout.size + sizeof(linkListSize) + linkListSize);
+            packElement(internal_id, bytes.data(), layout);
+            // a writer may hold the link lock while it preserves the element
+            bytes[offsetLevel0_ + LINK_LOCK_OFFSET] = 0;
+            memcpy(bytes.data() + layout.size, &linkListSize, sizeof(linkListSize));
+            if (linkListSize > 0) {
+                memcpy(bytes.data() + layout.size + sizeof(linkListSize), linkLists_[internal_id], linkListSize);
+            }
+        }
+
+        // keep the element for the running save, before it is changed
+        void preserveElement(LocationType internal_id) {
+            snapshot_.preserve(internal_id, [this](size_t id, std::vector<char> &bytes) {
+                snapshotElement(static_cast<LocationType>(id), bytes);
+            });
+        }
 
-            core_conf.max_elements = new_max_elements;
+        void writeHeader(std::ofstream &output, uint64_t snapshot, size_t count, size_t max_elements,
+                         LocationType enterpoint, int maxlevel) const {
+            writeBinaryPOD(output, static_cast<uint32_t>(core_conf.index_type));
+            writeBinaryPOD(output, static_cast<uint32_t>(core_conf.data));
+            writeBinaryPOD(output, static_cast<uint32_t>(core_conf.metric));
+            writeBinaryPOD(output, core_conf.dimension);
+            writeBinaryPOD(output, core_conf.worker_num);
+            writeBinaryPOD(output, static_cast<uint32_t>(max_elements));
+            writeBinaryPOD(output, snapshot);
+            writeBinaryPOD(output, offsetLevel0_);
+            writeBinaryPOD(output, count);
+            auto file_layout = interleavedLayout();
+            writeBinaryPOD(output, file_layout.size);
+            writeBinaryPOD(output, file_layout.label_offset);
+            writeBinaryPOD(output, file_layout.data_offset);
+            writeBinaryPOD(output, maxlevel);
+            writeBinaryPOD(output, enterpoint);
+            writeBinaryPOD(output, maxM_);
+
+            writeBinaryPOD(output, maxM0_);
+            writeBinaryPOD(output, hnsw_conf.M);
+            writeBinaryPOD(output, mult_);
+            writeBinaryPOD(output, hnsw_conf.ef_construction);
+            writeBinaryPOD(output, LAYOUT_MAGIC | layoutFlags());
         }
 
-        turbo::Status saveIndex(const std::string &location, uint64_t snapshot) override{
+        turbo::Status writeSnapshot(const std::string &location, uint64_t snapshot, size_t count,
+                                    size_t max_elements, LocationType enterpoint, int maxlevel) {
+            // the level 0 elements go out in batches, the upper level links
+            // follow them in the file so they are held until the end
+            constexpr size_t kBatchElements = 1024;
+            auto layout = interleavedLayout();
             try {
                 std::ofstream output(location, std::ios::binary);
-                std::streampos position;
-                snapshot_id_ = snapshot;
-                // save core config
-                writeBinaryPOD(output, static_cast<uint32_t>(core_conf.index_type));
-                writeBinaryPOD(output, static_cast<uint32_t>(core_conf.data));
-                writeBinaryPOD(output, static_cast<uint32_t>(core_conf.metric));
-                writeBinaryPOD(output, core_conf.dimension);
-                writeBinaryPOD(output, core_conf.worker_num);
-                writeBinaryPOD(output, core_conf.max_elements);
-                writeBinaryPOD(output, snapshot_id_);
-                writeBinaryPOD(output, offsetLevel0_);
-                writeBinaryPOD(output, cur_element_count);
-                writeBinaryPOD(output, size_data_per_element_);
-                writeBinaryPOD(output, label_offset_);
-                writeBinaryPOD(output, offsetData_);
-                writeBinaryPOD(output, maxlevel_);
-                writeBinaryPOD(output, enterpoint_node_);
-                writeBinaryPOD(output, maxM_);
-
-                writeBinaryPOD(output, maxM0_);
-                writeBinaryPOD(output, hnsw_conf.M);
-                writeBinaryPOD(output, mult_);
-                writeBinaryPOD(output, hnsw_conf.ef_construction);
-
-                output.write(data_level0_memory_, cur_element_count * size_data_per_element_);
+                writeHeader(output, snapshot, count, max_elements, enterpoint, maxlevel);
+                std::vector<char> batch;
+                std::vector<char> links;
+                std::vector<char> bytes;
+                auto copy = [this](size_t id, std::vector<char> &out) {
+                    snapshotElement(static_cast<LocationType>(id), out);
+                };
+                for (size_t i = 0; i < count; i++) {
+                    snapshot_.take(i, bytes, copy);
+                    batch.insert(batch.end(), bytes.begin(), bytes.begin() + layout.size);
+                    links.insert(links.end(), bytes.begin() + layout.size, bytes.end());
+                    if (batch.size() >= kBatchElements * layout.size) {
+                        output.write(batch.data(), batch.size());
+                        batch.clear();
+                    }
+                }
+                output.write(batch.data(), batch.size());
+                output.write(links.data(), links.size());
+                output.close();
+                if (!output) {
+                    return turbo::internal_error("can not write " + location);
+                }
+            } catch (std::exception &e) {
+                return turbo::internal_error(e.what());
+            }
+            return turbo::OkStatus();
+        }
 
-                for (size_t i = 0; i < cur_element_count; i++) {
+        // save with the internal ids renumbered, element i of the file is element
+        // new_to_old[i] of the index, links are remapped, empty means as is.
+        // writers should be stopped while saving
+        turbo::Status saveIndexPermuted(const std::string &location, uint64_t snapshot,
+                                        const std::vector<LocationType> &new_to_old) const {
+            size_t count = cur_element_count;
+            if (!new_to_old.empty() && new_to_old.size() != count) {
+                return turbo::invalid_argument_error("permutation size mismatch the element count");
+            }
+            std::vector<LocationType> old_to_new;
+            if (!new_to_old.empty()) {
+                old_to_new.assign(count, count);
+                for (size_t i = 0; i < count; i++) {
+                    if (new_to_old[i] >= count || old_to_new[new_to_old[i]] != count) {
+                        return turbo::invalid_argument_error("not a permutation of the internal ids");
+                    }
+                    old_to_new[new_to_old[i]] = i;
+                }
+            }
+            auto remap = [&](LocationType *ll) {
+                size_t size = getListCount(ll);
+                for (size_t j = 1; j <= size; j++) {
+                    ll[j] = old_to_new[ll[j]];
+                }
+            };
+            try {
+                std::ofstream output(location, std::ios::binary);
+                LocationType enterpoint = old_to_new.empty() || count == 0 ? enterpoint_node_ : old_to_new[enterpoint_node_];
+                writeHeader(output, snapshot, count, max_elements_.load(), enterpoint, maxlevel_);
+                auto file_layout = interleavedLayout();
+
+                if (old_to_new.empty() && !hnsw_conf.split_layout) {
+                    // chunk by chunk, the file layout is the same as a flat array
+                    data_level0_.for_each_chunk(count, [&](const char *chunk, size_t n) {
+                        output.write(chunk, n * size_data_per_element_);
+                    });
+                } else {
+                    std::vector<char> element(file_layout.size);
+                    for (size_t i = 0; i < count; i++) {
+                        packElement(old_to_new.empty() ? i : new_to_old[i], element.data(), file_layout);
+                        if (!old_to_new.empty()) {
+                            remap((LocationType *) (element.data() + offsetLevel0_));
+                        }
+                        output.write(element.data(), file_layout.size);
+                    }
+                }
+
+                std::vector<char> links;
+                for (size_t i = 0; i < count; i++) {
+                    LocationType id = old_to_new.empty() ? i : new_to_old[i];
                     unsigned int linkListSize =
-                            element_levels_[i] > 0 ? size_links_per_element_ * element_levels_[i] : 0;
+                            element_levels_[id] > 0 ? size_links_per_element_ * element_levels_[id] : 0;
                     writeBinaryPOD(output, linkListSize);
-                    if (linkListSize)
-                        output.write(linkLists_[i], linkListSize);
+                    if (linkListSize == 0) {
+                        continue;
+                    }
+                    if (old_to_new.empty()) {
+                        output.write(linkLists_[id], linkListSize);
+                        continue;
+                    }
+                    links.assign(linkLists_[id], linkLists_[id] + linkListSize);
+                    for (int level = 0; level < element_levels_[id]; level++) {
+                        remap((LocationType *) (links.data() + level * size_links_per_element_));
+                    }
+                    output.write(links.data(), linkListSize);
                 }
                 output.close();
             } catch (std::exception &e) {
@@ -687,6 +1179,7 @@ namespace phekda {
             readBinaryPOD(input, tmp_core_conf.dimension);
             readBinaryPOD(input, tmp_core_conf.worker_num);
             readBinaryPOD(input, tmp_core_conf.max_elements);
+            tmp_core_conf.auto_grow = config.auto_grow;
             core_conf = tmp_core_conf;
             readBinaryPOD(input, snapshot_id_);
             readBinaryPOD(input, offsetLevel0_);
@@ -696,9 +1189,10 @@ namespace phekda {
             if (max_elements < cur_element_count)
                 max_elements =  core_conf.max_elements;
             core_conf.max_elements = max_elements;
-            readBinaryPOD(input, size_data_per_element_);
-            readBinaryPOD(input, label_offset_);
-            readBinaryPOD(input, offsetData_);
+            ElementLayout file_layout;
+            readBinaryPOD(input, file_layout.size);
+            readBinaryPOD(input, file_layout.label_offset);
+            readBinaryPOD(input, file_layout.data_offset);
             readBinaryPOD(input, maxlevel_);
             readBinaryPOD(input, enterpoint_node_);
 
@@ -707,15 +1201,41 @@ namespace phekda {
             readBinaryPOD(input, hnsw_conf.M);
             readBinaryPOD(input, mult_);
             readBinaryPOD(input, hnsw_conf.ef_construction);
+            // no flags word in a file saved before it, load it as packed
+            uint32_t layout_flags = 0;
+            if (input.tellg() < total_filesize) {
+                uint32_t word;
+                readBinaryPOD(input, word);
+                if ((word & LAYOUT_MAGIC_MASK) == LAYOUT_MAGIC) {
+                    layout_flags = word & ~LAYOUT_MAGIC_MASK;
+                } else {
+                    input.seekg(-static_cast<std::streamoff>(sizeof(word)), input.cur);
+                }
+            }
+            hnsw_conf.dense_label = layout_flags & LAYOUT_DENSE_LABEL;
+            uint32_t alignment_log = (layout_flags & LAYOUT_ALIGNMENT_MASK) >> LAYOUT_ALIGNMENT_SHIFT;
+            hnsw_conf.alignment = alignment_log ? size_t(1) << alignment_log : 0;
+            // either layout loads from the same file, keep the split one if asked
+            hnsw_conf.split_layout = hnswlib_config.split_layout || (layout_flags & LAYOUT_SPLIT);
 
             data_size_ = hnsw_conf.space->get_data_size();
             fstdistfunc_ = hnsw_conf.space->get_dist_func();
             dist_func_param_ = hnsw_conf.space->get_dist_func_param();
+            size_links_level0_ = maxM0_ * sizeof(LocationType) + sizeof(LocationType);
+            if (hnsw_conf.split_layout) {
+                setupLayout();
+            } else {
+                size_data_per_element_ = file_layout.size;
+                offsetData_ = file_layout.data_offset;
+                label_offset_ = file_layout.label_offset;
+                vector_arena_ = &data_level0_;
+                label_arena_ = &data_level0_;
+            }
 
             auto pos = input.tellg();
 
             /// Optional - check if index is ok:
-            input.seekg(cur_element_count * size_data_per_element_, input.cur);
+            input.seekg(cur_element_count * file_layout.size, input.cur);
             for (size_t i = 0; i < cur_element_count; i++) {
                 if (input.tellg() < 0 || input.tellg() >= total_filesize) {
                     return turbo::internal_error("Index seems to be corrupted or unsupported");
@@ -738,29 +1258,37 @@ namespace phekda {
 
             input.seekg(pos, input.beg);
 
-            data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);
-            if (data_level0_memory_ == nullptr) {
-                return turbo::resource_exhausted_error("Not enough memory: loadIndex failed to allocate level0");
+            auto rs = initStorage(max_elements);
+            if (!rs.ok()) {
+                return rs;
+            }
+            if (hnsw_conf.split_layout) {
+                std::vector<char> element(file_layout.size);
+                for (size_t i = 0; i < cur_element_count; i++) {
+                    input.read(element.data(), file_layout.size);
+                    unpackElement(i, element.data(), file_layout);
+                }
+            } else {
+                data_level0_.for_each_chunk(cur_element_count, [&](char *chunk, size_t n) {
+                    input.read(chunk, n * size_data_per_element_);
+                });
             }
-            input.read(data_level0_memory_, cur_element_count * size_data_per_element_);
 
             size_links_per_element_ = maxM_ * sizeof(LocationType) + sizeof(LocationType);
+            initLabelOpLocks();
 
-            size_links_level0_ = maxM0_ * sizeof(LocationType) + sizeof(LocationType);
-            std::vector<std::mutex>(max_elements).swap(link_list_locks_);
-            std::vector<std::mutex>(MAX_LABEL_OPERATION_LOCKS).swap(label_op_locks_);
-
-            visited_list_pool_ = new VisitedListPool(1, max_elements);
-
-            linkLists_ = (char **) malloc(sizeof(void *) * max_elements);
-            if (linkLists_ == nullptr) {
-                return turbo::resource_exhausted_error("Not enough memory: loadIndex failed to allocate linklists");
-            }
-            element_levels_ = std::vector<int>(max_elements);
             revSize_ = 1.0 / mult_;
             ef_ = 10;
+            label_lookup_.clear();
+            if (!hnsw_conf.dense_label) {
+                label_lookup_.reserve(cur_element_count);
+            }
             for (size_t i = 0; i < cur_element_count; i++) {
-                label_lookup_[getExternalLabel(i)] = i;
+                // the index may be saved while a writer held the lock
+                getLinkListLock(i).unlock();
+                if (!hnsw_conf.dense_label) {
+                    label_lookup_.insert_or_assign(getExternalLabel(i), i);
+                }
                 unsigned int linkListSize;
                 readBinaryPOD(input, linkListSize);
                 if (linkListSize == 0) {
@@ -776,7 +1304,11 @@ namespace phekda {
                 }
             }
 
+            num_present_ = 0;
             for (size_t i = 0; i < cur_element_count; i++) {
+                if (hnsw_conf.dense_label && isPresent(i)) {
+                    num_present_ += 1;
+                }
                 if (isMarkedDeleted(i)) {
                     num_deleted_ += 1;
                     if (hnsw_conf.allow_replace_deleted) deleted_elements.insert(i);
@@ -794,13 +1326,10 @@ namespace phekda {
             // lock all operations with element by label
             std::unique_lock<std::mutex> lock_label(getLabelOpMutex(label));
 
-            std::unique_lock<std::mutex> lock_table(label_lookup_lock);
-            auto search = label_lookup_.find(label);
-            if (search == label_lookup_.end() || isMarkedDeleted(search->second)) {
+            LocationType internalId;
+            if (!getInternalId(label, internalId) || isMarkedDeleted(internalId)) {
                 throw std::runtime_error("Label not found");
             }
-            LocationType internalId = search->second;
-            lock_table.unlock();
 
             char *data_ptrv = getDataByInternalId(internalId);
             size_t dim = *((size_t *) dist_func_param_);
@@ -818,16 +1347,14 @@ namespace phekda {
         * Marks an element with the given label deleted, does NOT really change the current graph.
         */
         turbo::Status markDelete(LabelType label) override {
+            std::shared_lock<SnapshotGate> gate(snapshot_gate_);
             // lock all operations with element by label
             std::unique_lock<std::mutex> lock_label(getLabelOpMutex(label));
 
-            std::unique_lock<std::mutex> lock_table(label_lookup_lock);
-            auto search = label_lookup_.find(label);
-            if (search == label_lookup_.end()) {
+            LocationType internalId;
+            if (!getInternalId(label, internalId)) {
                 return turbo::not_found_error("Label not found");
             }
-            LocationType internalId = search->second;
-            lock_table.unlock();
 
             return markDeletedInternal(internalId);
         }
@@ -835,19 +1362,71 @@ namespace phekda {
         virtual turbo::Status getVector(LabelType label, void *data) override{
             std::unique_lock<std::mutex> lock_label(getLabelOpMutex(label));
 
-            std::unique_lock<std::mutex> lock_table(label_lookup_lock);
-            auto search = label_lookup_.find(label);
-            if (search == label_lookup_.end()) {
+            LocationType internalId;
+            if (!getInternalId(label, internalId)) {
                 return turbo::not_found_error("Label not found");
             }
-            LocationType internalId = search->second;
-            lock_table.unlock();
             auto *ptr = getDataByInternalId(internalId);
             std::memcpy(data, ptr, data_size_);
             return turbo::OkStatus();
         }
 
 
+        // labels are resolved with one lock per label map shard, the vectors
+        // are copied in internal id order with the next ones prefetched. no
+        // label op lock is taken: as in search, a concurrent update of the
+        // same label may be read while written, a label replaced meanwhile
+        // is reported as not found
+        size_t getVectors(const LabelType *labels, size_t n, void *data, bool *found) override {
+            std::vector<LocationType> locations(n);
+            if (hnsw_conf.dense_label) {
+                // the label is the internal id, there is no map to look up
+                for (size_t i = 0; i < n; ++i) {
+                    if (!getInternalId(labels[i], locations[i])) {
+                        locations[i] = LabelMap::kEmpty;
+                    }
+                }
+            } else {
+                label_lookup_.find_batch(labels, n, locations.data());
+            }
+            std::vector<std::pair<LocationType, size_t>> order;
+            order.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                found[i] = false;
+                if (locations[i] != LabelMap::kEmpty) {
+                    order.emplace_back(locations[i], i);
+                }
+            }
+            std::sort(order.begin(), order.end());
+
+            constexpr size_t kPrefetchAhead = 4;
+            auto prefetch_vector = [this](LocationType internal_id) {
+#ifdef USE_SSE
+                const char *ptr = getDataByInternalId(internal_id);
+                for (size_t offset = 0; offset < data_size_; offset += 64) {
+                    _mm_prefetch(ptr + offset, _MM_HINT_T0);
+                }
+#endif
+            };
+            for (size_t k = 0; k < std::min(kPrefetchAhead, order.size()); ++k) {
+                prefetch_vector(order[k].first);
+            }
+            size_t count = 0;
+            for (size_t k = 0; k < order.size(); ++k) {
+                if (k + kPrefetchAhead < order.size()) {
+                    prefetch_vector(order[k + kPrefetchAhead].first);
+                }
+                auto internal_id = order[k].first;
+                auto i = order[k].second;
+                std::memcpy(static_cast<char *>(data) + i * data_size_, getDataByInternalId(internal_id), data_size_);
+                if (getExternalLabel(internal_id) == labels[i]) {
+                    found[i] = true;
+                    ++count;
+                }
+            }
+            return count;
+        }
+
         /*
         * Uses the last 16 bits of the memory for the linked list size to store the mark,
         * whereas maxM0_ has to be limited to the lower 16 bits, however, still large enough in almost all cases.
@@ -857,6 +1436,7 @@ namespace phekda {
                 return turbo::out_of_range_error("The requested to delete element is already deleted");
             }
             if (!isMarkedDeleted(internalId)) {
+                preserveElement(internalId);
                 unsigned char *ll_cur = ((unsigned char *) get_linklist0(internalId)) + 2;
                 *ll_cur |= DELETE_MARK;
                 num_deleted_ += 1;
@@ -878,16 +1458,14 @@ namespace phekda {
         *  because elements marked as deleted can be completely removed by addPoint
         */
         void unmarkDelete(LabelType label) {
+            std::shared_lock<SnapshotGate> gate(snapshot_gate_);
             // lock all operations with element by label
             std::unique_lock<std::mutex> lock_label(getLabelOpMutex(label));
 
-            std::unique_lock<std::mutex> lock_table(label_lookup_lock);
-            auto search = label_lookup_.find(label);
-            if (search == label_lookup_.end()) {
+            LocationType internalId;
+            if (!getInternalId(label, internalId)) {
                 throw std::runtime_error("Label not found");
             }
-            LocationType internalId = search->second;
-            lock_table.unlock();
 
             unmarkDeletedInternal(internalId);
         }
@@ -899,6 +1477,7 @@ namespace phekda {
         void unmarkDeletedInternal(LocationType internalId) {
             assert(internalId < cur_element_count);
             if (isMarkedDeleted(internalId)) {
+                preserveElement(internalId);
                 unsigned char *ll_cur = ((unsigned char *) get_linklist0(internalId)) + 2;
                 *ll_cur &= ~DELETE_MARK;
                 num_deleted_ -= 1;
@@ -921,6 +1500,15 @@ namespace phekda {
         }
 
 
+        /*
+        * Checks if the slot holds an element, vacant slots only exist in dense label mode.
+        */
+        bool isPresent(LocationType internalId) const {
+            unsigned char *ll_cur = ((unsigned char *) get_linklist0(internalId)) + 2;
+            return *ll_cur & PRESENT_MARK;
+        }
+
+
         unsigned short int getListCount(LocationType *ptr) const {
             return *((unsigned short int *) ptr);
         }
@@ -939,7 +1527,11 @@ namespace phekda {
             if ((hnsw_conf.allow_replace_deleted == false) && (wconf.replace_deleted == true)) {
                 return turbo::invalid_argument_error("Replacement of deleted elements is disabled in constructor");
             }
+            if (hnsw_conf.dense_label && wconf.replace_deleted) {
+                return turbo::invalid_argument_error("Replacement of deleted elements is not supported in dense label mode");
+            }
 
+            std::shared_lock<SnapshotGate> gate(snapshot_gate_);
             // lock all operations with element by label
             std::unique_lock<std::mutex> lock_label(getLabelOpMutex(label));
             if (!wconf.replace_deleted) {
@@ -962,12 +1554,15 @@ namespace phekda {
             } else {
                 // we assume that there are no concurrent operations on deleted element
                 LabelType label_replaced = getExternalLabel(internal_id_replaced);
+                preserveElement(internal_id_replaced);
                 setExternalLabel(internal_id_replaced, label);
 
-                std::unique_lock<std::mutex> lock_table(label_lookup_lock);
-                label_lookup_.erase(label_replaced);
-                label_lookup_[label] = internal_id_replaced;
-                lock_table.unlock();
+                // map the new label first, then drop the old one only if it
+                // still points here, a concurrent add may have moved it already
+                label_lookup_.insert_or_assign(label, internal_id_replaced);
+                if (label_replaced != label) {
+                    label_lookup_.erase(label_replaced, internal_id_replaced);
+                }
 
                 unmarkDeletedInternal(internal_id_replaced);
                 updatePoint(data_point, internal_id_replaced, 1.0);
@@ -978,6 +1573,7 @@ namespace phekda {
 
         void updatePoint(const void *dataPoint, LocationType internalId, float updateNeighborProbability) {
             // update the feature vector associated with existing point with new vector
+            preserveElement(internalId);
             memcpy(getDataByInternalId(internalId), dataPoint, data_size_);
 
             int maxLevelCopy = maxlevel_;
@@ -1039,7 +1635,8 @@ namespace phekda {
                     getNeighborsByHeuristic2(candidates, layer == 0 ? maxM0_ : maxM_);
 
                     {
-                        std::unique_lock<std::mutex> lock(link_list_locks_[neigh]);
+                        std::unique_lock<ByteSpinLock> lock(getLinkListLock(neigh));
+                        preserveElement(neigh);
                         LocationType *ll_cur;
                         ll_cur = get_linklist_at_level(neigh, layer);
                         size_t candSize = candidates.size();
@@ -1071,16 +1668,18 @@ namespace phekda {
                     while (changed) {
                         changed = false;
                         unsigned int *data;
-                        std::unique_lock<std::mutex> lock(link_list_locks_[currObj]);
+                        std::unique_lock<ByteSpinLock> lock(getLinkListLock(currObj));
                         data = get_linklist_at_level(currObj, level);
                         int size = getListCount(data);
                         LocationType *datal = (LocationType *) (data + 1);
 #ifdef USE_SSE
-                        _mm_prefetch(getDataByInternalId(*datal), _MM_HINT_T0);
+                        prefetchData(*datal);
 #endif
                         for (int i = 0; i < size; i++) {
 #ifdef USE_SSE
-                            _mm_prefetch(getDataByInternalId(*(datal + i + 1)), _MM_HINT_T0);
+                            if (i + 1 < size) {
+                                prefetchData(*(datal + i + 1));
+                            }
 #endif
                             LocationType cand = datal[i];
                             DistanceType d = fstdistfunc_(dataPoint, getDataByInternalId(cand), dist_func_param_);
@@ -1129,7 +1728,7 @@ namespace phekda {
 
 
         std::vector<LocationType> getConnectionsWithLock(LocationType internalId, int level) {
-            std::unique_lock<std::mutex> lock(link_list_locks_[internalId]);
+            std::unique_lock<ByteSpinLock> lock(getLinkListLock(internalId));
             unsigned int *data = get_linklist_at_level(internalId, level);
             int size = getListCount(data);
             std::vector<LocationType> result(size);
@@ -1144,17 +1743,16 @@ namespace phekda {
             {
                 // Checking if the element with the same label already exists
                 // if so, updating it *instead* of creating a new element.
-                std::unique_lock<std::mutex> lock_table(label_lookup_lock);
-                auto search = label_lookup_.find(label);
-                if (search != label_lookup_.end()) {
-                    LocationType existingInternalId = search->second;
+                // the caller holds the label operation lock, so the label
+                // can not be inserted by others between find and insert.
+                LocationType existingInternalId;
+                if (getInternalId(label, existingInternalId)) {
                     if (hnsw_conf.allow_replace_deleted) {
                         if (isMarkedDeleted(existingInternalId)) {
                             return turbo::invalid_argument_error(
                                     "Can't use add point to update deleted elements if replacement of deleted elements is enabled.");
                         }
                     }
-                    lock_table.unlock();
 
                     if (isMarkedDeleted(existingInternalId)) {
                         unmarkDeletedInternal(existingInternalId);
@@ -1164,16 +1762,51 @@ namespace phekda {
                     return existingInternalId;
                 }
 
-                if (cur_element_count >= core_conf.max_elements) {
-                    return turbo::out_of_range_error("The number of elements exceeds the specified limit");
+                if (hnsw_conf.dense_label) {
+                    // the slot is the label, move the high water mark over it
+                    if (label >= max_elements_) {
+                        if (!core_conf.auto_grow) {
+                            return turbo::out_of_range_error("The label exceeds the specified limit in dense label mode");
+                        }
+                        auto rs = growStorage(label + 1);
+                        if (!rs.ok()) {
+                            return rs;
+                        }
+                    }
+                    cur_c = label;
+                    size_t count = cur_element_count.load();
+                    while (count <= label && !cur_element_count.compare_exchange_weak(count, label + 1)) {
+                    }
+                    num_present_.fetch_add(1);
+                } else {
+                    // reserve a slot without a global lock
+                    size_t count = cur_element_count.load();
+                    while (true) {
+                        if (count >= max_elements_) {
+                            if (!core_conf.auto_grow) {
+                                return turbo::out_of_range_error("The number of elements exceeds the specified limit");
+                            }
+                            auto rs = growStorage(count + 1);
+                            if (!rs.ok()) {
+                                return rs;
+                            }
+                            count = cur_element_count.load();
+                            continue;
+                        }
+                        if (cur_element_count.compare_exchange_weak(count, count + 1)) {
+                            break;
+                        }
+                    }
+                    cur_c = count;
+                    label_lookup_.insert_or_assign(label, cur_c);
                 }
-
-                cur_c = cur_element_count;
-                cur_element_count++;
-                label_lookup_[label] = cur_c;
             }
 
-            std::unique_lock<std::mutex> lock_el(link_list_locks_[cur_c]);
+            // a vacant slot of the dense label mode may be in a running save
+            preserveElement(cur_c);
+            // clear the element before taking its lock, the lock is in the header
+            memset(data_level0_.at(cur_c) + offsetLevel0_, 0, size_data_per_element_);
+            std::unique_lock<ByteSpinLock> lock_el(getLinkListLock(cur_c));
             int curlevel = getRandomLevel(mult_);
             if (level > 0)
                 curlevel = level;
@@ -1187,11 +1820,10 @@ namespace phekda {
             LocationType currObj = enterpoint_node_;
             LocationType enterpoint_copy = enterpoint_node_;
 
-            memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
-
             // Initialisation of the data and label
-            memcpy(getExternalLabeLp(cur_c), &label, sizeof(LabelType));
+            setExternalLabel(cur_c, label);
             memcpy(getDataByInternalId(cur_c), data_point, data_size_);
+            *(((unsigned char *) get_linklist0(cur_c)) + 2) |= PRESENT_MARK;
 
             if (curlevel) {
                 linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
@@ -1209,14 +1841,14 @@ namespace phekda {
                         while (changed) {
                             changed = false;
                             unsigned int *data;
-                            std::unique_lock<std::mutex> lock(link_list_locks_[currObj]);
+                            std::unique_lock<ByteSpinLock> lock(getLinkListLock(currObj));
                             data = get_linklist(currObj, level);
                             int size = getListCount(data);
 
                             LocationType *datal = (LocationType *) (data + 1);
                             for (int i = 0; i < size; i++) {
                                 LocationType cand = datal[i];
-                                if (cand < 0 || cand > core_conf.max_elements) {
+                                if (cand < 0 || cand > max_elements_) {
                                     return turbo::internal_error("cand error");
                                 }
                                 DistanceType d = fstdistfunc_(data_point, getDataByInternalId(cand), dist_func_param_);
@@ -1249,7 +1881,7 @@ namespace phekda {
                 }
             } else {
                 // Do nothing for the first element
-                enterpoint_node_ = 0;
+                enterpoint_node_ = cur_c;
                 maxlevel_ = curlevel;
             }
 
@@ -1261,102 +1893,20 @@ namespace phekda {
             return cur_c;
         }
 
-        template<bool has_deletions, bool collect_metrics = false>
-        turbo::Status search_impl(LocationType ep_id, SearchContext&context, size_t ef, MaxResultQueue &queue) const {
-            VisitedList *vl = visited_list_pool_->getFreeVisitedList();
-            vl_type *visited_array = vl->mass;
-            vl_type visited_array_tag = vl->curV;
-            MinResultQueue candidate_set;
-            auto data_point = context.get_query();
-            DistanceType lowerBound;
-            auto ep_label = getExternalLabel(ep_id);
-            if ((!has_deletions || !isMarkedDeleted(ep_id)) && !context.is_exclude(ep_label)) {
-                DistanceType dist = fstdistfunc_(data_point, getDataByInternalId(ep_id), dist_func_param_);
-                lowerBound = dist;
-                queue.emplace(dist, ep_label, ep_id);
-                candidate_set.emplace(dist, ep_label, ep_id);
-            } else {
-                lowerBound = std::numeric_limits<DistanceType>::max();
-                candidate_set.emplace(lowerBound, ep_label, ep_id);
-            }
-
-            visited_array[ep_id] = visited_array_tag;
-
-            while (!candidate_set.empty()) {
-                auto current_node_pair = candidate_set.top();
-
-                if ((-current_node_pair.distance) > lowerBound &&
-                    (queue.size() == ef || (!context.has_condition() && !has_deletions))) {
-                    break;
-                }
-                candidate_set.pop();
-
-                LocationType current_node_id = current_node_pair.location;
-                int *data = (int *) get_linklist0(current_node_id);
-                size_t size = getListCount((LocationType *) data);
-//                bool cur_node_deleted = isMarkedDeleted(current_node_id);
-                if (collect_metrics) {
-                    metric_hops++;
-                    metric_distance_computations += size;
-                }
-
-#ifdef USE_SSE
-                _mm_prefetch((char *) (visited_array + *(data + 1)), _MM_HINT_T0);
-                _mm_prefetch((char *) (visited_array + *(data + 1) + 64), _MM_HINT_T0);
-                _mm_prefetch(data_level0_memory_ + (*(data + 1)) * size_data_per_element_ + offsetData_, _MM_HINT_T0);
-                _mm_prefetch((char *) (data + 2), _MM_HINT_T0);
-#endif
-
-                for (size_t j = 1; j <= size; j++) {
-                    int candidate_id = *(data + j);
-//                    if (candidate_id == 0) continue;
-#ifdef USE_SSE
-                    _mm_prefetch((char *) (visited_array + *(data + j + 1)), _MM_HINT_T0);
-                    _mm_prefetch(data_level0_memory_ + (*(data + j + 1)) * size_data_per_element_ + offsetData_,
-                                 _MM_HINT_T0);  ////////////
-#endif
-                    if (!(visited_array[candidate_id] == visited_array_tag)) {
-                        visited_array[candidate_id] = visited_array_tag;
-                        auto candidate_label = getExternalLabel(candidate_id);
-                        char *currObj1 = (getDataByInternalId(candidate_id));
-                        DistanceType dist = fstdistfunc_(data_point, currObj1, dist_func_param_);
-
-                        if (queue.size() < ef || lowerBound > dist) {
-                            candidate_set.emplace(dist, candidate_label, candidate_id);
-#ifdef USE_SSE
-                            _mm_prefetch(data_level0_memory_ + candidate_set.top().location * size_data_per_element_ +
-                                         offsetLevel0_,  ///////////
-                                         _MM_HINT_T0);  ////////////////////////
-#endif
-                            if ((!has_deletions || !isMarkedDeleted(candidate_id)) &&!context.is_exclude(candidate_label)) {
-                                queue.emplace(dist, candidate_label, candidate_id);
-                            }
-
-                            if (queue.size() > ef)
-                                queue.pop();
-
-                            if (!queue.empty())
-                                lowerBound = queue.top().distance;
-                        }
-                    }
-                }
-            }
-
-            visited_list_pool_->releaseVisitedList(vl);
-            return turbo::OkStatus();
-        }
-
-        turbo::Status search(SearchContext &context) override {
-            context.schedule_time = turbo::Time::current_time();
-            if (cur_element_count == 0) {
-                context.end_time = turbo::Time::current_time();
-                return turbo::OkStatus();
-            }
-
-            auto query_data = context.get_query();
-
+        // greedy descent from the enter point to level 1, the closest element
+        // found is the level 0 entry. with explain the path goes to trace
+        template<bool explain = false>
+        turbo::Status searchUpperLayers(const void *query_data, SearchStats &stats, LocationType &entry,
+                                        SearchTrace *trace = nullptr) const {
             LocationType currObj = enterpoint_node_;
             DistanceType curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
+            stats.distance_computations++;
+            if (explain) {
+                trace->max_level = maxlevel_;
+                trace->entry_point = currObj;
+                trace->entry_distance = curdist;
+                trace->level_hops.assign(maxlevel_ + 1, 0);
+            }
 
             for (int level = maxlevel_; level > 0; level--) {
                 bool changed = true;
@@ -1366,19 +1916,24 @@ namespace phekda {
 
                     data = (unsigned int *) get_linklist(currObj, level);
                     int size = getListCount(data);
-                    metric_hops++;
-                    metric_distance_computations += size;
+                    stats.hops++;
+                    stats.distance_computations += size;
+                    if (explain) {
+                        trace->level_hops[level]++;
+                    }
 
                     LocationType *datal = (LocationType *) (data + 1);
                     for (int i = 0; i < size; i++) {
                         LocationType cand = datal[i];
-                        if (cand < 0 || cand > core_conf.max_elements) {
-                            context.end_time = turbo::Time::current_time();
+                        if (cand > max_elements_) {
                             return turbo::internal_error("cand error");
                         }
                         DistanceType d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
 
                         if (d < curdist) {
+                            if (explain) {
+                                trace->upper_path.push_back({level, currObj, cand, d});
+                            }
                             curdist = d;
                             currObj = cand;
                             changed = true;
@@ -1386,44 +1941,113 @@ namespace phekda {
                     }
                 }
             }
+            if (explain) {
+                trace->level0_entry = currObj;
+            }
+            entry = currObj;
+            return turbo::OkStatus();
+        }
 
-            MaxResultQueue top_candidates;
-            if (num_deleted_) {
-                auto rs = search_impl<true, true>(
-                        currObj, context, std::max(ef_, static_cast<size_t>(context.top_k)), top_candidates);
-                if(!rs.ok()) {
-                    context.end_time = turbo::Time::current_time();
-                    return rs;
-                }
-            } else {
-                auto rs = search_impl<false, true>(
-                        currObj, context, std::max(ef_, static_cast<size_t>(context.top_k)), top_candidates);
-                if(!rs.ok()) {
-                    context.end_time = turbo::Time::current_time();
-                    return rs;
+        // search totals of the index since creation or the last reset
+        SearchStats getSearchStats() const override {
+            return search_stats_.total();
+        }
+
+        void resetSearchStats() override {
+            search_stats_.reset();
+        }
+
+        // copy the vectors of the results into context.raw_vectors right after
+        // the search touched them, the locations are only kept if asked for
+        void copyRawVectors(SearchContext &context) const {
+            context.raw_vectors.resize(context.results.size() * data_size_);
+            uint8_t *out = context.raw_vectors.data();
+            for (auto &rez: context.results) {
+                memcpy(out, getDataByInternalId(rez.location), data_size_);
+                out += data_size_;
+                if (!context.with_location) {
+                    rez.location = 0;
                 }
             }
+        }
 
-            while (top_candidates.size() > context.top_k) {
-                top_candidates.pop();
+        template<bool has_deletions, bool collect_metrics = false, bool explain = false>
+        turbo::Status search_impl(LocationType ep_id, SearchContext &context, size_t ef, SearchScratch &scratch) const {
+            bool completed = searchLevel0<has_deletions, collect_metrics, explain>(
+                    ep_id, context.get_query(), ef, context.has_condition(),
+                    [&context](LabelType label) { return !context.is_exclude(label); }, scratch,
+                    context.trace.get(), context.budget.limited() ? &context.budget : nullptr);
+            context.partial = !completed;
+            return turbo::OkStatus();
+        }
+
+        turbo::Status search(SearchContext &context) override {
+            context.schedule_time = turbo::Time::current_time();
+            context.partial = false;
+            if (cur_element_count == 0) {
+                context.end_time = turbo::Time::current_time();
+                return turbo::OkStatus();
             }
-            if(context.reverse_result) {
-                context.results.reserve(top_candidates.size());
-                while (!top_candidates.empty()) {
-                    auto rez = top_candidates.top();
-                    context.results.emplace_back(rez.distance, rez.label, context.with_location ? rez.location: 0);
-                    top_candidates.pop();
-                }
+
+            // heaps and visited list are pooled, a steady state query allocates nothing.
+            // a context carrying its own scratch skips the shared pool
+            SearchScratch *scratch = context.scratch ? context.scratch.get() : scratch_pool_.get();
+            scratch->stats = SearchStats();
+            scratch->stats.queries = 1;
+
+            // decided once per query, the traced search is a separate instantiation
+            bool explain = context.should_explain();
+            SearchTrace *trace = nullptr;
+            if (explain) {
+                context.trace = std::make_unique<SearchTrace>();
+                trace = context.trace.get();
             } else {
-                context.results.resize(top_candidates.size());
-                for(int i = top_candidates.size() - 1; i >= 0; i--) {
-                    auto rez = top_candidates.top();
-                    context.results[i] = ResultEntity(rez.distance, rez.label, context.with_location ? rez.location: 0);
-                    top_candidates.pop();
+                context.trace.reset();
+            }
+            auto phase_start = turbo::Time::current_time();
+
+            LocationType currObj;
+            auto rs = explain ? searchUpperLayers<true>(context.get_query(), scratch->stats, currObj, trace)
+                              : searchUpperLayers<false>(context.get_query(), scratch->stats, currObj);
+            if (explain) {
+                auto now = turbo::Time::current_time();
+                trace->upper_layers_time = now - phase_start;
+                phase_start = now;
+            }
+            if (rs.ok()) {
+                // the search list size of the context overrides the ef of the index
+                size_t ef = context.search_list_size > 0 ? context.search_list_size : ef_;
+                ef = std::max(ef, static_cast<size_t>(context.top_k));
+                if (explain) {
+                    rs = num_deleted_ ? search_impl<true, true, true>(currObj, context, ef, *scratch)
+                                      : search_impl<false, true, true>(currObj, context, ef, *scratch);
+                    auto now = turbo::Time::current_time();
+                    trace->level0_time = now - phase_start;
+                    phase_start = now;
+                } else {
+                    rs = num_deleted_ ? search_impl<true, true>(currObj, context, ef, *scratch)
+                                      : search_impl<false, true>(currObj, context, ef, *scratch);
+                }
+            }
+            context.stats = scratch->stats;
+            search_stats_.add(scratch->stats);
+            if (rs.ok()) {
+                context.results.clear();
+                scratch->results.pop_sorted(context.top_k, context.reverse_result, context.results,
+                                            context.with_location || context.with_raw_vector);
+                if (context.with_raw_vector) {
+                    copyRawVectors(context);
                 }
             }
+            if (explain) {
+                trace->filtered_out = scratch->stats.filtered_out;
+                trace->results_time = turbo::Time::current_time() - phase_start;
+            }
+            if (!context.scratch) {
+                scratch_pool_.release(scratch);
+            }
             context.end_time = turbo::Time::current_time();
-            return turbo::OkStatus();
+            return rs;
         }
 
         std::priority_queue<std::pair<DistanceType, LabelType >>
@@ -1431,53 +2055,33 @@ namespace phekda {
             std::priority_queue<std::pair<DistanceType, LabelType >> result;
             if (cur_element_count == 0) return result;
 
-            LocationType currObj = enterpoint_node_;
-            DistanceType curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
-
-            for (int level = maxlevel_; level > 0; level--) {
-                bool changed = true;
-                while (changed) {
-                    changed = false;
-                    unsigned int *data;
-
-                    data = (unsigned int *) get_linklist(currObj, level);
-                    int size = getListCount(data);
-                    metric_hops++;
-                    metric_distance_computations += size;
-
-                    LocationType *datal = (LocationType *) (data + 1);
-                    for (int i = 0; i < size; i++) {
-                        LocationType cand = datal[i];
-                        if (cand < 0 || cand > core_conf.max_elements)
-                            throw std::runtime_error("cand error");
-                        DistanceType d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
-
-                        if (d < curdist) {
-                            curdist = d;
-                            currObj = cand;
-                            changed = true;
-                        }
-                    }
-                }
+            SearchScratch *scratch = scratch_pool_.get();
+            scratch->stats = SearchStats();
+            scratch->stats.queries = 1;
+            LocationType currObj;
+            auto rs = searchUpperLayers(query_data, scratch->stats, currObj);
+            if (!rs.ok()) {
+                scratch_pool_.release(scratch);
+                throw std::runtime_error("cand error");
             }
-
-            std::priority_queue<std::pair<DistanceType, LocationType>, std::vector<std::pair<DistanceType, LocationType>>, CompareByFirst> top_candidates;
+            auto allowed = [isIdAllowed](LabelType label) { return !isIdAllowed || (*isIdAllowed)(label); };
             if (num_deleted_) {
-                top_candidates = searchBaseLayerST<true, true>(
-                        currObj, query_data, std::max(ef_, k), isIdAllowed);
+                searchLevel0<true, true>(currObj, query_data, std::max(ef_, k), isIdAllowed != nullptr, allowed, *scratch);
             } else {
-                top_candidates = searchBaseLayerST<false, true>(
-                        currObj, query_data, std::max(ef_, k), isIdAllowed);
+                searchLevel0<false, true>(currObj, query_data, std::max(ef_, k), isIdAllowed != nullptr, allowed, *scratch);
             }
+            search_stats_.add(scratch->stats);
 
+            ResultHeap &top_candidates = scratch->results;
             while (top_candidates.size() > k) {
                 top_candidates.pop();
             }
             while (top_candidates.size() > 0) {
-                std::pair<DistanceType, LocationType> rez = top_candidates.top();
-                result.push(std::pair<DistanceType, LabelType>(rez.first, getExternalLabel(rez.second)));
+                auto &rez = top_candidates.top();
+                result.emplace(rez.distance, rez.label);
                 top_candidates.pop();
             }
+            scratch_pool_.release(scratch);
             return result;
         }
 
@@ -21,6 +21,9 @@
 #pragma once
 
 #include <phekda/core/defines.h>
+#include <phekda/core/huge_page.h>
+#include <phekda/core/numa.h>
+#include <phekda/core/search_stats.h>
 #include <fstream>
 
 #ifndef NO_MANUAL_VECTORIZATION
@@ -136,6 +139,7 @@ static bool AVX512Capable() {
 
 #endif
 
+#include <functional>
 #include <queue>
 #include <vector>
 #include <iostream>
@@ -189,6 +193,30 @@ namespace phekda {
         size_t M = 16;
         size_t ef_construction = 200;
         size_t random_seed = 100;
+        // labels are the internal ids, must be in [0, max_elements)
+        // no label map and no inline label is kept, label based
+        // filters (eg. BitmapCondition) work on internal ids directly
+        // only HierarchicalNSW supports it, and it can not be used
+        // with replace_deleted
+        bool dense_label = false;
+        // elements per storage chunk, rounded up to power of two
+        // 0 means derived from max_elements
+        size_t chunk_elements = 0;
+        // pad the vector offset and the element stride to this many bytes,
+        // so vectors start on a cache line and never straddle an extra one,
+        // power of two, 0 keeps the packed layout. HierarchicalNSW only
+        size_t alignment = 0;
+        // keep vectors and labels in their own arrays, apart from the level 0
+        // links, so graph traversal and vector reads touch dense cache lines.
+        // the index file layout is the same either way. HierarchicalNSW only
+        bool split_layout = false;
+        // page backing of the element storage and visited lists, falls back to
+        // normal pages if huge pages are not available
+        HugePageMode huge_pages = HugePageMode::HUGE_PAGE_NONE;
+        // numa placement of the element storage, numa_node is the node
+        // for NUMA_BIND and NUMA_REPLICATE
+        NumaPolicy numa_policy = NumaPolicy::NUMA_NONE;
+        int numa_node = 0;
         SpaceInterface<DistanceType> *space = nullptr;
     };
 
@@ -200,6 +228,12 @@ namespace phekda {
 
     static constexpr HnswlibWriteConfig kHnswNotReplaceDeleted = {false};
 
+    struct HnswlibSaveConfig {
+        // called once the point in time snapshot is taken, before it is
+        // written. the writers of the index wait until it returns
+        std::function<void()> on_snapshot;
+    };
+
     class AlgorithmInterface {
     public:
 
@@ -216,6 +250,10 @@ namespace phekda {
 
         virtual turbo::Status saveIndex(const std::string &location, uint64_t snapshot) = 0;
 
+        // saveIndex, calling on_snapshot as HnswlibSaveConfig tells
+        virtual turbo::Status saveIndex(const std::string &location, uint64_t snapshot,
+                                        const std::function<void()> &on_snapshot) = 0;
+
         virtual turbo::Status loadIndex(const std::string &location, const CoreConfig &config, const HnswlibConfig &hnswlib_config) = 0;
 
         virtual turbo::Status search(SearchContext &context)  = 0;
@@ -229,6 +267,25 @@ namespace phekda {
 
         virtual turbo::Status getVector(LabelType label, void *data) = 0;
 
+        // batched getVector, the vector of labels[i] goes to row i of data.
+        // found[i] is false for a label not found, without failing the batch,
+        // return the number found
+        virtual size_t getVectors(const LabelType *labels, size_t n, void *data, bool *found) = 0;
+
+        // elements stored, the deleted ones included
+        virtual size_t getCurrentElementCount() const = 0;
+
+        // elements marked deleted but still stored
+        virtual size_t getDeletedCount() const = 0;
+
+        // memory of the element storage and how much of it is on huge pages
+        virtual PageStats getPageStats() const = 0;
+
+        // search totals since creation or the last reset
+        virtual SearchStats getSearchStats() const = 0;
+
+        virtual void resetSearchStats() = 0;
+
         virtual ~AlgorithmInterface() {
         }
     };
@@ -22,6 +22,58 @@
 
 namespace phekda {
 
+    static std::unique_ptr<AlgorithmInterface> new_algorithm(IndexType index_type) {
+        if(index_type == IndexType::INDEX_HNSWLIB) {
+            return std::make_unique<HierarchicalNSW>();
+        } else if(index_type == IndexType::INDEX_HNSW_FLAT) {
+            return std::make_unique<BruteforceSearch>();
+        }
+        return nullptr;
+    }
+
+    turbo::Status HnswIndex::create_algorithm(const CoreConfig &core) {
+        switch (core.metric) {
+            case MetricType::METRIC_L2:
+                space_ = std::make_unique<L2Space>(core.dimension);
+                break;
+            case MetricType::METRIC_IP:
+                space_ = std::make_unique<InnerProductSpace>(core.dimension);
+                break;
+            case MetricType::METRIC_COSINE:
+                return turbo::invalid_argument_error("unsupported metric type");
+            case MetricType::METRIC_NONE:
+                return turbo::invalid_argument_error("unsupported metric type");
+            default:
+                return turbo::invalid_argument_error("unsupported metric type");
+        };
+        if(!space_) {
+            return turbo::invalid_argument_error("unsupported metric type");
+        }
+        alg_ = new_algorithm(core.index_type);
+        if(!alg_) {
+            return turbo::invalid_argument_error("unsupported index type");
+        }
+        return turbo::OkStatus();
+    }
+
+    AlgorithmInterface *HnswIndex::local_algorithm() const {
+        if(replicas_.empty()) {
+            return alg_.get();
+        }
+        auto node = static_cast<size_t>(numa_current_node());
+        if(node == 0 || node > replicas_.size()) {
+            return alg_.get();
+        }
+        return replicas_[node - 1].get();
+    }
+
+    turbo::Status HnswIndex::check_writable() const {
+        if(!replicas_.empty()) {
+            return turbo::failed_precondition_error("index replicated per numa node is read only");
+        }
+        return turbo::OkStatus();
+    }
+
     turbo::Status HnswIndex::initialize(const IndexConfig &config) {
         if(init_type_ != IndexInitializationType::INIT_NONE) {
             return turbo::OkStatus();
@@ -40,32 +92,12 @@ namespace phekda {
             return turbo::invalid_argument_error("dimension should not be 0");
         }
 
-        switch (config.core.metric) {
-            case MetricType::METRIC_L2:
-                space_ = std::make_unique<L2Space>(config.core.dimension);
-                break;
-            case MetricType::METRIC_IP:
-                space_ = std::make_unique<InnerProductSpace>(config.core.dimension);
-                break;
-            case MetricType::METRIC_COSINE:
-                return turbo::invalid_argument_error("unsupported metric type");
-            case MetricType::METRIC_NONE:
-                return turbo::invalid_argument_error("unsupported metric type");
-            default:
-                return turbo::invalid_argument_error("unsupported metric type");
-        };
-        if(!space_) {
-            return turbo::invalid_argument_error("unsupported metric type");
-        }
-        if(config.core.index_type == IndexType::INDEX_HNSWLIB) {
-            alg_ = std::make_unique<HierarchicalNSW>();
-        } else if(config.core.index_type == IndexType::INDEX_HNSW_FLAT) {
-            alg_ = std::make_unique<BruteforceSearch>();
-        } else {
-            return turbo::invalid_argument_error("unsupported index type");
+        auto rs = create_algorithm(config.core);
+        if(!rs.ok()) {
+            return rs;
         }
         hnswlib_config.space = space_.get();
-        auto rs = alg_->initialize(config.core, hnswlib_config);
+        rs = alg_->initialize(config.core, hnswlib_config);
         if(!rs.ok()) {
             return rs;
         }
@@ -85,7 +117,16 @@ namespace phekda {
         } catch (const std::bad_any_cast &e) {
             return turbo::invalid_argument_error("write_conf is not HnswlibWriteConfig");
         }
-        return alg_->addPoint(data, label, hnswlib_write_conf);
+        auto rs = check_writable();
+        if(!rs.ok()) {
+            return rs;
+        }
+        ScopedLatency latency(metrics_.insert);
+        rs = alg_->addPoint(data, label, hnswlib_write_conf);
+        if(!rs.ok()) {
+            metrics_.insert_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
     }
 
     turbo::Status HnswIndex::add_vectors(turbo::Nonnull<const uint8_t *> data, turbo::Nonnull<const LabelType *> labels, uint32_t num,
@@ -101,10 +142,16 @@ namespace phekda {
         } catch (const std::bad_any_cast &e) {
             return turbo::invalid_argument_error("write_conf is not HnswlibWriteConfig");
         }
+        auto rs = check_writable();
+        if(!rs.ok()) {
+            return rs;
+        }
         auto size = space_->get_data_size();
         for(uint32_t i = 0; i < num; ++i) {
-            auto rs = alg_->addPoint(data + i * size, labels[i], hnswlib_write_conf);
+            ScopedLatency latency(metrics_.insert);
+            rs = alg_->addPoint(data + i * size, labels[i], hnswlib_write_conf);
             if(!rs.ok()) {
+                metrics_.insert_errors.fetch_add(1, std::memory_order_relaxed);
                 return rs;
             }
         }
@@ -112,25 +159,45 @@ namespace phekda {
     }
 
     turbo::Status HnswIndex::get_vector(LabelType label, turbo::Nonnull<uint8_t *> data) {
-        return alg_->getVector(label, data);
+        return local_algorithm()->getVector(label, data);
     }
     turbo::Status
     HnswIndex::get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data) {
-        auto size = space_->get_data_size();
-        for(uint32_t i = 0; i < num; ++i) {
-            auto rs = alg_->getVector(labels[i], data + i * size);
-            if(!rs.ok()) {
-                return rs;
-            }
+        std::unique_ptr<bool[]> found(new bool[num]);
+        if (local_algorithm()->getVectors(labels, num, data, found.get()) != num) {
+            return turbo::not_found_error("Label not found");
         }
         return turbo::OkStatus();
     }
 
+    turbo::Status
+    HnswIndex::get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data,
+                           turbo::Nonnull<bool *> found) {
+        local_algorithm()->getVectors(labels, num, data, found);
+        return turbo::OkStatus();
+    }
+
     turbo::Status HnswIndex::search(SearchContext &context) {
-        return alg_->search(context);
+        auto rs = local_algorithm()->search(context);
+        // the times are set by create_search_context and the algorithm
+        if(context.start_time != turbo::Time()) {
+            metrics_.queue_wait.record(context.schedule_time - context.start_time);
+        }
+        metrics_.search.record(context.end_time - context.schedule_time);
+        if(!rs.ok()) {
+            metrics_.search_errors.fetch_add(1, std::memory_order_relaxed);
+        } else if(context.partial) {
+            metrics_.partial_searches.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
     }
 
     turbo::Status HnswIndex::lazy_delete(LabelType label) {
+        auto rs = check_writable();
+        if(!rs.ok()) {
+            return rs;
+        }
+        ScopedLatency latency(metrics_.remove);
         return alg_->markDelete(label);
     }
 
@@ -143,11 +210,33 @@ namespace phekda {
     }
 
     turbo::Status HnswIndex::save(LabelType snapshot_id, const std::string &path, const std::any &save_conf) {
-        return alg_->saveIndex(path, snapshot_id);
+        ScopedLatency latency(metrics_.save);
+        auto *conf = std::any_cast<HnswlibSaveConfig>(&save_conf);
+        return alg_->saveIndex(path, snapshot_id, conf != nullptr ? conf->on_snapshot : nullptr);
+    }
+
+    turbo::Result<MetricsSnapshot> HnswIndex::metrics() const {
+        auto snap = metrics_.snapshot();
+        if(init_type_ == IndexInitializationType::INIT_NONE) {
+            return snap;
+        }
+        snap.elements = alg_->getCurrentElementCount();
+        snap.deleted = alg_->getDeletedCount();
+        if(snap.elements > 0) {
+            snap.deleted_ratio = static_cast<double>(snap.deleted) / static_cast<double>(snap.elements);
+        }
+        auto pages = alg_->getPageStats();
+        for(auto &replica : replicas_) {
+            pages += replica->getPageStats();
+        }
+        snap.memory_bytes = pages.bytes;
+        snap.huge_page_bytes = pages.huge_page_bytes;
+        return snap;
     }
 
     turbo::Status HnswIndex::load(const std::string &path, const IndexConfig &config) {
         turbo::MutexLock lock(&init_mutex_);
+        ScopedLatency latency(metrics_.load);
         if(init_type_ != IndexInitializationType::INIT_NONE) {
             return turbo::already_exists_error("index already initialized, can not load");
         }
@@ -158,8 +247,58 @@ namespace phekda {
         } catch (const std::bad_any_cast &e) {
             return turbo::invalid_argument_error("index_conf is not HnswlibConfig");
         }
+        if(core_config.dimension == 0) {
+            return turbo::invalid_argument_error("dimension should not be 0");
+        }
+        // the space and the algorithm are chosen by the config, as in initialize
+        auto rs = create_algorithm(core_config);
+        if(!rs.ok()) {
+            return rs;
+        }
+        hnswlib_config.space = space_.get();
+        bool replicate = hnswlib_config.numa_policy == NumaPolicy::NUMA_REPLICATE;
+        if(replicate) {
+            hnswlib_config.numa_node = 0;
+        }
+        rs = alg_->loadIndex(path, core_config, hnswlib_config);
+        if(!rs.ok()) {
+            return rs;
+        }
+        // a copy bound to each other node, searches pick the local one. loaded
+        // on the node, so the upper level links malloc-ed there are local too
+        for(int node = 1; replicate && node < numa_num_nodes(); ++node) {
+            auto replica = new_algorithm(core_config.index_type);
+            hnswlib_config.numa_node = node;
+            std::thread loader([&] {
+                (void) numa_pin_thread(node);
+                rs = replica->loadIndex(path, core_config, hnswlib_config);
+            });
+            loader.join();
+            if(!rs.ok()) {
+                replicas_.clear();
+                return rs;
+            }
+            replicas_.push_back(std::move(replica));
+        }
         init_type_ = IndexInitializationType::INIT_LOAD;
-        return alg_->loadIndex(path, core_config, hnswlib_config);
+        return turbo::OkStatus();
+    }
+
+    bool HnswIndex::support_build(std::any conf) const {
+        return init_type_ != IndexInitializationType::INIT_NONE &&
+               std::any_cast<HnswlibBuildConfig>(&conf) != nullptr &&
+               dynamic_cast<const HierarchicalNSW *>(alg_.get()) != nullptr;
+    }
+
+    turbo::Status HnswIndex::build(std::any conf) const {
+        if (!support_build(conf)) {
+            return turbo::unavailable_error("build not supported");
+        }
+        auto build_conf = std::any_cast<HnswlibBuildConfig>(conf);
+        if (build_conf.path.empty()) {
+            return turbo::invalid_argument_error("build path should not be empty");
+        }
+        return save_reordered(*dynamic_cast<const HierarchicalNSW *>(alg_.get()), build_conf);
     }
 
     CoreConfig HnswIndex::get_core_config() const {
@@ -24,6 +24,7 @@
 #include <phekda/unified.h>
 #include <phekda/hnswlib/hnswalg.h>
 #include <phekda/hnswlib/bruteforce.h>
+#include <phekda/hnswlib/reorder.h>
 #include <phekda/hnswlib/space_ip.h>
 #include <phekda/hnswlib/space_l2.h>
 #include <turbo/synchronization/mutex.h>
@@ -55,6 +56,11 @@ namespace phekda {
         turbo::Status
         get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data) override;
 
+        // resolved in one batch, copied in internal id order
+        turbo::Status
+        get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data,
+                    turbo::Nonnull<bool *> found) override;
+
         // search vectors in index
         // this is the only way to search in index
         // if the index search in different way, it should be specified in the
@@ -116,18 +122,16 @@ namespace phekda {
         // let it configurable in the build function's
         // conf parameter, and trans the ownership of the
         // conf to index, let index judge if it can build
-        bool support_build(std::any conf) const override {
-            return false;
-        }
+        // HnswlibBuildConfig on a HierarchicalNSW index, writes a copy
+        // with internal ids reordered for memory locality
+        bool support_build(std::any conf) const override;
 
         // build index
         // build index should not modify the data in the index
         // only can be visited the parameters in the index
         // after build it should output a new index data.
         // next time a new index should be call load to load the new index data
-        turbo::Status build(std::any conf) const override {
-            return turbo::unavailable_error("build not supported");
-        }
+        turbo::Status build(std::any conf) const override;
 
         CoreConfig get_core_config() const override ;
 
@@ -136,10 +140,48 @@ namespace phekda {
         IndexInitializationType get_initialization_type() const override {
             return init_type_;
         }
+
+        // latencies of the calls of this index, sizes of the primary copy,
+        // memory of all the copies
+        turbo::Result<MetricsSnapshot> metrics() const override;
+
+        // clear the histograms and counters, not atomic with concurrent calls
+        void reset_metrics() {
+            metrics_.reset();
+        }
+
+        // copies of the index, one per numa node when loaded with NUMA_REPLICATE
+        size_t num_replicas() const {
+            return replicas_.size() + 1;
+        }
+
+        // search totals of all the copies
+        SearchStats search_stats() const {
+            SearchStats stats;
+            if (alg_) {
+                stats += alg_->getSearchStats();
+            }
+            for (auto &replica: replicas_) {
+                stats += replica->getSearchStats();
+            }
+            return stats;
+        }
     private:
+        // create space_ and alg_ for the metric and index type
+        turbo::Status create_algorithm(const CoreConfig &core);
+
+        // the copy on the numa node of the calling thread
+        AlgorithmInterface *local_algorithm() const;
+
+        // replicas are read only
+        turbo::Status check_writable() const;
+
         turbo::Mutex         init_mutex_;
         IndexInitializationType                init_type_{IndexInitializationType::INIT_NONE};
         std::unique_ptr<AlgorithmInterface> alg_{nullptr};
+        // NUMA_REPLICATE copies for the nodes 1..n-1, alg_ is on node 0
+        std::vector<std::unique_ptr<AlgorithmInterface>> replicas_;
         std::unique_ptr<SpaceInterface<float>> space_{nullptr};
+        IndexMetrics metrics_;
     };
 }  // namespace phekda
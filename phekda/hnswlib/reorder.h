@@ -0,0 +1,198 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+#pragma once
+
+#include <phekda/hnswlib/hnswalg.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+namespace phekda {
+
+    enum class ReorderType {
+        REORDER_NONE = 0,
+        // breadth first from the entry point over the level 0 graph
+        REORDER_BFS = 1,
+        // reverse Cuthill-McKee, breadth first with low degree neighbors
+        // first, started from a low degree element of each component
+        REORDER_RCM = 2
+    };
+
+    struct ReorderReport {
+        ReorderType type{ReorderType::REORDER_NONE};
+        size_t elements{0};
+        // mean |id(u) - id(v)| over all level 0 links
+        double avg_neighbor_distance_before{0.0};
+        double avg_neighbor_distance_after{0.0};
+        double elapsed_seconds{0.0};
+    };
+
+    // for HnswIndex::build, writes a reordered copy of the index to path,
+    // load it to serve with the new layout
+    struct HnswlibBuildConfig {
+        ReorderType reorder{ReorderType::REORDER_BFS};
+        std::string path;
+        uint64_t snapshot{0};
+        // filled if not null
+        ReorderReport *report{nullptr};
+    };
+
+    namespace detail {
+
+        inline void for_each_level0_link(const HierarchicalNSW &alg, LocationType id,
+                                          const std::function<void(LocationType)> &fn) {
+            LocationType *ll = alg.get_linklist0(id);
+            size_t size = alg.getListCount(ll);
+            for (size_t i = 1; i <= size; ++i) {
+                fn(ll[i]);
+            }
+        }
+
+        // breadth first from the seeds, a new seed is taken from pick_seed
+        // each time a component is exhausted, neighbors sorted by degree if asked
+        template<typename PickSeed>
+        std::vector<LocationType> breadth_first(const HierarchicalNSW &alg, bool by_degree, PickSeed &&pick_seed) {
+            size_t n = alg.cur_element_count;
+            std::vector<LocationType> order;
+            order.reserve(n);
+            std::vector<bool> visited(n, false);
+            std::vector<LocationType> neighbors;
+            while (order.size() < n) {
+                LocationType seed = pick_seed(visited);
+                visited[seed] = true;
+                order.push_back(seed);
+                for (size_t head = order.size() - 1; head < order.size(); ++head) {
+                    neighbors.clear();
+                    for_each_level0_link(alg, order[head], [&](LocationType v) {
+                        if (v < n && !visited[v]) {
+                            visited[v] = true;
+                            neighbors.push_back(v);
+                        }
+                    });
+                    if (by_degree) {
+                        std::stable_sort(neighbors.begin(), neighbors.end(), [&](LocationType a, LocationType b) {
+                            return alg.getListCount(alg.get_linklist0(a)) < alg.getListCount(alg.get_linklist0(b));
+                        });
+                    }
+                    order.insert(order.end(), neighbors.begin(), neighbors.end());
+                }
+            }
+            return order;
+        }
+
+    }  // namespace detail
+
+    // new_to_old permutation of the internal ids, element i of the
+    // reordered index is element new_to_old[i] of alg. writers should be stopped
+    inline std::vector<LocationType> compute_reorder(const HierarchicalNSW &alg, ReorderType type) {
+        size_t n = alg.cur_element_count;
+        std::vector<LocationType> order;
+        switch (type) {
+            case ReorderType::REORDER_BFS: {
+                size_t next = 0;
+                bool first = true;
+                order = detail::breadth_first(alg, false, [&](const std::vector<bool> &visited) {
+                    if (first) {
+                        first = false;
+                        return alg.enterpoint_node_;
+                    }
+                    while (visited[next]) {
+                        ++next;
+                    }
+                    return static_cast<LocationType>(next);
+                });
+                break;
+            }
+            case ReorderType::REORDER_RCM: {
+                // seeds by ascending degree, approximates peripheral elements
+                std::vector<LocationType> by_degree(n);
+                std::iota(by_degree.begin(), by_degree.end(), 0);
+                std::stable_sort(by_degree.begin(), by_degree.end(), [&](LocationType a, LocationType b) {
+                    return alg.getListCount(alg.get_linklist0(a)) < alg.getListCount(alg.get_linklist0(b));
+                });
+                size_t next = 0;
+                order = detail::breadth_first(alg, true, [&](const std::vector<bool> &visited) {
+                    while (visited[by_degree[next]]) {
+                        ++next;
+                    }
+                    return by_degree[next];
+                });
+                std::reverse(order.begin(), order.end());
+                break;
+            }
+            default:
+                order.resize(n);
+                std::iota(order.begin(), order.end(), 0);
+                break;
+        }
+        return order;
+    }
+
+    // mean id distance of the level 0 links, under the permutation if not empty
+    inline double average_neighbor_distance(const HierarchicalNSW &alg, const std::vector<LocationType> &new_to_old) {
+        size_t n = alg.cur_element_count;
+        std::vector<LocationType> old_to_new;
+        if (!new_to_old.empty()) {
+            old_to_new.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                old_to_new[new_to_old[i]] = i;
+            }
+        }
+        auto id_of = [&](LocationType id) {
+            return old_to_new.empty() ? id : old_to_new[id];
+        };
+        double total = 0;
+        size_t links = 0;
+        for (LocationType u = 0; u < n; ++u) {
+            auto nu = static_cast<int64_t>(id_of(u));
+            detail::for_each_level0_link(alg, u, [&](LocationType v) {
+                total += std::llabs(nu - static_cast<int64_t>(id_of(v)));
+                ++links;
+            });
+        }
+        return links == 0 ? 0.0 : total / links;
+    }
+
+    // save a copy of alg with internal ids reordered for locality
+    inline turbo::Status save_reordered(const HierarchicalNSW &alg, const HnswlibBuildConfig &conf) {
+        if (alg.hnsw_conf.dense_label) {
+            return turbo::invalid_argument_error("reorder is not supported in dense label mode, labels are the ids");
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto new_to_old = compute_reorder(alg, conf.reorder);
+        auto rs = alg.saveIndexPermuted(conf.path, conf.snapshot, new_to_old);
+        if (!rs.ok()) {
+            return rs;
+        }
+        if (conf.report) {
+            conf.report->type = conf.reorder;
+            conf.report->elements = alg.cur_element_count;
+            conf.report->avg_neighbor_distance_before = average_neighbor_distance(alg, {});
+            conf.report->avg_neighbor_distance_after = average_neighbor_distance(alg, new_to_old);
+            conf.report->elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        return turbo::OkStatus();
+    }
+
+}  // namespace phekda
@@ -20,9 +20,12 @@
 //
 #pragma once
 
+#include <phekda/core/huge_page.h>
 #include <mutex>
+#include <new>
 #include <string.h>
-#include <deque>
+#include <vector>
+#include <algorithm>
 
 namespace phekda {
 typedef unsigned short int vl_type;
@@ -32,11 +35,21 @@ class VisitedList {
     vl_type curV;
     vl_type *mass;
     unsigned int numelements;
+    PageBlock block;
 
-    VisitedList(int numelements1) {
+    VisitedList(int numelements1, HugePageMode huge_pages = HugePageMode::HUGE_PAGE_NONE) {
         curV = -1;
         numelements = numelements1;
-        mass = new vl_type[numelements];
+        size_t bytes = sizeof(vl_type) * numelements;
+        // a list per concurrent search, hugetlb pages would pin a page for
+        // each, transparent huge pages only for lists spanning one
+        huge_pages = huge_pages == HugePageMode::HUGE_PAGE_NONE || bytes < kHugePage2MB
+                     ? HugePageMode::HUGE_PAGE_NONE : HugePageMode::HUGE_PAGE_TRANSPARENT;
+        block = page_alloc(bytes, 64, huge_pages);
+        if (block.ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        mass = static_cast<vl_type *>(block.ptr);
     }
 
     void reset() {
@@ -47,7 +60,7 @@ class VisitedList {
         }
     }
 
-    ~VisitedList() { delete[] mass; }
+    ~VisitedList() { page_free(block); }
 };
 ///////////////////////////////////////////////////////////
 //
@@ -56,15 +69,18 @@ class VisitedList {
 /////////////////////////////////////////////////////////
 
 class VisitedListPool {
-    std::deque<VisitedList *> pool;
+    // free lists used as a stack, the most recently used list is warm in cache
+    std::vector<VisitedList *> pool;
     std::mutex poolguard;
     int numelements;
+    HugePageMode huge_pages;
 
  public:
-    VisitedListPool(int initmaxpools, int numelements1) {
+    VisitedListPool(int initmaxpools, int numelements1, HugePageMode huge_pages1 = HugePageMode::HUGE_PAGE_NONE) {
         numelements = numelements1;
+        huge_pages = huge_pages1;
         for (int i = 0; i < initmaxpools; i++)
-            pool.push_front(new VisitedList(numelements));
+            pool.push_back(new VisitedList(numelements, huge_pages));
     }
 
     VisitedList *getFreeVisitedList() {
@@ -72,25 +88,47 @@ class VisitedListPool {
         {
             std::unique_lock <std::mutex> lock(poolguard);
             if (pool.size() > 0) {
-                rez = pool.front();
-                pool.pop_front();
+                rez = pool.back();
+                pool.pop_back();
+                // the index has grown since the list was created
+                if (rez->numelements < (unsigned int) numelements) {
+                    delete rez;
+                    rez = new VisitedList(numelements, huge_pages);
+                }
             } else {
-                rez = new VisitedList(numelements);
+                rez = new VisitedList(numelements, huge_pages);
             }
         }
         rez->reset();
         return rez;
     }
 
+    // lists handed out later cover at least numelements1 elements,
+    // lists in use keep their size until they are returned
+    void resize(int numelements1) {
+        std::unique_lock <std::mutex> lock(poolguard);
+        numelements = std::max(numelements, numelements1);
+    }
+
+    // page stats of the lists in the pool, lists in use are not counted
+    PageStats page_stats() {
+        std::vector<PageBlock> blocks;
+        {
+            std::unique_lock <std::mutex> lock(poolguard);
+            for (auto *vl: pool) {
+                blocks.push_back(vl->block);
+            }
+        }
+        return phekda::page_stats(blocks);
+    }
+
     void releaseVisitedList(VisitedList *vl) {
         std::unique_lock <std::mutex> lock(poolguard);
-        pool.push_front(vl);
+        pool.push_back(vl);
     }
 
     ~VisitedListPool() {
-        while (pool.size()) {
-            VisitedList *rez = pool.front();
-            pool.pop_front();
+        for (auto *rez: pool) {
             delete rez;
         }
     }
@@ -0,0 +1,107 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-24.
+//
+
+#pragma once
+
+#include <phekda/unified.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace phekda {
+
+    /**
+     * @class SearchContextPool
+     * @brief reusable search contexts of one index for steady state serving.
+     *        a released context is reset() and keeps its query, result and
+     *        scratch buffers, so the next query acquiring it allocates nothing
+     *
+     * @code
+     * SearchContextPool pool(&index);
+     * auto context = pool.acquire();
+     * context->with_top_k(10).with_query(query);
+     * auto rs = index.search(*context);
+     * // context goes back to the pool when the handle goes out of scope
+     * @endcode
+     *
+     * the index must outlive the pool, the pool must outlive its handles.
+     */
+    class SearchContextPool {
+    public:
+        struct Releaser {
+            SearchContextPool *pool{nullptr};
+
+            void operator()(SearchContext *context) const {
+                pool->release(context);
+            }
+        };
+
+        using Handle = std::unique_ptr<SearchContext, Releaser>;
+
+        // max_idle bounds the contexts kept for reuse, 0 keeps them all
+        explicit SearchContextPool(const UnifiedIndex *index, size_t max_idle = 0)
+                : index_(index), max_idle_(max_idle) {}
+
+        SearchContextPool(const SearchContextPool &) = delete;
+
+        SearchContextPool &operator=(const SearchContextPool &) = delete;
+
+        Handle acquire() {
+            SearchContext *context = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!idle_.empty()) {
+                    context = idle_.back().release();
+                    idle_.pop_back();
+                }
+            }
+            if (context == nullptr) {
+                context = new SearchContext(index_->create_search_context());
+                context->scratch = std::make_unique<SearchScratch>();
+            } else {
+                context->start_time = turbo::Time::current_time();
+            }
+            return Handle(context, Releaser{this});
+        }
+
+        // contexts waiting for reuse
+        size_t idle() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return idle_.size();
+        }
+
+    private:
+        void release(SearchContext *context) {
+            std::unique_ptr<SearchContext> owned(context);
+            owned->reset();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (max_idle_ == 0 || idle_.size() < max_idle_) {
+                idle_.push_back(std::move(owned));
+            }
+        }
+
+        const UnifiedIndex *index_;
+        size_t max_idle_;
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<SearchContext>> idle_;
+    };
+
+}  // namespace phekda
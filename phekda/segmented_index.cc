@@ -0,0 +1,721 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+#include <phekda/segmented_index.h>
+#include <phekda/core/search_merge.h>
+#include <phekda/hnswlib/hnswlib.h>
+#include <fstream>
+
+namespace phekda {
+
+    namespace {
+        // "PHKSEGMT"
+        constexpr uint64_t kSegmentedMagic = 0x5048'4b53'4547'4d54ULL;
+
+        // a candidate counts in a segment if the segment holds the live copy
+        class SegmentCondition : public SearchCondition {
+        public:
+            SegmentCondition(const LabelMap &labels, const std::vector<LocationType> &ids,
+                             const SearchCondition *user)
+                    : labels_(labels), ids_(ids), user_(user) {}
+
+            bool is_exclude(LabelType label) const override {
+                LocationType owner;
+                if (!labels_.find(label, owner) || !std::binary_search(ids_.begin(), ids_.end(), owner)) {
+                    return true;
+                }
+                return user_ != nullptr && user_->is_exclude(label);
+            }
+
+            bool is_whitelist(LabelType label) const override {
+                return user_ != nullptr && user_->is_whitelist(label);
+            }
+
+            bool should_explain() const override {
+                return user_ != nullptr && user_->should_explain();
+            }
+
+        private:
+            const LabelMap &labels_;
+            const std::vector<LocationType> &ids_;
+            const SearchCondition *user_;
+        };
+
+        void write_u64(std::ofstream &output, uint64_t value) {
+            output.write(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        uint64_t read_u64(std::ifstream &input) {
+            uint64_t value = 0;
+            input.read(reinterpret_cast<char *>(&value), sizeof(value));
+            return value;
+        }
+    }  // namespace
+
+    SegmentedIndex::~SegmentedIndex() {
+        {
+            std::lock_guard<std::mutex> lock(seal_mutex_);
+            stopping_ = true;
+        }
+        seal_cv_.notify_all();
+        if (sealer_.joinable()) {
+            sealer_.join();
+        }
+    }
+
+    turbo::Status SegmentedIndex::setup(const IndexConfig &config) {
+        try {
+            segmented_ = std::any_cast<SegmentedConfig>(config.index_conf);
+        } catch (const std::bad_any_cast &e) {
+            return turbo::invalid_argument_error("index_conf is not SegmentedConfig");
+        }
+        if (config.core.dimension == 0) {
+            return turbo::invalid_argument_error("dimension should not be 0");
+        }
+        if (segmented_.head_capacity == 0) {
+            return turbo::invalid_argument_error("head_capacity should not be 0");
+        }
+        if (segmented_.segment_type != IndexType::INDEX_HNSWLIB &&
+            segmented_.segment_type != IndexType::INDEX_HNSW_FLAT) {
+            return turbo::invalid_argument_error("unsupported segment index type");
+        }
+        config_ = config;
+        auto rs = pool_.start(segmented_.threads);
+        if (!rs.ok()) {
+            return rs;
+        }
+        return build_pool_.start(segmented_.threads);
+    }
+
+    void SegmentedIndex::stop_pools() {
+        pool_.stop();
+        build_pool_.stop();
+    }
+
+    void SegmentedIndex::start(IndexInitializationType type) {
+        if (segmented_.background) {
+            sealer_ = std::thread([this] { seal_loop(); });
+        }
+        init_type_ = type;
+    }
+
+    turbo::Result<std::shared_ptr<UnifiedIndex>>
+    SegmentedIndex::create_segment_index(IndexType type, size_t capacity) const {
+        std::shared_ptr<UnifiedIndex> index(UnifiedIndex::create_index(type));
+        if (!index) {
+            return turbo::invalid_argument_error("unsupported segment index type");
+        }
+        IndexConfig conf;
+        conf.core = config_.core;
+        conf.core.index_type = type;
+        conf.core.max_elements = static_cast<uint32_t>(std::max<size_t>(capacity, 1));
+        conf.core.auto_grow = false;
+        conf.index_conf = segmented_.segment_conf;
+        auto rs = index->initialize(conf);
+        if (!rs.ok()) {
+            return rs;
+        }
+        return index;
+    }
+
+    turbo::Result<SegmentedIndex::SegmentPtr> SegmentedIndex::make_head() {
+        auto rs = create_segment_index(IndexType::INDEX_HNSW_FLAT, segmented_.head_capacity);
+        if (!rs.ok()) {
+            return rs.status();
+        }
+        auto head = std::make_shared<Segment>();
+        head->ids.push_back(next_id_++);
+        head->index = std::move(rs).value();
+        head->labels.reserve(segmented_.head_capacity);
+        return head;
+    }
+
+    turbo::Status SegmentedIndex::initialize(const IndexConfig &config) {
+        if (init_type_ != IndexInitializationType::INIT_NONE) {
+            return turbo::OkStatus();
+        }
+        turbo::MutexLock lock(&init_mutex_);
+        if (init_type_ != IndexInitializationType::INIT_NONE) {
+            return turbo::OkStatus();
+        }
+        auto rs = setup(config);
+        if (!rs.ok()) {
+            stop_pools();
+            return rs;
+        }
+        auto head = make_head();
+        if (!head.ok()) {
+            stop_pools();
+            return head.status();
+        }
+        head_ = std::move(head).value();
+        start(IndexInitializationType::INIT_INIT);
+        return turbo::OkStatus();
+    }
+
+    std::vector<SegmentedIndex::SegmentPtr> SegmentedIndex::snapshot() const {
+        std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+        std::vector<SegmentPtr> parts(segments_);
+        parts.push_back(head_);
+        return parts;
+    }
+
+    size_t SegmentedIndex::num_segments() const {
+        std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+        return segments_.size();
+    }
+
+    SegmentedIndex::SegmentPtr SegmentedIndex::owner_of(LabelType label) const {
+        LocationType owner;
+        if (!labels_.find(label, owner)) {
+            return nullptr;
+        }
+        for (auto &part: snapshot()) {
+            if (part->covers(owner)) {
+                return part;
+            }
+        }
+        return nullptr;
+    }
+
+    turbo::Status SegmentedIndex::for_each(NumaWorkerPool &pool, size_t n,
+                                           const std::function<turbo::Status(size_t)> &fn) {
+        std::vector<turbo::Status> status(n);
+        std::vector<std::future<void>> futures;
+        for (size_t i = 1; i < n; ++i) {
+            futures.push_back(pool.submit([&fn, &status, i] { status[i] = fn(i); }));
+        }
+        if (n > 0) {
+            status[0] = fn(0);
+        }
+        for (auto &future: futures) {
+            future.wait();
+        }
+        for (auto &rs: status) {
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SegmentedIndex::rotate_head() {
+        auto head = make_head();
+        if (!head.ok()) {
+            return head.status();
+        }
+        {
+            std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+            segments_.push_back(head_);
+            head_ = std::move(head).value();
+        }
+        if (!segmented_.background) {
+            return maintain();
+        }
+        {
+            std::lock_guard<std::mutex> lock(seal_mutex_);
+            ++seal_pending_;
+        }
+        seal_cv_.notify_all();
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SegmentedIndex::add_to_head(const uint8_t *data, const LabelType *labels, uint32_t num,
+                                              const std::any &write_conf) {
+        size_t size = config_.core.dimension * data_type_size(config_.core.data);
+        uint32_t done = 0;
+        while (done < num) {
+            if (head_->labels.size() >= segmented_.head_capacity) {
+                auto rs = rotate_head();
+                if (!rs.ok()) {
+                    return rs;
+                }
+            }
+            auto room = static_cast<uint32_t>(segmented_.head_capacity - head_->labels.size());
+            uint32_t n = std::min(room, num - done);
+            auto rs = head_->index->add_vectors(data + done * size, labels + done, n, write_conf);
+            if (!rs.ok()) {
+                return rs;
+            }
+            auto id = head_->ids[0];
+            for (uint32_t i = done; i < done + n; ++i) {
+                head_->labels.push_back(labels[i]);
+                labels_.insert_or_assign(labels[i], id);
+            }
+            done += n;
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SegmentedIndex::add_vector(turbo::Nonnull<const uint8_t *> data, LabelType label, std::any write_conf) {
+        return add_vectors(data, &label, 1, std::move(write_conf));
+    }
+
+    turbo::Status SegmentedIndex::add_vectors(turbo::Nonnull<const uint8_t *> data,
+                                              turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                                              std::any write_conf) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.insert);
+        std::lock_guard<std::mutex> lock(write_mutex_);
+        auto rs = add_to_head(data, labels, num, write_conf);
+        if (!rs.ok()) {
+            metrics_.insert_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
+    }
+
+    turbo::Status SegmentedIndex::rebuild(const std::vector<SegmentPtr> &from) {
+        // the live labels of every segment, read from the index holding them
+        size_t size = config_.core.dimension * data_type_size(config_.core.data);
+        std::vector<LabelType> live;
+        std::vector<uint8_t> data;
+        for (auto &part: from) {
+            auto labels = part->labels;
+            std::sort(labels.begin(), labels.end());
+            labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+            labels.erase(std::remove_if(labels.begin(), labels.end(), [&](LabelType label) {
+                LocationType owner;
+                return !labels_.find(label, owner) || !part->covers(owner);
+            }), labels.end());
+            if (labels.empty()) {
+                continue;
+            }
+            std::vector<uint8_t> rows(labels.size() * size);
+            std::unique_ptr<bool[]> found(new bool[labels.size()]);
+            auto rs = part->index->get_vectors(labels.data(), static_cast<uint32_t>(labels.size()), rows.data(),
+                                               found.get());
+            if (!rs.ok()) {
+                return rs;
+            }
+            for (size_t i = 0; i < labels.size(); ++i) {
+                if (found[i]) {
+                    live.push_back(labels[i]);
+                    data.insert(data.end(), rows.begin() + i * size, rows.begin() + (i + 1) * size);
+                }
+            }
+        }
+        auto sealed = std::make_shared<Segment>();
+        for (auto &part: from) {
+            sealed->ids.insert(sealed->ids.end(), part->ids.begin(), part->ids.end());
+        }
+        std::sort(sealed->ids.begin(), sealed->ids.end());
+        sealed->sealed = true;
+        if (!live.empty()) {
+            auto rs = create_segment_index(segmented_.segment_type, live.size());
+            if (!rs.ok()) {
+                return rs.status();
+            }
+            sealed->index = std::move(rs).value();
+            // the graph built by the build workers, in contiguous chunks
+            size_t chunks = std::min(build_pool_.num_threads() + 1, live.size());
+            size_t chunk = (live.size() + chunks - 1) / chunks;
+            auto status = for_each(build_pool_, chunks, [&](size_t c) {
+                size_t begin = c * chunk;
+                size_t end = std::min(begin + chunk, live.size());
+                if (begin >= end) {
+                    return turbo::OkStatus();
+                }
+                return sealed->index->add_vectors(data.data() + begin * size, live.data() + begin,
+                                                  static_cast<uint32_t>(end - begin), {});
+            });
+            if (!status.ok()) {
+                return status;
+            }
+            sealed->labels = std::move(live);
+        }
+        // swapped in at the place of the oldest, dropped if nothing is live
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        auto first = std::find(segments_.begin(), segments_.end(), from.front());
+        if (first == segments_.end()) {
+            return turbo::internal_error("segment to rebuild not found");
+        }
+        if (sealed->index) {
+            *first = sealed;
+        } else {
+            first = segments_.erase(first);
+        }
+        for (size_t i = 1; i < from.size(); ++i) {
+            auto it = std::find(segments_.begin(), segments_.end(), from[i]);
+            if (it != segments_.end()) {
+                segments_.erase(it);
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SegmentedIndex::maintain() {
+        std::lock_guard<std::mutex> lock(maintain_mutex_);
+        while (true) {
+            SegmentPtr frozen;
+            {
+                std::shared_lock<std::shared_mutex> segments_lock(segments_mutex_);
+                for (auto &part: segments_) {
+                    if (!part->sealed) {
+                        frozen = part;
+                        break;
+                    }
+                }
+            }
+            if (!frozen) {
+                break;
+            }
+            auto rs = rebuild({frozen});
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        if (segmented_.max_segments == 0) {
+            return turbo::OkStatus();
+        }
+        std::vector<SegmentPtr> sealed;
+        {
+            std::shared_lock<std::shared_mutex> segments_lock(segments_mutex_);
+            for (auto &part: segments_) {
+                if (part->sealed) {
+                    sealed.push_back(part);
+                }
+            }
+        }
+        if (sealed.size() <= segmented_.max_segments) {
+            return turbo::OkStatus();
+        }
+        return rebuild(sealed);
+    }
+
+    void SegmentedIndex::seal_loop() {
+        while (true) {
+            size_t pending;
+            {
+                std::unique_lock<std::mutex> lock(seal_mutex_);
+                seal_cv_.wait(lock, [this] { return stopping_ || seal_pending_ > 0; });
+                if (stopping_) {
+                    return;
+                }
+                pending = seal_pending_;
+            }
+            // seals all the frozen heads, the ones counted meanwhile included
+            auto rs = maintain();
+            {
+                std::lock_guard<std::mutex> lock(seal_mutex_);
+                seal_pending_ -= pending;
+                if (!rs.ok()) {
+                    seal_status_ = rs;
+                }
+            }
+            seal_cv_.notify_all();
+        }
+    }
+
+    turbo::Status SegmentedIndex::wait_sealed() {
+        std::unique_lock<std::mutex> lock(seal_mutex_);
+        seal_cv_.wait(lock, [this] { return stopping_ || seal_pending_ == 0; });
+        return seal_status_;
+    }
+
+    turbo::Status SegmentedIndex::get_vector(LabelType label, turbo::Nonnull<uint8_t *> data) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        auto part = owner_of(label);
+        if (!part) {
+            return turbo::not_found_error("label not found");
+        }
+        return part->index->get_vector(label, data);
+    }
+
+    turbo::Status SegmentedIndex::get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                                              turbo::Nonnull<uint8_t *> data) {
+        std::unique_ptr<bool[]> found(new bool[num]);
+        auto rs = UnifiedIndex::get_vectors(labels, num, data, found.get());
+        if (!rs.ok()) {
+            return rs;
+        }
+        if (!std::all_of(found.get(), found.get() + num, [](bool f) { return f; })) {
+            return turbo::not_found_error("Label not found");
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SegmentedIndex::search(SearchContext &context) {
+        context.schedule_time = turbo::Time::current_time();
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        auto parts = snapshot();
+        std::vector<SearchContext> subs;
+        std::vector<SegmentCondition> conditions;
+        subs.reserve(parts.size());
+        conditions.reserve(parts.size());
+        for (auto &part: parts) {
+            subs.push_back(part->index->create_search_context());
+            auto rs = prepare_part_search(context, subs.back());
+            if (!rs.ok()) {
+                return rs;
+            }
+            conditions.emplace_back(labels_, part->ids, context.condition);
+            subs.back().with_condition(&conditions.back());
+        }
+        auto rs = for_each(pool_, parts.size(), [&](size_t i) { return parts[i]->index->search(subs[i]); });
+        if (rs.ok()) {
+            merge_part_results(subs, context);
+        }
+        context.trace.reset();
+        context.end_time = turbo::Time::current_time();
+        if (context.start_time != turbo::Time()) {
+            metrics_.queue_wait.record(context.schedule_time - context.start_time);
+        }
+        metrics_.search.record(context.end_time - context.schedule_time);
+        if (!rs.ok()) {
+            metrics_.search_errors.fetch_add(1, std::memory_order_relaxed);
+        } else if (context.partial) {
+            metrics_.partial_searches.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
+    }
+
+    turbo::Status SegmentedIndex::lazy_delete(LabelType label) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.remove);
+        // the copy stays in its segment until the segment is rebuilt
+        if (!labels_.erase(label)) {
+            return turbo::not_found_error("label not found");
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<ConsolidationReport> SegmentedIndex::consolidate(const std::any &conf) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        auto begin = turbo::Time::current_time();
+        ConsolidationReport report;
+        auto before = metrics();
+        if (before.ok()) {
+            report.delete_set_size = before.value().deleted;
+        }
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            if (!head_->labels.empty()) {
+                auto rs = rotate_head();
+                if (!rs.ok()) {
+                    return rs;
+                }
+            }
+        }
+        auto rs = wait_sealed();
+        if (!rs.ok()) {
+            return rs;
+        }
+        {
+            std::lock_guard<std::mutex> lock(maintain_mutex_);
+            auto parts = snapshot();
+            parts.pop_back();
+            if (!parts.empty()) {
+                rs = rebuild(parts);
+                if (!rs.ok()) {
+                    return rs;
+                }
+            }
+        }
+        auto after = metrics();
+        if (after.ok()) {
+            report.active_points = after.value().elements;
+            report.max_points = after.value().elements + after.value().deleted;
+            report.slots_released = report.delete_set_size - std::min(report.delete_set_size, after.value().deleted);
+        }
+        report.time = (turbo::Time::current_time() - begin).to_seconds();
+        return report;
+    }
+
+    turbo::Status SegmentedIndex::save(LabelType snapshot_id, const std::string &path, const std::any &save_conf) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.save);
+        std::vector<SegmentPtr> parts;
+        std::vector<std::vector<LabelType>> lives;
+        LocationType next_id;
+        turbo::Status rs;
+        {
+            // the head is the only part that changes, its snapshot is taken
+            // with the label lists under the write lock, and written once the
+            // writers are let go. the frozen heads and the sealed segments
+            // are immutable, a rebuild swapping them out meanwhile leaves the
+            // ones held here as they are
+            std::unique_lock<std::mutex> write_lock(write_mutex_);
+            parts = snapshot();
+            for (auto &part: parts) {
+                // only the live labels, the map is rebuilt from them
+                std::vector<LabelType> live;
+                for (auto label: part->labels) {
+                    LocationType owner;
+                    if (labels_.find(label, owner) && part->covers(owner)) {
+                        live.push_back(label);
+                    }
+                }
+                std::sort(live.begin(), live.end());
+                live.erase(std::unique(live.begin(), live.end()), live.end());
+                lives.push_back(std::move(live));
+            }
+            next_id = next_id_;
+            HnswlibSaveConfig head_conf;
+            head_conf.on_snapshot = [&write_lock] { write_lock.unlock(); };
+            rs = parts.back()->index->save(snapshot_id, segment_path(path, parts.size() - 1), head_conf);
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        rs = for_each(pool_, parts.size() - 1, [&](size_t i) {
+            return parts[i]->index->save(snapshot_id, segment_path(path, i), save_conf);
+        });
+        if (!rs.ok()) {
+            return rs;
+        }
+        // written last, a crash before leaves no loadable index at path
+        std::ofstream output(path, std::ios::binary);
+        write_u64(output, kSegmentedMagic);
+        write_u64(output, snapshot_id);
+        write_u64(output, next_id);
+        write_u64(output, parts.size());
+        for (size_t i = 0; i < parts.size(); ++i) {
+            auto &part = parts[i];
+            write_u64(output, part->sealed);
+            write_u64(output, part->index->get_core_config().max_elements);
+            write_u64(output, part->ids.size());
+            for (auto id: part->ids) {
+                write_u64(output, id);
+            }
+            write_u64(output, lives[i].size());
+            output.write(reinterpret_cast<const char *>(lives[i].data()), lives[i].size() * sizeof(LabelType));
+        }
+        if (!output) {
+            return turbo::internal_error("can not write " + path);
+        }
+        snapshot_id_ = snapshot_id;
+        return turbo::OkStatus();
+    }
+
+    turbo::Status SegmentedIndex::load(const std::string &path, const IndexConfig &config) {
+        turbo::MutexLock lock(&init_mutex_);
+        ScopedLatency latency(metrics_.load);
+        if (init_type_ != IndexInitializationType::INIT_NONE) {
+            return turbo::already_exists_error("index already initialized, can not load");
+        }
+        std::ifstream input(path, std::ios::binary);
+        if (read_u64(input) != kSegmentedMagic || !input) {
+            return turbo::data_loss_error("not a segmented index: " + path);
+        }
+        auto rs = setup(config);
+        if (!rs.ok()) {
+            stop_pools();
+            return rs;
+        }
+        auto snapshot_id = read_u64(input);
+        auto next_id = static_cast<LocationType>(read_u64(input));
+        auto num_parts = read_u64(input);
+        std::vector<SegmentPtr> parts;
+        std::vector<size_t> capacities;
+        for (uint64_t i = 0; i < num_parts && input; ++i) {
+            auto part = std::make_shared<Segment>();
+            part->sealed = read_u64(input) != 0;
+            capacities.push_back(read_u64(input));
+            part->ids.resize(read_u64(input));
+            for (auto &id: part->ids) {
+                id = static_cast<LocationType>(read_u64(input));
+            }
+            part->labels.resize(read_u64(input));
+            input.read(reinterpret_cast<char *>(part->labels.data()), part->labels.size() * sizeof(LabelType));
+            parts.push_back(std::move(part));
+        }
+        if (!input || parts.empty()) {
+            stop_pools();
+            return turbo::data_loss_error("truncated segmented index: " + path);
+        }
+        rs = for_each(pool_, parts.size(), [&](size_t i) {
+            auto type = parts[i]->sealed ? segmented_.segment_type : IndexType::INDEX_HNSW_FLAT;
+            parts[i]->index.reset(UnifiedIndex::create_index(type));
+            IndexConfig conf;
+            conf.core = config_.core;
+            conf.core.index_type = type;
+            conf.core.max_elements = static_cast<uint32_t>(capacities[i]);
+            conf.core.auto_grow = false;
+            conf.index_conf = segmented_.segment_conf;
+            return parts[i]->index->load(segment_path(path, i), conf);
+        });
+        if (!rs.ok()) {
+            stop_pools();
+            return rs;
+        }
+        size_t frozen = 0;
+        for (auto &part: parts) {
+            for (auto label: part->labels) {
+                labels_.insert_or_assign(label, part->ids[0]);
+            }
+            if (part != parts.back() && !part->sealed) {
+                ++frozen;
+            }
+        }
+        head_ = parts.back();
+        parts.pop_back();
+        segments_ = std::move(parts);
+        next_id_ = next_id;
+        snapshot_id_ = snapshot_id;
+        if (segmented_.background) {
+            seal_pending_ = frozen;
+        }
+        start(IndexInitializationType::INIT_LOAD);
+        if (frozen > 0) {
+            if (segmented_.background) {
+                seal_cv_.notify_all();
+            } else {
+                return maintain();
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Result<MetricsSnapshot> SegmentedIndex::metrics() const {
+        auto snap = metrics_.snapshot();
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return snap;
+        }
+        size_t held = 0;
+        for (auto &part: snapshot()) {
+            auto rs = part->index->metrics();
+            if (!rs.ok()) {
+                continue;
+            }
+            held += rs.value().elements;
+            snap.memory_bytes += rs.value().memory_bytes;
+            snap.huge_page_bytes += rs.value().huge_page_bytes;
+        }
+        snap.elements = labels_.size();
+        snap.deleted = held - std::min(held, snap.elements);
+        if (snap.elements > 0) {
+            snap.deleted_ratio = static_cast<double>(snap.deleted) / static_cast<double>(snap.elements);
+        }
+        return snap;
+    }
+
+}  // namespace phekda
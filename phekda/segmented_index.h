@@ -0,0 +1,244 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+
+#pragma once
+
+#include <phekda/unified.h>
+#include <phekda/core/label_map.h>
+#include <phekda/core/numa_worker_pool.h>
+#include <turbo/synchronization/mutex.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+namespace phekda {
+
+    // index_conf of a SegmentedIndex
+    struct SegmentedConfig {
+        // vectors of the mutable head, a flat index, sealed once full
+        size_t head_capacity{10000};
+        // type and index_conf of the sealed segments, the index_conf is
+        // used for the head too
+        IndexType segment_type{IndexType::INDEX_HNSWLIB};
+        std::any segment_conf;
+        // the sealed segments are merged into one when there are more,
+        // 0 never merges
+        size_t max_segments{8};
+        // seal and merge in a background thread, false does it on the
+        // writer filling the head
+        bool background{true};
+        // threads per numa node of the search fan out pool, and apart
+        // of the segment build pool, 0 is one per cpu
+        size_t threads{0};
+    };
+
+    /**
+     * @class SegmentedIndex
+     * @brief log structured index. writes go to a small flat head, a full
+     *        head is frozen and rebuilt as a sealed segment of segment_type
+     *        off the write path, and too many sealed segments are merged
+     *        into one. a search runs on the head and the segments in
+     *        parallel and merges their top k.
+     *
+     * The label map is global, it tells the segment holding the live copy
+     * of a label. a delete drops the label from the map, an update adds the
+     * label to the head and points the map to it, the stale copies left in
+     * sealed segments are skipped by the searches and dropped by merges.
+     */
+    class SegmentedIndex : public UnifiedIndex {
+    public:
+        SegmentedIndex() = default;
+
+        ~SegmentedIndex() override;
+
+        turbo::Status initialize(const IndexConfig &config) override;
+
+        turbo::Status add_vector(turbo::Nonnull<const uint8_t *> data, LabelType label, std::any write_conf) override;
+
+        turbo::Status
+        add_vectors(turbo::Nonnull<const uint8_t *> data, turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                    std::any write_conf) override;
+
+        turbo::Status get_vector(LabelType label, turbo::Nonnull<uint8_t *> data) override;
+
+        turbo::Status
+        get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data) override;
+
+        turbo::Status search(SearchContext &context) override;
+
+        turbo::Status lazy_delete(LabelType label) override;
+
+        // seal the head and merge all the sealed segments, the stale
+        // copies are dropped, waits for the pending seals first
+        turbo::Result<ConsolidationReport> consolidate(const std::any &conf) override;
+
+        LabelType snapshot_id() const override {
+            return snapshot_id_;
+        }
+
+        // one file per segment, path.segment.<i>, next to the segment list
+        // at path. writers wait only until the snapshot of the head is
+        // taken, frozen heads are saved flat and sealed after the load
+        turbo::Status save(LabelType snapshot_id, const std::string &path, const std::any &save_conf) override;
+
+        turbo::Status load(const std::string &path, const IndexConfig &config) override;
+
+        bool support_dynamic() const override {
+            return true;
+        }
+
+        bool need_train() const override {
+            return false;
+        }
+
+        turbo::Status train(std::any conf) override {
+            return turbo::OkStatus();
+        }
+
+        bool is_trained() const override {
+            return true;
+        }
+
+        bool support_build(std::any conf) const override {
+            return false;
+        }
+
+        turbo::Status build(std::any conf) const override {
+            return turbo::unavailable_error("build not supported");
+        }
+
+        CoreConfig get_core_config() const override {
+            return config_.core;
+        }
+
+        IndexConfig get_index_config() const override {
+            return config_;
+        }
+
+        IndexInitializationType get_initialization_type() const override {
+            return init_type_;
+        }
+
+        // elements are the live labels, deleted the stale copies still held
+        // by the segments
+        turbo::Result<MetricsSnapshot> metrics() const override;
+
+        // block until the frozen heads are sealed and the merges done, the
+        // last error of the background sealer if any
+        turbo::Status wait_sealed();
+
+        // sealed segments, the frozen heads waiting to be sealed included
+        size_t num_segments() const;
+
+        static std::string segment_path(const std::string &path, size_t segment) {
+            return path + ".segment." + std::to_string(segment);
+        }
+
+    private:
+        // check and keep the config, start the fan out and build threads
+        turbo::Status setup(const IndexConfig &config);
+
+        void stop_pools();
+
+        // start the background sealer if asked for, the index is ready
+        void start(IndexInitializationType type);
+
+        struct Segment {
+            // ids of the heads the segment was built from, sorted. the label
+            // map points to one of them for the labels it holds the live copy of
+            std::vector<LocationType> ids;
+            std::shared_ptr<UnifiedIndex> index;
+            // labels added, including the stale ones
+            std::vector<LabelType> labels;
+            bool sealed{false};
+
+            bool covers(LocationType id) const {
+                return std::binary_search(ids.begin(), ids.end(), id);
+            }
+        };
+
+        using SegmentPtr = std::shared_ptr<Segment>;
+
+        turbo::Result<std::shared_ptr<UnifiedIndex>> create_segment_index(IndexType type, size_t capacity) const;
+
+        // a new empty head, not installed
+        turbo::Result<SegmentPtr> make_head();
+
+        // freeze the full head and hand it to the sealer, write_mutex_ held
+        turbo::Status rotate_head();
+
+        // the live vectors of from rebuilt as one sealed segment in their place
+        turbo::Status rebuild(const std::vector<SegmentPtr> &from);
+
+        // seal the frozen heads, then merge if there are too many segments
+        turbo::Status maintain();
+
+        void seal_loop();
+
+        // the sealed segments and the frozen heads, then the head
+        std::vector<SegmentPtr> snapshot() const;
+
+        turbo::Status add_to_head(const uint8_t *data, const LabelType *labels, uint32_t num,
+                                  const std::any &write_conf);
+
+        // the segment holding the live copy of label, nullptr if none
+        SegmentPtr owner_of(LabelType label) const;
+
+        // fn(0) on the caller, the rest on pool
+        static turbo::Status for_each(NumaWorkerPool &pool, size_t n, const std::function<turbo::Status(size_t)> &fn);
+
+        turbo::Mutex init_mutex_;
+        IndexInitializationType init_type_{IndexInitializationType::INIT_NONE};
+        IndexConfig config_;
+        SegmentedConfig segmented_;
+        LabelType snapshot_id_{0};
+        // label -> id of the head it was last added to
+        LabelMap labels_;
+        // serializes the writers of the head
+        std::mutex write_mutex_;
+        // guards head_ and segments_, searches copy them under a shared lock
+        mutable std::shared_mutex segments_mutex_;
+        SegmentPtr head_;
+        // oldest first
+        std::vector<SegmentPtr> segments_;
+        LocationType next_id_{0};
+        // one seal or merge at a time
+        std::mutex maintain_mutex_;
+        std::mutex seal_mutex_;
+        std::condition_variable seal_cv_;
+        size_t seal_pending_{0};
+        turbo::Status seal_status_;
+        bool stopping_{false};
+        std::thread sealer_;
+        // search and save fan out
+        mutable NumaWorkerPool pool_;
+        // seal and merge builds, long tasks kept out of the queues of the searches
+        NumaWorkerPool build_pool_;
+        IndexMetrics metrics_;
+    };
+
+}  // namespace phekda
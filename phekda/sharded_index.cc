@@ -0,0 +1,359 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-29.
+//
+#include <phekda/sharded_index.h>
+#include <phekda/core/search_merge.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace phekda {
+
+    namespace {
+        // "PHKSHARD"
+        constexpr uint64_t kShardedMagic = 0x5048'4b53'4841'5244ULL;
+
+        // splitmix64 finalizer, independent of the murmur hash LabelMap uses
+        // inside the shards, so a shard's labels still spread over its map
+        uint64_t route_hash(LabelType label) {
+            uint64_t h = label + 0x9e3779b97f4a7c15ULL;
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+            return h ^ (h >> 31);
+        }
+
+    }  // namespace
+
+    size_t ShardedIndex::shard_of(LabelType label) const {
+        return static_cast<size_t>(route_hash(label) % shards_.size());
+    }
+
+    turbo::Status ShardedIndex::create_shards(const IndexConfig &config, ShardedConfig &sharded) {
+        try {
+            sharded = std::any_cast<ShardedConfig>(config.index_conf);
+        } catch (const std::bad_any_cast &e) {
+            return turbo::invalid_argument_error("index_conf is not ShardedConfig");
+        }
+        if (sharded.num_shards == 0) {
+            return turbo::invalid_argument_error("num_shards should not be 0");
+        }
+        if (sharded.shard_type == IndexType::INDEX_SHARDED) {
+            return turbo::invalid_argument_error("shards can not be sharded");
+        }
+        for (size_t i = 0; i < sharded.num_shards; ++i) {
+            std::unique_ptr<UnifiedIndex> shard(UnifiedIndex::create_index(sharded.shard_type));
+            if (!shard) {
+                return turbo::invalid_argument_error("unsupported shard index type");
+            }
+            shards_.push_back(std::move(shard));
+        }
+        // shard 0 runs on the calling thread, the others on the pool. it
+        // serves every caller at once, so by default it has a worker per cpu
+        // rather than per shard
+        if (sharded.num_shards > 1) {
+            auto nodes = static_cast<size_t>(numa_num_nodes());
+            auto rs = pool_.start((sharded.threads + nodes - 1) / nodes);
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ShardedIndex::for_each_shard(const std::function<turbo::Status(size_t)> &fn) const {
+        if (shards_.empty()) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        std::vector<turbo::Status> status(shards_.size());
+        std::vector<std::future<void>> futures;
+        for (size_t i = 1; i < shards_.size(); ++i) {
+            if (pool_.num_threads() == 0) {
+                status[i] = fn(i);
+            } else {
+                futures.push_back(pool_.submit([&fn, &status, i] { status[i] = fn(i); }));
+            }
+        }
+        status[0] = fn(0);
+        for (auto &future: futures) {
+            future.wait();
+        }
+        for (auto &rs: status) {
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ShardedIndex::initialize(const IndexConfig &config) {
+        if (init_type_ != IndexInitializationType::INIT_NONE) {
+            return turbo::OkStatus();
+        }
+        turbo::MutexLock lock(&init_mutex_);
+        if (init_type_ != IndexInitializationType::INIT_NONE) {
+            return turbo::OkStatus();
+        }
+        ShardedConfig sharded;
+        auto rs = create_shards(config, sharded);
+        if (!rs.ok()) {
+            shards_.clear();
+            return rs;
+        }
+        IndexConfig shard_config;
+        shard_config.core = config.core;
+        shard_config.core.index_type = sharded.shard_type;
+        shard_config.index_conf = sharded.shard_conf;
+        rs = for_each_shard([&](size_t i) { return shards_[i]->initialize(shard_config); });
+        if (!rs.ok()) {
+            pool_.stop();
+            shards_.clear();
+            return rs;
+        }
+        config_ = config;
+        init_type_ = IndexInitializationType::INIT_INIT;
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ShardedIndex::add_vector(turbo::Nonnull<const uint8_t *> data, LabelType label, std::any write_conf) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.insert);
+        auto rs = shards_[shard_of(label)]->add_vector(data, label, std::move(write_conf));
+        if (!rs.ok()) {
+            metrics_.insert_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
+    }
+
+    turbo::Status ShardedIndex::add_vectors(turbo::Nonnull<const uint8_t *> data,
+                                            turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                                            std::any write_conf) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.insert);
+        std::vector<std::vector<uint32_t>> rows(shards_.size());
+        for (uint32_t i = 0; i < num; ++i) {
+            rows[shard_of(labels[i])].push_back(i);
+        }
+        size_t size = config_.core.dimension * data_type_size(config_.core.data);
+        auto rs = for_each_shard([&](size_t s) {
+            auto &part = rows[s];
+            if (part.empty()) {
+                return turbo::OkStatus();
+            }
+            // the rows of the shard gathered contiguous
+            std::vector<uint8_t> part_data(part.size() * size);
+            std::vector<LabelType> part_labels(part.size());
+            for (size_t i = 0; i < part.size(); ++i) {
+                std::memcpy(part_data.data() + i * size, data + part[i] * size, size);
+                part_labels[i] = labels[part[i]];
+            }
+            return shards_[s]->add_vectors(part_data.data(), part_labels.data(),
+                                           static_cast<uint32_t>(part.size()), write_conf);
+        });
+        if (!rs.ok()) {
+            metrics_.insert_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
+    }
+
+    turbo::Status ShardedIndex::get_vector(LabelType label, turbo::Nonnull<uint8_t *> data) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        return shards_[shard_of(label)]->get_vector(label, data);
+    }
+
+    turbo::Status ShardedIndex::get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                                            turbo::Nonnull<uint8_t *> data) {
+        std::unique_ptr<bool[]> found(new bool[num]);
+        auto rs = UnifiedIndex::get_vectors(labels, num, data, found.get());
+        if (!rs.ok()) {
+            return rs;
+        }
+        if (!std::all_of(found.get(), found.get() + num, [](bool f) { return f; })) {
+            return turbo::not_found_error("Label not found");
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ShardedIndex::search(SearchContext &context) {
+        context.schedule_time = turbo::Time::current_time();
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        // one context per shard borrowing the query
+        std::vector<SearchContext> subs;
+        subs.reserve(shards_.size());
+        for (auto &shard: shards_) {
+            subs.push_back(shard->create_search_context());
+            auto rs = prepare_part_search(context, subs.back());
+            if (!rs.ok()) {
+                return rs;
+            }
+        }
+        auto rs = for_each_shard([this, &subs](size_t i) { return shards_[i]->search(subs[i]); });
+        if (rs.ok()) {
+            merge_part_results(subs, context);
+        }
+        context.trace.reset();
+        context.end_time = turbo::Time::current_time();
+        if (context.start_time != turbo::Time()) {
+            metrics_.queue_wait.record(context.schedule_time - context.start_time);
+        }
+        metrics_.search.record(context.end_time - context.schedule_time);
+        if (!rs.ok()) {
+            metrics_.search_errors.fetch_add(1, std::memory_order_relaxed);
+        } else if (context.partial) {
+            metrics_.partial_searches.fetch_add(1, std::memory_order_relaxed);
+        }
+        return rs;
+    }
+
+    turbo::Status ShardedIndex::lazy_delete(LabelType label) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.remove);
+        return shards_[shard_of(label)]->lazy_delete(label);
+    }
+
+    turbo::Result<ConsolidationReport> ShardedIndex::consolidate(const std::any &conf) {
+        ConsolidationReport total;
+        for (auto &shard: shards_) {
+            auto rs = shard->consolidate(conf);
+            if (!rs.ok()) {
+                return rs.status();
+            }
+            auto &report = rs.value();
+            if (report.status != ConsolidationReport::SUCCESS) {
+                total.status = report.status;
+            }
+            total.active_points += report.active_points;
+            total.max_points += report.max_points;
+            total.empty_slots += report.empty_slots;
+            total.slots_released += report.slots_released;
+            total.delete_set_size += report.delete_set_size;
+            total.num_calls_to_process_delete += report.num_calls_to_process_delete;
+            total.time += report.time;
+        }
+        return total;
+    }
+
+    LabelType ShardedIndex::snapshot_id() const {
+        LabelType id = 0;
+        for (size_t i = 0; i < shards_.size(); ++i) {
+            id = i == 0 ? shards_[i]->snapshot_id() : std::min(id, shards_[i]->snapshot_id());
+        }
+        return id;
+    }
+
+    turbo::Status ShardedIndex::save(LabelType snapshot_id, const std::string &path, const std::any &save_conf) {
+        if (init_type_ == IndexInitializationType::INIT_NONE) {
+            return turbo::invalid_argument_error("index not initialized");
+        }
+        ScopedLatency latency(metrics_.save);
+        auto rs = for_each_shard([&](size_t i) {
+            return shards_[i]->save(snapshot_id, shard_path(path, i), save_conf);
+        });
+        if (!rs.ok()) {
+            return rs;
+        }
+        // written last, a crash before leaves no loadable index at path
+        std::ofstream output(path, std::ios::binary);
+        uint64_t header[3] = {kShardedMagic, shards_.size(), snapshot_id};
+        output.write(reinterpret_cast<const char *>(header), sizeof(header));
+        if (!output) {
+            return turbo::internal_error("can not write " + path);
+        }
+        return turbo::OkStatus();
+    }
+
+    turbo::Status ShardedIndex::load(const std::string &path, const IndexConfig &config) {
+        turbo::MutexLock lock(&init_mutex_);
+        ScopedLatency latency(metrics_.load);
+        if (init_type_ != IndexInitializationType::INIT_NONE) {
+            return turbo::already_exists_error("index already initialized, can not load");
+        }
+        std::ifstream input(path, std::ios::binary);
+        uint64_t header[3] = {0, 0, 0};
+        input.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!input || header[0] != kShardedMagic) {
+            return turbo::data_loss_error("not a sharded index: " + path);
+        }
+        ShardedConfig sharded;
+        auto rs = create_shards(config, sharded);
+        if (rs.ok() && header[1] != sharded.num_shards) {
+            rs = turbo::invalid_argument_error("saved with " + std::to_string(header[1]) + " shards");
+        }
+        if (rs.ok()) {
+            IndexConfig shard_config;
+            shard_config.core = config.core;
+            shard_config.core.index_type = sharded.shard_type;
+            shard_config.index_conf = sharded.shard_conf;
+            rs = for_each_shard([&](size_t i) { return shards_[i]->load(shard_path(path, i), shard_config); });
+        }
+        if (!rs.ok()) {
+            pool_.stop();
+            shards_.clear();
+            return rs;
+        }
+        config_ = config;
+        init_type_ = IndexInitializationType::INIT_LOAD;
+        return turbo::OkStatus();
+    }
+
+    bool ShardedIndex::support_dynamic() const {
+        return std::all_of(shards_.begin(), shards_.end(), [](auto &shard) { return shard->support_dynamic(); });
+    }
+
+    bool ShardedIndex::need_train() const {
+        return std::any_of(shards_.begin(), shards_.end(), [](auto &shard) { return shard->need_train(); });
+    }
+
+    turbo::Status ShardedIndex::train(std::any conf) {
+        return for_each_shard([&](size_t i) { return shards_[i]->train(conf); });
+    }
+
+    bool ShardedIndex::is_trained() const {
+        return std::all_of(shards_.begin(), shards_.end(), [](auto &shard) { return shard->is_trained(); });
+    }
+
+    turbo::Result<MetricsSnapshot> ShardedIndex::metrics() const {
+        auto snap = metrics_.snapshot();
+        for (auto &shard: shards_) {
+            auto rs = shard->metrics();
+            if (!rs.ok()) {
+                continue;
+            }
+            snap.elements += rs.value().elements;
+            snap.deleted += rs.value().deleted;
+            snap.memory_bytes += rs.value().memory_bytes;
+            snap.huge_page_bytes += rs.value().huge_page_bytes;
+        }
+        if (snap.elements > 0) {
+            snap.deleted_ratio = static_cast<double>(snap.deleted) / static_cast<double>(snap.elements);
+        }
+        return snap;
+    }
+
+}  // namespace phekda
@@ -0,0 +1,151 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-29.
+//
+
+#pragma once
+
+#include <phekda/unified.h>
+#include <phekda/core/numa_worker_pool.h>
+#include <turbo/synchronization/mutex.h>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace phekda {
+
+    // index_conf of a ShardedIndex
+    struct ShardedConfig {
+        size_t num_shards{2};
+        // type and index_conf of every shard, the core config is shared and
+        // its max_elements is the capacity of each shard
+        IndexType shard_type{IndexType::INDEX_HNSWLIB};
+        std::any shard_conf;
+        // fan out threads shared by all the callers, 0 is one per cpu
+        size_t threads{0};
+    };
+
+    /**
+     * @class ShardedIndex
+     * @brief several indexes behind one UnifiedIndex. a label lives in the
+     *        shard picked by its hash, a search runs on all the shards in
+     *        parallel and merges their top k, a batch add builds the shards
+     *        in parallel. save and load write and read one file per shard,
+     *        path.shard.<i>, next to a small file at path
+     */
+    class ShardedIndex : public UnifiedIndex {
+    public:
+        ShardedIndex() = default;
+
+        ~ShardedIndex() override = default;
+
+        turbo::Status initialize(const IndexConfig &config) override;
+
+        turbo::Status add_vector(turbo::Nonnull<const uint8_t *> data, LabelType label, std::any write_conf) override;
+
+        // grouped by shard, the shards add their part in parallel
+        turbo::Status
+        add_vectors(turbo::Nonnull<const uint8_t *> data, turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                    std::any write_conf) override;
+
+        turbo::Status get_vector(LabelType label, turbo::Nonnull<uint8_t *> data) override;
+
+        turbo::Status
+        get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data) override;
+
+        // all the shards in parallel, the results are merged by distance.
+        // locations in the results are those of the shard holding the label
+        turbo::Status search(SearchContext &context) override;
+
+        turbo::Status lazy_delete(LabelType label) override;
+
+        // the shards one by one, the reports are summed
+        turbo::Result<ConsolidationReport> consolidate(const std::any &conf) override;
+
+        // the oldest snapshot of the shards
+        LabelType snapshot_id() const override;
+
+        turbo::Status save(LabelType snapshot_id, const std::string &path, const std::any &save_conf) override;
+
+        // the number of shards saved must match the config
+        turbo::Status load(const std::string &path, const IndexConfig &config) override;
+
+        bool support_dynamic() const override;
+
+        bool need_train() const override;
+
+        turbo::Status train(std::any conf) override;
+
+        bool is_trained() const override;
+
+        bool support_build(std::any conf) const override {
+            return false;
+        }
+
+        turbo::Status build(std::any conf) const override {
+            return turbo::unavailable_error("build not supported");
+        }
+
+        CoreConfig get_core_config() const override {
+            return config_.core;
+        }
+
+        IndexConfig get_index_config() const override {
+            return config_;
+        }
+
+        IndexInitializationType get_initialization_type() const override {
+            return init_type_;
+        }
+
+        // latencies of the calls of this index, sizes summed over the shards
+        turbo::Result<MetricsSnapshot> metrics() const override;
+
+        size_t num_shards() const {
+            return shards_.size();
+        }
+
+        UnifiedIndex *shard(size_t i) const {
+            return shards_[i].get();
+        }
+
+        // the shard a label is routed to
+        size_t shard_of(LabelType label) const;
+
+        static std::string shard_path(const std::string &path, size_t shard) {
+            return path + ".shard." + std::to_string(shard);
+        }
+
+    private:
+        // create the shards and start the fan out threads
+        turbo::Status create_shards(const IndexConfig &config, ShardedConfig &sharded);
+
+        // fn(i) for every shard, shard 0 on the calling thread, the first error
+        // is returned after all of them finished
+        turbo::Status for_each_shard(const std::function<turbo::Status(size_t)> &fn) const;
+
+        turbo::Mutex init_mutex_;
+        IndexInitializationType init_type_{IndexInitializationType::INIT_NONE};
+        IndexConfig config_;
+        std::vector<std::unique_ptr<UnifiedIndex>> shards_;
+        mutable NumaWorkerPool pool_;
+        IndexMetrics metrics_;
+    };
+
+}  // namespace phekda
@@ -20,6 +20,8 @@
 //
 #include <phekda/unified.h>
 #include <phekda/hnswlib/index.h>
+#include <phekda/segmented_index.h>
+#include <phekda/sharded_index.h>
 
 namespace phekda {
 
@@ -35,11 +37,28 @@ namespace phekda {
         return context;
     }
 
+    turbo::Status UnifiedIndex::get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num,
+                                            turbo::Nonnull<uint8_t *> data, turbo::Nonnull<bool *> found) {
+        auto size = get_core_config().dimension * data_type_size(get_core_config().data);
+        for (uint32_t i = 0; i < num; ++i) {
+            auto rs = get_vector(labels[i], data + i * size);
+            if (!rs.ok() && !turbo::is_not_found(rs)) {
+                return rs;
+            }
+            found[i] = rs.ok();
+        }
+        return turbo::OkStatus();
+    }
+
     UnifiedIndex* UnifiedIndex::create_index(IndexType type) {
         switch (type) {
             case IndexType::INDEX_HNSWLIB:
             case IndexType::INDEX_HNSW_FLAT:
                 return new HnswIndex();
+            case IndexType::INDEX_SHARDED:
+                return new ShardedIndex();
+            case IndexType::INDEX_SEGMENTED:
+                return new SegmentedIndex();
             default:
                 return nullptr;
         }
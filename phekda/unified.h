@@ -24,6 +24,7 @@
 #include <turbo/utility/status.h>
 #include <phekda/core/config.h>
 #include <phekda/core/search_context.h>
+#include <phekda/core/index_metrics.h>
 #include <phekda/conditions/bitmap_condition.h>
 #include <phekda/version.h>
 
@@ -79,6 +80,13 @@ namespace phekda {
         virtual turbo::Status
         get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data) = 0;
 
+        // get vectors from index with labels, a label not found does not fail
+        // the batch, found[i] tells if the vector of labels[i] is filled in.
+        // the default calls get_vector per label
+        virtual turbo::Status
+        get_vectors(turbo::Nonnull<const LabelType *> labels, uint32_t num, turbo::Nonnull<uint8_t *> data,
+                    turbo::Nonnull<bool *> found);
+
         // create meta,
         // default is init core config
         // if index need more meta, it should be specified in the config.index_conf
@@ -104,12 +112,11 @@ namespace phekda {
         // the index should be able to provide a snapshot
         TURBO_MUST_USE_RESULT virtual LabelType snapshot_id() const = 0;
 
-        // install snapshot to index
-        // the index should be able to install the snapshot
-        // at this time, the index can be searched, but add and delete
-        // should be blocked
-        // for search engine, although the index need not be so strict
-        // as the traditional database, but it should be able to provide
+        // save a snapshot of the index to path
+        // the snapshot is the index as it was when the save started,
+        // searches, adds and deletes go on while it is written, the
+        // elements changed meanwhile are kept aside until the save
+        // reached them
         virtual turbo::Status save(LabelType snapshot_id, const std::string &path, const std::any &save_conf) = 0;
 
         // load snapshot to index
@@ -152,6 +159,12 @@ namespace phekda {
 
         TURBO_MUST_USE_RESULT  virtual IndexInitializationType get_initialization_type() const = 0;
 
+        // latency histograms, counters and sizes of the index, for export
+        // as text or through MetricsSnapshot::for_each
+        TURBO_MUST_USE_RESULT virtual turbo::Result<MetricsSnapshot> metrics() const {
+            return turbo::unimplemented_error("metrics not supported");
+        }
+
     };
 
 }  // namespace phekda
@@ -0,0 +1,87 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-21.
+//
+#include <phekda/core/chunked_arena.h>
+#include <gtest/gtest.h>
+#include <mutex>
+
+TEST(ChunkedArena, grow_keeps_address) {
+    phekda::ChunkedArena arena;
+    ASSERT_TRUE(arena.initialize(24, 100).ok());
+    EXPECT_EQ(arena.chunk_elements(), 128);
+    ASSERT_TRUE(arena.reserve(10).ok());
+    EXPECT_EQ(arena.capacity(), 128);
+    for (size_t i = 0; i < 128; ++i) {
+        memset(arena.at(i), static_cast<int>(i), 24);
+    }
+    char *first = arena.at(0);
+    char *last = arena.at(127);
+    // enough chunks to replace the directory a few times
+    ASSERT_TRUE(arena.reserve(128 * 100).ok());
+    EXPECT_EQ(arena.capacity(), 128 * 100);
+    EXPECT_EQ(arena.num_chunks(), 100);
+    EXPECT_EQ(arena.at(0), first);
+    EXPECT_EQ(arena.at(127), last);
+    EXPECT_EQ(arena.at(128), arena.chunk(1));
+    EXPECT_EQ(arena.at(129) - arena.at(128), 24);
+    for (size_t i = 0; i < 128; ++i) {
+        EXPECT_EQ(arena.at(i)[23], static_cast<char>(i));
+    }
+    size_t total = 0;
+    arena.for_each_chunk(300, [&](char *chunk, size_t n) {
+        EXPECT_EQ(chunk, arena.at(total));
+        total += n;
+    });
+    EXPECT_EQ(total, 300);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.at(128)) % 64, 0);
+}
+
+TEST(ChunkedArena, zeroed_chunks) {
+    phekda::ChunkedArena arena;
+    ASSERT_TRUE(arena.initialize(16, 16, 64, true).ok());
+    ASSERT_TRUE(arena.reserve(40).ok());
+    for (size_t i = 0; i < arena.capacity(); ++i) {
+        for (size_t j = 0; j < 16; ++j) {
+            ASSERT_EQ(arena.at(i)[j], 0);
+        }
+    }
+    EXPECT_FALSE(arena.initialize(0, 16).ok());
+}
+
+TEST(ChunkedVector, non_movable) {
+    phekda::ChunkedVector<std::mutex> locks;
+    ASSERT_TRUE(locks.initialize(8).ok());
+    ASSERT_TRUE(locks.reserve(8).ok());
+    std::mutex *first = &locks[0];
+    std::lock_guard<std::mutex> guard(locks[3]);
+    ASSERT_TRUE(locks.reserve(1000).ok());
+    EXPECT_EQ(&locks[0], first);
+    EXPECT_FALSE(locks[3].try_lock());
+    EXPECT_TRUE(locks[999].try_lock());
+    locks[999].unlock();
+
+    phekda::ChunkedVector<char *> ptrs;
+    ASSERT_TRUE(ptrs.initialize(4).ok());
+    ASSERT_TRUE(ptrs.reserve(9).ok());
+    EXPECT_EQ(ptrs.capacity(), 12);
+    for (size_t i = 0; i < ptrs.capacity(); ++i) {
+        EXPECT_EQ(ptrs[i], nullptr);
+    }
+}
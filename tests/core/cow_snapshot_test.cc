@@ -0,0 +1,125 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+#include <phekda/core/cow_snapshot.h>
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+    // element i is 8 bytes holding its version
+    struct Elements {
+        explicit Elements(size_t n) : values(n, 0) {}
+
+        void copy(size_t id, std::vector<char> &bytes) const {
+            bytes.resize(sizeof(uint64_t));
+            memcpy(bytes.data(), &values[id], sizeof(uint64_t));
+        }
+
+        static uint64_t value(const std::vector<char> &bytes) {
+            uint64_t v;
+            memcpy(&v, bytes.data(), sizeof(v));
+            return v;
+        }
+
+        std::vector<uint64_t> values;
+    };
+}  // namespace
+
+TEST(CowSnapshot, keeps_the_first_version) {
+    Elements elements(4);
+    phekda::CowSnapshot snapshot;
+    auto copy = [&](size_t id, std::vector<char> &bytes) { elements.copy(id, bytes); };
+    EXPECT_FALSE(snapshot.active());
+    // nothing kept when no save runs
+    snapshot.preserve(0, copy);
+    EXPECT_EQ(snapshot.kept_bytes(), 0);
+
+    snapshot.begin(3);
+    EXPECT_TRUE(snapshot.active());
+    EXPECT_EQ(snapshot.count(), 3);
+    // element 1 changes twice, only the version at begin is kept
+    snapshot.preserve(1, copy);
+    elements.values[1] = 10;
+    snapshot.preserve(1, copy);
+    elements.values[1] = 11;
+    EXPECT_EQ(snapshot.kept_bytes(), sizeof(uint64_t));
+    // added after begin, not part of the snapshot
+    snapshot.preserve(3, copy);
+    elements.values[3] = 30;
+    EXPECT_EQ(snapshot.kept_bytes(), sizeof(uint64_t));
+
+    std::vector<char> bytes;
+    snapshot.take(0, bytes, copy);
+    EXPECT_EQ(Elements::value(bytes), 0);
+    snapshot.take(1, bytes, copy);
+    EXPECT_EQ(Elements::value(bytes), 0);
+    // already written, the writer does not keep it any more
+    snapshot.preserve(0, copy);
+    elements.values[0] = 5;
+    EXPECT_EQ(snapshot.kept_bytes(), sizeof(uint64_t));
+    snapshot.take(2, bytes, copy);
+    EXPECT_EQ(Elements::value(bytes), 0);
+
+    snapshot.end();
+    EXPECT_FALSE(snapshot.active());
+    EXPECT_EQ(snapshot.count(), 0);
+}
+
+TEST(CowSnapshot, concurrent_writers) {
+    constexpr size_t n = 20000;
+    Elements elements(n);
+    for (size_t i = 0; i < n; ++i) {
+        elements.values[i] = i;
+    }
+    phekda::CowSnapshot snapshot;
+    snapshot.begin(n);
+    std::atomic<bool> done{false};
+    std::vector<std::thread> writers;
+    for (size_t t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t] {
+            // each writer owns the ids equal to t modulo 4
+            size_t round = 1;
+            while (!done.load()) {
+                for (size_t i = t; i < n; i += 4) {
+                    snapshot.preserve(i, [&](size_t id, std::vector<char> &bytes) { elements.copy(id, bytes); });
+                    __atomic_store_n(&elements.values[i], i + round * n, __ATOMIC_RELAXED);
+                }
+                ++round;
+            }
+        });
+    }
+    std::vector<char> bytes;
+    for (size_t i = 0; i < n; ++i) {
+        snapshot.take(i, bytes, [&](size_t id, std::vector<char> &out) {
+            out.resize(sizeof(uint64_t));
+            uint64_t v = __atomic_load_n(&elements.values[id], __ATOMIC_RELAXED);
+            memcpy(out.data(), &v, sizeof(v));
+        });
+        ASSERT_EQ(Elements::value(bytes), i);
+    }
+    done.store(true);
+    for (auto &w: writers) {
+        w.join();
+    }
+    snapshot.end();
+}
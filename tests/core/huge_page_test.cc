@@ -0,0 +1,109 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+#include <phekda/core/huge_page.h>
+#include <phekda/core/chunked_arena.h>
+#include <phekda/hnswlib/visited_list_pool.h>
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+TEST(HugePageTest, alloc_modes) {
+    const size_t bytes = 3 * phekda::kHugePage2MB + 100;
+    for (auto mode: {phekda::HugePageMode::HUGE_PAGE_NONE, phekda::HugePageMode::HUGE_PAGE_TRANSPARENT,
+                     phekda::HugePageMode::HUGE_PAGE_2MB, phekda::HugePageMode::HUGE_PAGE_1GB}) {
+        auto block = phekda::page_alloc(bytes, 64, mode);
+        ASSERT_NE(block.ptr, nullptr);
+        EXPECT_GE(block.bytes, bytes);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(block.ptr) % 64, 0);
+        if (mode == phekda::HugePageMode::HUGE_PAGE_NONE) {
+            EXPECT_EQ(block.backing, phekda::PageBacking::PAGE_MALLOC);
+        } else {
+#ifdef __linux__
+            // hugetlb falls back to transparent huge pages, never to malloc
+            EXPECT_NE(block.backing, phekda::PageBacking::PAGE_MALLOC);
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(block.ptr) % phekda::kHugePage2MB, 0);
+#endif
+        }
+        memset(block.ptr, 1, bytes);
+        auto stats = phekda::page_stats({block});
+        EXPECT_EQ(stats.bytes, block.bytes);
+        EXPECT_LE(stats.huge_page_bytes, stats.bytes);
+        if (block.backing == phekda::PageBacking::PAGE_HUGETLB) {
+            EXPECT_EQ(stats.huge_page_bytes, block.bytes);
+        }
+        if (block.backing == phekda::PageBacking::PAGE_MALLOC) {
+            EXPECT_EQ(stats.huge_page_bytes, 0);
+        }
+        phekda::page_free(block);
+    }
+}
+
+TEST(HugePageTest, chunked_arena) {
+    phekda::ChunkedArena arena;
+    ASSERT_TRUE(arena.initialize(100, 65536, 64, true, phekda::HugePageMode::HUGE_PAGE_TRANSPARENT).ok());
+    ASSERT_TRUE(arena.reserve(3 * 65536).ok());
+    for (size_t i = 0; i < arena.capacity(); i += 997) {
+        // mapped chunks are zeroed without memset
+        ASSERT_EQ(arena.at(i)[0], 0);
+        arena.at(i)[0] = 1;
+    }
+    auto stats = arena.page_stats();
+    EXPECT_GE(stats.bytes, arena.memory_usage());
+    EXPECT_LE(stats.huge_page_bytes, stats.bytes);
+    arena.release();
+    EXPECT_EQ(arena.page_stats().bytes, 0);
+}
+
+TEST(HugePageTest, small_chunks_share_pages) {
+    phekda::ChunkedArena arena;
+    // 100KB chunks, twenty of them fit in one 2MB page
+    ASSERT_TRUE(arena.initialize(100, 1024, 64, true, phekda::HugePageMode::HUGE_PAGE_2MB).ok());
+    ASSERT_TRUE(arena.reserve(10 * 1024).ok());
+    EXPECT_EQ(arena.num_chunks(), 10u);
+    for (size_t i = 0; i < arena.capacity(); i += 101) {
+        ASSERT_EQ(arena.at(i)[0], 0);
+        arena.at(i)[0] = 1;
+    }
+#ifdef __linux__
+    EXPECT_EQ(arena.page_stats().bytes, phekda::kHugePage2MB);
+    // the next page once the first is full
+    ASSERT_TRUE(arena.reserve(30 * 1024).ok());
+    EXPECT_EQ(arena.page_stats().bytes, 2 * phekda::kHugePage2MB);
+#endif
+    // chunks do not overlap
+    std::vector<char *> chunks;
+    for (size_t c = 0; c < arena.num_chunks(); ++c) {
+        chunks.push_back(arena.chunk(c));
+    }
+    std::sort(chunks.begin(), chunks.end());
+    for (size_t c = 1; c < chunks.size(); ++c) {
+        EXPECT_GE(static_cast<size_t>(chunks[c] - chunks[c - 1]), arena.chunk_bytes());
+    }
+}
+
+TEST(HugePageTest, visited_list_backing) {
+    // small lists stay on malloc, hugetlb is never used for them
+    phekda::VisitedList small(1000, phekda::HugePageMode::HUGE_PAGE_1GB);
+    EXPECT_EQ(small.block.backing, phekda::PageBacking::PAGE_MALLOC);
+    phekda::VisitedList large(4 << 20, phekda::HugePageMode::HUGE_PAGE_1GB);
+    EXPECT_NE(large.block.backing, phekda::PageBacking::PAGE_HUGETLB);
+}
@@ -0,0 +1,154 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-20.
+//
+#include <phekda/core/label_map.h>
+#include <gtest/gtest.h>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+TEST(LabelMap, insert_find_erase) {
+    phekda::LabelMap map(4);
+    EXPECT_TRUE(map.empty());
+    for (phekda::LabelType i = 0; i < 1000; ++i) {
+        map.insert_or_assign(i * 7919, i);
+    }
+    EXPECT_EQ(map.size(), 1000);
+    for (phekda::LabelType i = 0; i < 1000; ++i) {
+        phekda::LocationType loc;
+        ASSERT_TRUE(map.find(i * 7919, loc));
+        EXPECT_EQ(loc, i);
+    }
+    EXPECT_FALSE(map.contains(1));
+    // overwrite
+    map.insert_or_assign(0, 42);
+    phekda::LocationType loc;
+    ASSERT_TRUE(map.find(0, loc));
+    EXPECT_EQ(loc, 42);
+    EXPECT_EQ(map.size(), 1000);
+
+    bool inserted;
+    EXPECT_EQ(map.try_emplace(0, 7, inserted), 42);
+    EXPECT_FALSE(inserted);
+    EXPECT_EQ(map.try_emplace(1, 7, inserted), 7);
+    EXPECT_TRUE(inserted);
+
+    EXPECT_TRUE(map.erase(1));
+    EXPECT_FALSE(map.erase(1));
+    EXPECT_FALSE(map.contains(1));
+    for (phekda::LabelType i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(map.erase(i * 7919));
+    }
+    EXPECT_EQ(map.size(), 500);
+    size_t visited = 0;
+    map.for_each([&](phekda::LabelType label, phekda::LocationType location) {
+        EXPECT_EQ(label, location * 7919);
+        ++visited;
+    });
+    EXPECT_EQ(visited, 500);
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_FALSE(map.contains(7919));
+}
+
+TEST(LabelMap, erase_if_location) {
+    phekda::LabelMap map(4);
+    map.insert_or_assign(5, 1);
+    // the label moved on, keep it
+    EXPECT_FALSE(map.erase(5, 2));
+    EXPECT_FALSE(map.erase(6, 1));
+    EXPECT_TRUE(map.contains(5));
+    EXPECT_TRUE(map.erase(5, 1));
+    EXPECT_FALSE(map.contains(5));
+    EXPECT_EQ(map.size(), 0u);
+}
+
+TEST(LabelMap, find_batch) {
+    phekda::LabelMap map(8);
+    for (phekda::LabelType i = 0; i < 1000; ++i) {
+        map.insert_or_assign(i * 3, i);
+    }
+    map.erase(30);
+    std::vector<phekda::LabelType> labels;
+    for (phekda::LabelType i = 0; i < 300; ++i) {
+        labels.push_back(i);
+    }
+    std::vector<phekda::LocationType> locations(labels.size());
+    EXPECT_EQ(map.find_batch(labels.data(), labels.size(), locations.data()), 99u);
+    for (size_t i = 0; i < labels.size(); ++i) {
+        if (labels[i] % 3 == 0 && labels[i] != 30) {
+            EXPECT_EQ(locations[i], labels[i] / 3);
+        } else {
+            EXPECT_EQ(locations[i], phekda::LabelMap::kEmpty);
+        }
+    }
+    EXPECT_EQ(map.find_batch(labels.data(), 0, locations.data()), 0u);
+}
+
+TEST(LabelMap, erase_reinsert_churn) {
+    // erased slots should be reused or rehashed away, never fill the table
+    phekda::LabelMap map(1);
+    std::unordered_map<phekda::LabelType, phekda::LocationType> expect;
+    std::mt19937 rng(47);
+    std::uniform_int_distribution<phekda::LabelType> dist(0, 511);
+    for (int i = 0; i < 100000; ++i) {
+        auto label = dist(rng);
+        if (i % 3 == 0) {
+            EXPECT_EQ(map.erase(label), expect.erase(label) == 1);
+        } else {
+            map.insert_or_assign(label, i);
+            expect[label] = i;
+        }
+    }
+    EXPECT_EQ(map.size(), expect.size());
+    for (auto &it: expect) {
+        phekda::LocationType loc;
+        ASSERT_TRUE(map.find(it.first, loc));
+        EXPECT_EQ(loc, it.second);
+    }
+    // 12 bytes per slot under 3/4 load factor
+    EXPECT_LE(map.memory_usage(), 1024 * sizeof(phekda::LabelMap::Slot));
+}
+
+TEST(LabelMap, concurrent_insert) {
+    phekda::LabelMap map;
+    const int num_threads = 8;
+    const phekda::LabelType per_thread = 20000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            for (phekda::LabelType i = 0; i < per_thread; ++i) {
+                auto label = t * per_thread + i;
+                map.insert_or_assign(label, static_cast<phekda::LocationType>(label));
+                phekda::LocationType loc;
+                ASSERT_TRUE(map.find(label, loc));
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(map.size(), num_threads * per_thread);
+    for (phekda::LabelType label = 0; label < num_threads * per_thread; ++label) {
+        phekda::LocationType loc;
+        ASSERT_TRUE(map.find(label, loc));
+        EXPECT_EQ(loc, label);
+    }
+}
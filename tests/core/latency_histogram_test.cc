@@ -0,0 +1,101 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-26.
+//
+#include <phekda/core/index_metrics.h>
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(LatencyHistogram, buckets) {
+    using H = phekda::LatencyHistogram;
+    for (uint64_t v: {0ull, 1ull, 15ull, 16ull, 17ull, 100ull, 1000ull, 123456789ull, 1ull << 40}) {
+        auto b = H::bucket_of(v);
+        EXPECT_LE(v, H::bucket_upper(b)) << v;
+        if (b > 0) {
+            EXPECT_GT(v, H::bucket_upper(b - 1)) << v;
+        }
+        // relative error under 1/16
+        EXPECT_LE(H::bucket_upper(b) - v, v / 16 + 1) << v;
+    }
+    EXPECT_EQ(H::bucket_of(uint64_t(1) << 60), H::kBuckets - 1);
+}
+
+TEST(LatencyHistogram, percentiles) {
+    phekda::LatencyHistogram h;
+    EXPECT_EQ(h.snapshot().count, 0u);
+    // 1..10000 us
+    for (uint64_t i = 1; i <= 10000; ++i) {
+        h.record(i * 1000);
+    }
+    auto snap = h.snapshot();
+    EXPECT_EQ(snap.count, 10000u);
+    EXPECT_EQ(snap.max, 10000u * 1000);
+    EXPECT_NEAR(snap.mean(), 5000.5 * 1000, 1);
+    auto near = [](uint64_t value, double expect) {
+        EXPECT_NEAR(static_cast<double>(value), expect, expect / 16) << value;
+    };
+    near(snap.p50, 5000e3);
+    near(snap.p90, 9000e3);
+    near(snap.p99, 9900e3);
+    near(snap.p999, 9990e3);
+    EXPECT_LE(snap.p999, snap.max);
+    h.reset();
+    EXPECT_EQ(h.snapshot().count, 0u);
+}
+
+TEST(LatencyHistogram, concurrent_record) {
+    phekda::LatencyHistogram h;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&h, t] {
+            for (uint64_t i = 0; i < 10000; ++i) {
+                h.record(turbo::Duration::nanoseconds(static_cast<int64_t>(i + t)));
+            }
+        });
+    }
+    for (auto &t: threads) {
+        t.join();
+    }
+    auto snap = h.snapshot();
+    EXPECT_EQ(snap.count, 40000u);
+    EXPECT_EQ(snap.max, 10002u);
+}
+
+TEST(IndexMetrics, export) {
+    phekda::IndexMetrics metrics;
+    metrics.search.record(2000);
+    metrics.search.record(4000);
+    auto snap = metrics.snapshot();
+    snap.elements = 10;
+    snap.deleted = 1;
+    size_t names = 0;
+    double search_count = 0;
+    snap.for_each([&](const std::string &name, double value) {
+        ++names;
+        if (name == "search_count") {
+            search_count = value;
+        }
+    });
+    EXPECT_EQ(search_count, 2);
+    EXPECT_GT(names, 40u);
+    auto text = snap.to_string();
+    EXPECT_NE(text.find("search_p99_us "), std::string::npos) << text;
+    EXPECT_NE(text.find("elements 10\n"), std::string::npos);
+}
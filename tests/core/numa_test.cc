@@ -0,0 +1,94 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-23.
+//
+#include <phekda/core/numa.h>
+#include <phekda/core/numa_worker_pool.h>
+#include <phekda/core/chunked_arena.h>
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+TEST(NumaTest, parse_id_list) {
+    EXPECT_EQ(phekda::detail::parse_id_list("0-3,8,10-11"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(phekda::detail::parse_id_list("5"), (std::vector<int>{5}));
+    EXPECT_TRUE(phekda::detail::parse_id_list("").empty());
+}
+
+TEST(NumaTest, topology) {
+    int nodes = phekda::numa_num_nodes();
+    ASSERT_GE(nodes, 1);
+    EXPECT_LT(phekda::numa_current_node(), nodes);
+    EXPECT_FALSE(phekda::numa_pin_thread(nodes).ok());
+}
+
+TEST(NumaTest, place_arena) {
+    for (auto policy: {phekda::NumaPolicy::NUMA_INTERLEAVE, phekda::NumaPolicy::NUMA_BIND}) {
+        phekda::ChunkedArena arena;
+        ASSERT_TRUE(arena.initialize(64, 4096).ok());
+        arena.set_numa(policy, phekda::numa_num_nodes() - 1);
+        ASSERT_TRUE(arena.reserve(3 * 4096).ok());
+        memset(arena.chunk(0), 1, arena.chunk_bytes());
+        EXPECT_EQ(arena.at(100)[0], 1);
+    }
+    std::vector<char> buf(8192);
+    EXPECT_FALSE(phekda::numa_place(buf.data(), buf.size(), phekda::NumaPolicy::NUMA_BIND, -1).ok());
+}
+
+TEST(NumaTest, worker_pool) {
+    phekda::NumaWorkerPool pool;
+    ASSERT_TRUE(pool.start(2).ok());
+    EXPECT_FALSE(pool.start(2).ok());
+    EXPECT_EQ(pool.num_nodes(), phekda::numa_num_nodes());
+    EXPECT_EQ(pool.num_threads(), 2 * pool.num_nodes());
+
+    std::vector<int> ran_on(16, -1);
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < ran_on.size(); ++i) {
+        int node = static_cast<int>(i) % pool.num_nodes();
+        futures.push_back(pool.submit(node, [&ran_on, i] {
+            ran_on[i] = phekda::numa_current_node();
+        }));
+    }
+    for (auto &f: futures) {
+        f.get();
+    }
+    for (size_t i = 0; i < ran_on.size(); ++i) {
+        EXPECT_EQ(ran_on[i], static_cast<int>(i) % pool.num_nodes());
+    }
+    pool.stop();
+    EXPECT_EQ(pool.num_threads(), 0);
+}
+
+TEST(NumaTest, worker_pool_not_started) {
+    phekda::NumaWorkerPool pool;
+    // no workers, the task runs on the caller
+    auto caller = std::this_thread::get_id();
+    std::thread::id ran_on;
+    auto future = pool.submit(3, [&] { ran_on = std::this_thread::get_id(); });
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(0)), std::future_status::ready);
+    EXPECT_EQ(ran_on, caller);
+
+    ASSERT_TRUE(pool.start(1).ok());
+    pool.stop();
+    bool ran = false;
+    pool.submit([&] { ran = true; }).get();
+    EXPECT_TRUE(ran);
+}
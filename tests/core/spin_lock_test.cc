@@ -0,0 +1,61 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+#include <phekda/core/spin_lock.h>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TEST(ByteSpinLock, embedded_in_header) {
+    // a zeroed header byte is an unlocked lock
+    struct Header {
+        uint16_t count;
+        uint8_t flags;
+        uint8_t lock;
+    };
+    std::vector<Header> headers(4, Header{0, 0, 0});
+    auto &lock = phekda::ByteSpinLock::at(&headers[1].lock);
+    EXPECT_FALSE(lock.is_locked());
+    ASSERT_TRUE(lock.try_lock());
+    EXPECT_FALSE(lock.try_lock());
+    EXPECT_EQ(headers[1].lock, 1);
+    EXPECT_EQ(headers[1].flags, 0);
+    lock.unlock();
+    EXPECT_EQ(headers[1].lock, 0);
+
+    size_t counter = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10000; ++i) {
+                std::lock_guard<phekda::ByteSpinLock> guard(phekda::ByteSpinLock::at(&headers[2].lock));
+                ++counter;
+                ++headers[2].count;
+            }
+        });
+    }
+    for (auto &t: threads) {
+        t.join();
+    }
+    EXPECT_EQ(counter, 40000);
+    EXPECT_EQ(headers[2].count, static_cast<uint16_t>(40000));
+    EXPECT_FALSE(phekda::ByteSpinLock::at(&headers[2].lock).is_locked());
+}
@@ -0,0 +1,97 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+class AlignedLayoutTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    // odd dimension, the packed layout puts vectors at arbitrary offsets
+    AlignedLayoutTest() : TestVectors(13, 1000) {}
+
+    void SetUp() override {
+        config.random_seed = 123;
+        config.alignment = 64;
+        config.space = &space;
+    }
+
+    static bool aligned(const void *ptr, size_t alignment) {
+        return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+    }
+
+    phekda::L2Space space{static_cast<size_t>(d)};
+    phekda::CoreConfig core_config = make_core_config(n);
+    phekda::HnswlibConfig config = phekda::test::hnsw_config();
+};
+
+TEST_F(AlignedLayoutTest, layout) {
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    EXPECT_EQ(alg.offsetData_ % 64, 0);
+    EXPECT_EQ(alg.size_data_per_element_ % 64, 0);
+    EXPECT_GE(alg.offsetData_, alg.size_links_level0_);
+    EXPECT_GE(alg.size_data_per_element_, alg.label_offset_ + sizeof(phekda::LabelType));
+
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        ASSERT_TRUE(alg.addPoint(data.data() + i * d, i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    for (phekda::LocationType i = 0; i < n; ++i) {
+        ASSERT_TRUE(aligned(alg.getDataByInternalId(i), 64));
+    }
+    alg.setEf(50);
+    for (phekda::LabelType q = 0; q < 20; ++q) {
+        auto res = alg.searchKnnCloserFirst(data.data() + q * d, 1);
+        ASSERT_EQ(res.size(), 1);
+        EXPECT_EQ(res[0].second, q);
+    }
+
+    // not a power of two
+    config.alignment = 48;
+    phekda::HierarchicalNSW bad;
+    EXPECT_FALSE(bad.initialize(core_config, config).ok());
+}
+
+TEST_F(AlignedLayoutTest, save_load) {
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        ASSERT_TRUE(alg.addPoint(data.data() + i * d, i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    ASSERT_TRUE(alg.saveIndex("aligned_layout_index", 1).ok());
+
+    phekda::HnswlibConfig load_config;
+    load_config.space = &space;
+    phekda::HierarchicalNSW loaded;
+    ASSERT_TRUE(loaded.loadIndex("aligned_layout_index", core_config, load_config).ok());
+    EXPECT_EQ(loaded.get_index_config().alignment, 64);
+    EXPECT_EQ(loaded.size_data_per_element_, alg.size_data_per_element_);
+    std::vector<float> out(d);
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        ASSERT_TRUE(aligned(loaded.getDataByInternalId(i), 64));
+        ASSERT_TRUE(loaded.getVector(i, out.data()).ok());
+        ASSERT_TRUE(std::equal(out.begin(), out.end(), data.begin() + i * d));
+    }
+    loaded.setEf(50);
+    auto res = loaded.searchKnnCloserFirst(data.data() + 5 * d, 1);
+    ASSERT_EQ(res.size(), 1);
+    EXPECT_EQ(res[0].second, 5);
+}
@@ -0,0 +1,157 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-28.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <phekda/async_searcher.h>
+#include <gtest/gtest.h>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class AsyncSearcherTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    AsyncSearcherTest() : TestVectors(8, 1000) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config())).ok());
+    }
+
+    phekda::SearchContext context_of(phekda::LabelType i) const {
+        auto context = index.create_search_context();
+        context.with_top_k(5).with_query(vec(i));
+        return context;
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_F(AsyncSearcherTest, callback_and_future) {
+    phekda::AsyncSearcher searcher(&index, 0);
+    auto context = context_of(3);
+    EXPECT_TRUE(turbo::is_failed_precondition(
+            searcher.search_async(std::move(context), [](turbo::Status, phekda::SearchContext &) {})));
+    ASSERT_TRUE(searcher.start(2).ok());
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t done = 0;
+    for (phekda::LabelType q = 0; q < 50; ++q) {
+        auto rs = searcher.search_async(context_of(q), [&, q](turbo::Status status, phekda::SearchContext &ctx) {
+            EXPECT_TRUE(status.ok());
+            EXPECT_EQ(ctx.results.size(), 5u);
+            EXPECT_EQ(ctx.results[0].label, q);
+            std::lock_guard<std::mutex> lock(mutex);
+            ++done;
+            cv.notify_one();
+        });
+        ASSERT_TRUE(rs.ok());
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return done == 50; });
+    }
+
+    std::vector<std::future<phekda::AsyncSearcher::Result>> futures;
+    for (phekda::LabelType q = 0; q < 50; ++q) {
+        futures.push_back(searcher.search_async(context_of(q)));
+    }
+    for (phekda::LabelType q = 0; q < 50; ++q) {
+        auto result = futures[q].get();
+        ASSERT_TRUE(result.status.ok());
+        ASSERT_EQ(result.context.results.size(), 5u);
+        EXPECT_EQ(result.context.results[0].label, q);
+    }
+    searcher.stop();
+    EXPECT_EQ(searcher.completed(), 100u);
+    EXPECT_EQ(searcher.in_flight(), 0u);
+    EXPECT_EQ(searcher.rejected(), 0u);
+}
+
+TEST_F(AsyncSearcherTest, admission_control) {
+    phekda::AsyncSearcher searcher(&index, 2);
+    ASSERT_TRUE(searcher.start(1).ok());
+
+    // hold the worker in the first callback so the second search queues
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool entered = false;
+    bool release = false;
+    ASSERT_TRUE(searcher.search_async(context_of(1), [&](turbo::Status, phekda::SearchContext &) {
+        std::unique_lock<std::mutex> lock(mutex);
+        entered = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return release; });
+    }).ok());
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return entered; });
+    }
+    auto second = searcher.search_async(context_of(2));
+    EXPECT_EQ(searcher.in_flight(), 2u);
+    EXPECT_EQ(searcher.queue_depth(), 1u);
+
+    // over the bound, the context stays with the caller
+    auto context = context_of(3);
+    auto rs = searcher.search_async(std::move(context), [](turbo::Status, phekda::SearchContext &) {
+        ADD_FAILURE() << "rejected search completed";
+    });
+    EXPECT_TRUE(turbo::is_resource_exhausted(rs));
+    EXPECT_EQ(context.top_k, 5u);
+    auto rejected = searcher.search_async(context_of(4)).get();
+    EXPECT_TRUE(turbo::is_resource_exhausted(rejected.status));
+    EXPECT_EQ(searcher.rejected(), 2u);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+        cv.notify_all();
+    }
+    auto result = second.get();
+    ASSERT_TRUE(result.status.ok());
+    EXPECT_EQ(result.context.results[0].label, 2u);
+    searcher.stop();
+    EXPECT_EQ(searcher.completed(), 2u);
+    EXPECT_EQ(searcher.queue_depth(), 0u);
+}
+
+TEST_F(AsyncSearcherTest, callback_errors) {
+    phekda::AsyncSearcher searcher(&index, 1);
+    ASSERT_TRUE(searcher.start(1).ok());
+    EXPECT_TRUE(turbo::is_invalid_argument(searcher.search_async(context_of(1), nullptr)));
+    EXPECT_EQ(searcher.in_flight(), 0u);
+
+    // a throwing callback still frees its slot, the next search is admitted
+    for (size_t i = 0; i < 3; ++i) {
+        auto rs = searcher.search_async(context_of(i), [](turbo::Status, phekda::SearchContext &) {
+            throw std::runtime_error("callback failed");
+        });
+        ASSERT_TRUE(rs.ok());
+        while (searcher.completed() <= i) {
+            std::this_thread::yield();
+        }
+    }
+    searcher.stop();
+    EXPECT_EQ(searcher.completed(), 3u);
+    EXPECT_EQ(searcher.in_flight(), 0u);
+    EXPECT_EQ(searcher.rejected(), 0u);
+}
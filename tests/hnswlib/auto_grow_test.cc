@@ -0,0 +1,120 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-21.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class AutoGrowTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    AutoGrowTest() : TestVectors(8, 2000) {}
+
+    void SetUp() override {
+        config.random_seed = 123;
+        config.chunk_elements = 64;
+    }
+
+    phekda::IndexConfig index_config(phekda::IndexType type, bool auto_grow) {
+        auto conf = make_config(100, config, type);
+        conf.with_auto_grow(auto_grow);
+        return conf;
+    }
+
+    phekda::HnswlibConfig config = phekda::test::hnsw_config();
+};
+
+TEST_F(AutoGrowTest, fixed_limit) {
+    phekda::HnswIndex index;
+    ASSERT_TRUE(index.initialize(index_config(phekda::IndexType::INDEX_HNSWLIB, false)).ok());
+    for (phekda::LabelType i = 0; i < 100; ++i) {
+        ASSERT_TRUE(index.add_vector(vec(i), i, {}).ok());
+    }
+    EXPECT_FALSE(index.add_vector(vec(100), 100, {}).ok());
+    EXPECT_EQ(index.get_core_config().max_elements, 100);
+}
+
+TEST_F(AutoGrowTest, hnsw_grow_while_searching) {
+    phekda::HnswIndex index;
+    ASSERT_TRUE(index.initialize(index_config(phekda::IndexType::INDEX_HNSWLIB, true)).ok());
+    ASSERT_TRUE(index.add_vector(vec(0), 0, {}).ok());
+
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> searches{0};
+    std::thread reader([&] {
+        auto context = index.create_search_context();
+        context.with_top_k(5);
+        while (!stop) {
+            context.results.clear();
+            context.with_query(vec(searches % n));
+            if (index.search(context).ok()) {
+                ++searches;
+            }
+        }
+    });
+    for (phekda::LabelType i = 1; i < n; ++i) {
+        ASSERT_TRUE(index.add_vector(vec(i), i, {}).ok());
+    }
+    stop = true;
+    reader.join();
+    EXPECT_GT(searches.load(), 0);
+    EXPECT_GE(index.get_core_config().max_elements, n);
+
+    std::vector<float> out(d);
+    for (phekda::LabelType i = 0; i < n; i += 97) {
+        ASSERT_TRUE(index.get_vector(i, reinterpret_cast<uint8_t *>(out.data())).ok());
+        EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + i * d));
+    }
+    auto context = index.create_search_context();
+    context.with_top_k(1);
+    context.with_query(vec(1500));
+    ASSERT_TRUE(index.search(context).ok());
+    ASSERT_EQ(context.results.size(), 1);
+    EXPECT_EQ(context.results[0].label, 1500);
+
+    // the grown index reloads with the same chunk size
+    ASSERT_TRUE(index.save(1, "auto_grow_index", {}).ok());
+    phekda::L2Space space(d);
+    config.space = &space;
+    phekda::HierarchicalNSW loaded;
+    auto conf = index_config(phekda::IndexType::INDEX_HNSWLIB, true);
+    ASSERT_TRUE(loaded.loadIndex("auto_grow_index", conf.core, config).ok());
+    EXPECT_EQ(loaded.getCurrentElementCount(), n);
+    ASSERT_TRUE(loaded.getVector(1999, out.data()).ok());
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + 1999 * d));
+    ASSERT_TRUE(loaded.addPoint(data.data(), n + 1, phekda::kHnswNotReplaceDeleted).ok());
+}
+
+TEST_F(AutoGrowTest, flat_grow) {
+    phekda::HnswIndex index;
+    ASSERT_TRUE(index.initialize(index_config(phekda::IndexType::INDEX_HNSW_FLAT, true)).ok());
+    for (phekda::LabelType i = 0; i < 500; ++i) {
+        ASSERT_TRUE(index.add_vector(vec(i), i, {}).ok());
+    }
+    EXPECT_GE(index.get_core_config().max_elements, 500);
+    auto context = index.create_search_context();
+    context.with_top_k(1);
+    context.with_query(vec(321));
+    ASSERT_TRUE(index.search(context).ok());
+    ASSERT_EQ(context.results.size(), 1);
+    EXPECT_EQ(context.results[0].label, 321);
+}
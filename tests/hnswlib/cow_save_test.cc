@@ -0,0 +1,265 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CowSaveTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    // rows for the labels added during the saves too
+    CowSaveTest() : TestVectors(8, 4 * 1000) {}
+
+    void SetUp() override {
+        config.random_seed = 50;
+    }
+
+    void TearDown() override {
+        for (auto &file: files) {
+            std::remove(file.c_str());
+        }
+    }
+
+    // the vector of label at version, every dimension shifted alike so a
+    // torn copy shows up as uneven shifts
+    std::vector<float> vector(phekda::LabelType label, int version) const {
+        std::vector<float> v(data.begin() + label * d, data.begin() + (label + 1) * d);
+        for (auto &x: v) {
+            x += static_cast<float>(version);
+        }
+        return v;
+    }
+
+    std::string file(const std::string &name) {
+        files.push_back(name);
+        return name;
+    }
+
+    static std::string read_file(const std::string &path) {
+        std::ifstream input(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    // rows in the index before the writes start
+    size_t initial = 1000;
+    std::vector<std::string> files;
+    phekda::CoreConfig core_config = make_core_config(n);
+    phekda::HnswlibConfig config = phekda::test::hnsw_config();
+};
+
+TEST_F(CowSaveTest, hnsw_writes_during_save_are_not_seen) {
+    phekda::L2Space space(d);
+    config.space = &space;
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    for (phekda::LabelType i = 0; i < initial; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 0).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    ASSERT_TRUE(alg.saveIndex(file("cow_hnsw_before_index"), 5).ok());
+
+    // start a save by hand, write to the index, then let the save finish
+    size_t count;
+    size_t max_elements;
+    phekda::LocationType enterpoint;
+    int maxlevel;
+    {
+        std::unique_lock<phekda::SnapshotGate> gate(alg.snapshot_gate_);
+        count = alg.cur_element_count;
+        max_elements = alg.max_elements_;
+        enterpoint = alg.enterpoint_node_;
+        maxlevel = alg.maxlevel_;
+        alg.snapshot_.begin(count);
+    }
+    for (phekda::LabelType i = 0; i < 100; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 1).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    for (phekda::LabelType i = 100; i < 150; ++i) {
+        ASSERT_TRUE(alg.markDelete(i).ok());
+    }
+    for (phekda::LabelType i = initial; i < initial + 300; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 0).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    EXPECT_GT(alg.snapshotKeptBytes(), 0);
+    ASSERT_TRUE(alg.writeSnapshot(file("cow_hnsw_after_index"), 5, count, max_elements, enterpoint, maxlevel).ok());
+    {
+        std::unique_lock<phekda::SnapshotGate> gate(alg.snapshot_gate_);
+        alg.snapshot_.end();
+    }
+
+    auto before = read_file("cow_hnsw_before_index");
+    ASSERT_FALSE(before.empty());
+    EXPECT_TRUE(before == read_file("cow_hnsw_after_index"));
+    // the index itself went on
+    EXPECT_EQ(alg.cur_element_count, initial + 300);
+    EXPECT_EQ(alg.getDeletedCount(), 50);
+}
+
+TEST_F(CowSaveTest, flat_writes_during_save_are_not_seen) {
+    phekda::L2Space space(d);
+    config.space = &space;
+    phekda::BruteforceSearch alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    for (phekda::LabelType i = 0; i < initial; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 0).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    ASSERT_TRUE(alg.saveIndex(file("cow_flat_before_index"), 5).ok());
+
+    size_t count;
+    size_t max_elements;
+    {
+        std::unique_lock<phekda::SnapshotGate> gate(alg.snapshot_gate_);
+        count = alg.cur_element_count;
+        max_elements = alg.max_elements_;
+        alg.snapshot_.begin(count);
+    }
+    for (phekda::LabelType i = 0; i < 100; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 1).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    // deletes move the last rows into the holes, the adds then reuse the
+    // rows freed at the end
+    for (phekda::LabelType i = 100; i < 150; ++i) {
+        ASSERT_TRUE(alg.markDelete(i).ok());
+    }
+    for (phekda::LabelType i = initial; i < initial + 300; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 0).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    ASSERT_TRUE(alg.writeSnapshot(file("cow_flat_after_index"), count, max_elements).ok());
+    {
+        std::unique_lock<phekda::SnapshotGate> gate(alg.snapshot_gate_);
+        alg.snapshot_.end();
+    }
+
+    auto before = read_file("cow_flat_before_index");
+    ASSERT_FALSE(before.empty());
+    EXPECT_TRUE(before == read_file("cow_flat_after_index"));
+    EXPECT_EQ(alg.cur_element_count, initial + 250);
+}
+
+TEST_F(CowSaveTest, on_snapshot_runs_before_the_write) {
+    auto conf = make_config(n, config, phekda::IndexType::INDEX_HNSW_FLAT);
+    phekda::HnswIndex index;
+    ASSERT_TRUE(index.initialize(conf).ok());
+    for (phekda::LabelType i = 0; i < initial; ++i) {
+        ASSERT_TRUE(index.add_vector(reinterpret_cast<const uint8_t *>(vector(i, 0).data()), i, {}).ok());
+    }
+
+    // an add started from the hook lands after the snapshot
+    size_t calls = 0;
+    std::thread writer;
+    phekda::HnswlibSaveConfig save_conf;
+    save_conf.on_snapshot = [&] {
+        ++calls;
+        writer = std::thread([&] {
+            auto v = vector(initial, 0);
+            EXPECT_TRUE(index.add_vector(reinterpret_cast<const uint8_t *>(v.data()), initial, {}).ok());
+        });
+    };
+    auto path = file("cow_hook_index");
+    ASSERT_TRUE(index.save(6, path, save_conf).ok());
+    writer.join();
+    EXPECT_EQ(calls, 1u);
+    EXPECT_EQ(index.metrics().value().elements, initial + 1);
+
+    phekda::HnswIndex loaded;
+    ASSERT_TRUE(loaded.load(path, conf).ok());
+    EXPECT_EQ(loaded.metrics().value().elements, initial);
+}
+
+TEST_F(CowSaveTest, hnsw_save_with_concurrent_writers) {
+    phekda::L2Space space(d);
+    config.space = &space;
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    for (phekda::LabelType i = 0; i < initial; ++i) {
+        ASSERT_TRUE(alg.addPoint(vector(i, 0).data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<phekda::LabelType> next_label{initial};
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 3; ++t) {
+        writers.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            int version = 1;
+            while (!done.load()) {
+                auto label = static_cast<phekda::LabelType>(rng() % initial);
+                switch (rng() % 3) {
+                    case 0: {
+                        auto added = next_label.fetch_add(1);
+                        if (added < n) {
+                            (void) alg.addPoint(vector(added, 0).data(), added, phekda::kHnswNotReplaceDeleted);
+                        }
+                        break;
+                    }
+                    case 1:
+                        (void) alg.addPoint(vector(label, version++).data(), label, phekda::kHnswNotReplaceDeleted);
+                        break;
+                    default:
+                        (void) alg.markDelete(label);
+                        break;
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < 3; ++round) {
+        auto path = file("cow_hnsw_concurrent_index");
+        ASSERT_TRUE(alg.saveIndex(path, round).ok());
+
+        phekda::HierarchicalNSW loaded;
+        ASSERT_TRUE(loaded.loadIndex(path, core_config, config).ok());
+        EXPECT_EQ(loaded.snapshot_id(), round);
+        size_t count = loaded.cur_element_count;
+        ASSERT_GE(count, initial);
+        for (size_t i = 0; i < count; ++i) {
+            auto id = static_cast<phekda::LocationType>(i);
+            // every link points inside the snapshot
+            for (int level = 0; level <= loaded.element_levels_[id]; ++level) {
+                auto *ll = loaded.get_linklist_at_level(id, level);
+                size_t size = loaded.getListCount(ll);
+                for (size_t j = 1; j <= size; ++j) {
+                    ASSERT_LT(ll[j], count);
+                }
+            }
+            // a whole version of the vector, never a mix of two
+            auto label = loaded.getExternalLabel(id);
+            ASSERT_LT(label, n);
+            auto *v = reinterpret_cast<const float *>(loaded.getDataByInternalId(id));
+            float shift = v[0] - data[label * d];
+            for (int j = 1; j < d; ++j) {
+                ASSERT_NEAR(v[j] - data[label * d + j], shift, 1e-3);
+            }
+        }
+        auto result = loaded.searchKnn(vector(0, 0).data(), 10);
+        EXPECT_EQ(result.size(), 10);
+    }
+    done.store(true);
+    for (auto &w: writers) {
+        w.join();
+    }
+}
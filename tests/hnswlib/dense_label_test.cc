@@ -0,0 +1,114 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-21.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+class DenseLabelTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    DenseLabelTest() : TestVectors(8, 1000) {}
+
+    void SetUp() override {
+        config.random_seed = 123;
+        config.dense_label = true;
+        config.space = &space;
+    }
+
+    phekda::L2Space space{static_cast<size_t>(d)};
+    phekda::CoreConfig core_config = make_core_config(n);
+    phekda::HnswlibConfig config = phekda::test::hnsw_config(16, 200);
+};
+
+TEST_F(DenseLabelTest, add_search_get) {
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    // no inline label in the element
+    EXPECT_EQ(alg.size_data_per_element_, alg.size_links_level0_ + alg.data_size_);
+
+    // insert out of order, only the even labels
+    std::vector<phekda::LabelType> labels;
+    for (phekda::LabelType i = 0; i < n; i += 2) {
+        labels.push_back(i);
+    }
+    std::shuffle(labels.begin(), labels.end(), std::mt19937(7));
+    for (auto label: labels) {
+        ASSERT_TRUE(alg.addPoint(data.data() + label * d, label, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    EXPECT_TRUE(alg.label_lookup_.empty());
+    // the vacant odd slots are not counted
+    EXPECT_EQ(alg.getCurrentElementCount(), n / 2);
+    ASSERT_TRUE(alg.addPoint(data.data() + 4 * d, 4, phekda::kHnswNotReplaceDeleted).ok());
+    EXPECT_EQ(alg.getCurrentElementCount(), n / 2);
+    EXPECT_FALSE(alg.addPoint(data.data(), n, phekda::kHnswNotReplaceDeleted).ok());
+    EXPECT_FALSE(alg.addPoint(data.data(), 0, phekda::kHnswRepaceDeleted).ok());
+
+    std::vector<float> out(d);
+    ASSERT_TRUE(alg.getVector(10, out.data()).ok());
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + 10 * d));
+    // vacant slots are not found
+    EXPECT_FALSE(alg.getVector(11, out.data()).ok());
+    EXPECT_FALSE(alg.markDelete(11).ok());
+
+    alg.setEf(100);
+    for (phekda::LabelType q = 0; q < 20; q += 2) {
+        auto res = alg.searchKnnCloserFirst(data.data() + q * d, 1);
+        ASSERT_EQ(res.size(), 1);
+        EXPECT_EQ(res[0].second, q);
+    }
+
+    ASSERT_TRUE(alg.markDelete(0).ok());
+    auto res = alg.searchKnnCloserFirst(data.data(), 5);
+    for (auto &r: res) {
+        EXPECT_NE(r.second, 0);
+        EXPECT_EQ(r.second % 2, 0);
+    }
+}
+
+TEST_F(DenseLabelTest, save_load) {
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    for (phekda::LabelType i = 0; i < n; i += 3) {
+        ASSERT_TRUE(alg.addPoint(data.data() + i * d, i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    ASSERT_TRUE(alg.saveIndex("dense_label_index", 3).ok());
+
+    phekda::HnswlibConfig load_config;
+    load_config.space = &space;
+    phekda::HierarchicalNSW loaded;
+    ASSERT_TRUE(loaded.loadIndex("dense_label_index", core_config, load_config).ok());
+    EXPECT_TRUE(loaded.get_index_config().dense_label);
+    EXPECT_EQ(loaded.getCurrentElementCount(), (n + 2) / 3);
+    std::vector<float> out(d);
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        auto rs = loaded.getVector(i, out.data());
+        EXPECT_EQ(rs.ok(), i % 3 == 0);
+    }
+    // fill a vacant slot after load
+    ASSERT_TRUE(loaded.addPoint(data.data() + d, 1, phekda::kHnswNotReplaceDeleted).ok());
+    ASSERT_TRUE(loaded.getVector(1, out.data()).ok());
+    EXPECT_EQ(loaded.getCurrentElementCount(), (n + 2) / 3 + 1);
+    auto res = loaded.searchKnnCloserFirst(data.data() + d, 1);
+    ASSERT_EQ(res.size(), 1);
+    EXPECT_EQ(res[0].second, 1);
+}
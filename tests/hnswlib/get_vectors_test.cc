@@ -0,0 +1,94 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-25.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+class GetVectorsTest : public ::testing::TestWithParam<phekda::IndexType>, public phekda::test::TestVectors {
+public:
+    GetVectorsTest() : TestVectors(20, 500) {}
+
+    void SetUp() override {
+        // labels are offset so they differ from the internal ids
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config(), GetParam()), 1000).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_P(GetVectorsTest, batch_with_missing) {
+    size_t size = d * sizeof(float);
+    // unordered, repeated and missing labels
+    std::vector<phekda::LabelType> labels = {1499, 1000, 7, 1250, 1250, 99999, 1001};
+    std::vector<uint8_t> out(labels.size() * size);
+    std::unique_ptr<bool[]> found(new bool[labels.size()]);
+    ASSERT_TRUE(index.get_vectors(labels.data(), labels.size(), out.data(), found.get()).ok());
+    for (size_t i = 0; i < labels.size(); ++i) {
+        bool expect = labels[i] >= 1000 && labels[i] < 1000 + n;
+        ASSERT_EQ(found[i], expect) << labels[i];
+        if (expect) {
+            EXPECT_EQ(memcmp(out.data() + i * size, vec(labels[i] - 1000), size), 0);
+        }
+    }
+    // the all or nothing variant reports the missing label
+    EXPECT_FALSE(index.get_vectors(labels.data(), labels.size(), out.data()).ok());
+
+    std::vector<phekda::LabelType> all;
+    for (phekda::LabelType i = n; i > 0; --i) {
+        all.push_back(i - 1 + 1000);
+    }
+    out.resize(all.size() * size);
+    ASSERT_TRUE(index.get_vectors(all.data(), all.size(), out.data()).ok());
+    for (size_t i = 0; i < all.size(); ++i) {
+        EXPECT_EQ(memcmp(out.data() + i * size, vec(all[i] - 1000), size), 0);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Index, GetVectorsTest,
+                         ::testing::Values(phekda::IndexType::INDEX_HNSWLIB, phekda::IndexType::INDEX_HNSW_FLAT));
+
+TEST(GetVectorsDenseTest, dense_labels) {
+    phekda::test::TestVectors vectors(20, 500);
+    auto n = vectors.n;
+    auto config = phekda::test::hnsw_config();
+    config.dense_label = true;
+    phekda::HnswIndex index;
+    ASSERT_TRUE(index.initialize(vectors.make_config(2 * n, config)).ok());
+    // the label is the internal id, only the even ones are taken
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        ASSERT_TRUE(index.add_vector(vectors.vec(i), 2 * i, {}).ok());
+    }
+
+    size_t size = vectors.d * sizeof(float);
+    std::vector<phekda::LabelType> labels = {998, 0, 7, 500, 500, 99999, 2};
+    std::vector<uint8_t> out(labels.size() * size);
+    std::unique_ptr<bool[]> found(new bool[labels.size()]);
+    ASSERT_TRUE(index.get_vectors(labels.data(), labels.size(), out.data(), found.get()).ok());
+    for (size_t i = 0; i < labels.size(); ++i) {
+        bool expect = labels[i] % 2 == 0 && labels[i] < 2 * n;
+        ASSERT_EQ(found[i], expect) << labels[i];
+        if (expect) {
+            EXPECT_EQ(memcmp(out.data() + i * size, vectors.vec(labels[i] / 2), size), 0);
+        }
+    }
+}
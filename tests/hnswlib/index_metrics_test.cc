@@ -0,0 +1,65 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-26.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(IndexMetricsTest, hnsw_index) {
+    phekda::test::TestVectors vectors(8, 500);
+    auto n = vectors.n;
+    auto conf = vectors.make_config(n, phekda::test::hnsw_config());
+    phekda::HnswIndex index;
+    ASSERT_TRUE(vectors.build(index, conf).ok());
+    for (phekda::LabelType i = 0; i < 50; ++i) {
+        ASSERT_TRUE(index.lazy_delete(i).ok());
+    }
+    EXPECT_FALSE(index.lazy_delete(n + 1).ok());
+    for (phekda::LabelType q = 0; q < 100; ++q) {
+        auto context = index.create_search_context();
+        context.with_top_k(5).with_query(vectors.vec(q));
+        ASSERT_TRUE(index.search(context).ok());
+    }
+    ASSERT_TRUE(index.save(1, "metrics_index", {}).ok());
+
+    auto rs = index.metrics();
+    ASSERT_TRUE(rs.ok());
+    auto snap = rs.value();
+    EXPECT_EQ(snap.insert.count, static_cast<uint64_t>(n));
+    EXPECT_EQ(snap.remove.count, 51u);
+    EXPECT_EQ(snap.search.count, 100u);
+    EXPECT_EQ(snap.queue_wait.count, 100u);
+    EXPECT_EQ(snap.save.count, 1u);
+    EXPECT_GT(snap.search.p50, 0u);
+    EXPECT_LE(snap.search.p50, snap.search.p99);
+    EXPECT_GT(snap.qps, 0.0);
+    EXPECT_EQ(snap.elements, static_cast<size_t>(n));
+    EXPECT_EQ(snap.deleted, 50u);
+    EXPECT_DOUBLE_EQ(snap.deleted_ratio, 0.1);
+    EXPECT_GT(snap.memory_bytes, 0u);
+
+    phekda::HnswIndex loaded;
+    ASSERT_TRUE(loaded.load("metrics_index", conf).ok());
+    EXPECT_EQ(loaded.metrics().value().load.count, 1u);
+
+    index.reset_metrics();
+    EXPECT_EQ(index.metrics().value().search.count, 0u);
+}
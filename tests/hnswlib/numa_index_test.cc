@@ -0,0 +1,105 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-23.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <phekda/core/numa_worker_pool.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+class NumaIndexTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    NumaIndexTest() : TestVectors(8, 2000) {}
+
+    void SetUp() override {
+        config.random_seed = 123;
+    }
+
+    phekda::IndexConfig index_config() {
+        return make_config(2 * n, config);
+    }
+
+    std::vector<phekda::LabelType> search(phekda::HnswIndex &index, phekda::LabelType q) {
+        auto context = index.create_search_context();
+        context.with_top_k(5).with_query(vec(q));
+        EXPECT_TRUE(index.search(context).ok());
+        std::vector<phekda::LabelType> labels;
+        for (auto &r: context.results) {
+            labels.push_back(r.label);
+        }
+        return labels;
+    }
+
+    phekda::HnswlibConfig config = phekda::test::hnsw_config();
+};
+
+TEST_F(NumaIndexTest, bind_and_interleave) {
+    for (auto policy: {phekda::NumaPolicy::NUMA_BIND, phekda::NumaPolicy::NUMA_INTERLEAVE}) {
+        config.numa_policy = policy;
+        config.numa_node = phekda::numa_num_nodes() - 1;
+        phekda::HnswIndex index;
+        ASSERT_TRUE(index.initialize(index_config()).ok());
+        for (phekda::LabelType i = 0; i < n; ++i) {
+            ASSERT_TRUE(index.add_vector(vec(i), i, {}).ok());
+        }
+        EXPECT_EQ(search(index, 7)[0], 7);
+    }
+    config.numa_policy = phekda::NumaPolicy::NUMA_BIND;
+    config.numa_node = phekda::numa_num_nodes();
+    phekda::HnswIndex bad;
+    EXPECT_FALSE(bad.initialize(index_config()).ok());
+}
+
+TEST_F(NumaIndexTest, replicate) {
+    {
+        phekda::HnswIndex index;
+        ASSERT_TRUE(index.initialize(index_config()).ok());
+        for (phekda::LabelType i = 0; i < n; ++i) {
+            ASSERT_TRUE(index.add_vector(vec(i), i, {}).ok());
+        }
+        ASSERT_TRUE(index.save(1, "numa_index", {}).ok());
+    }
+
+    config.numa_policy = phekda::NumaPolicy::NUMA_REPLICATE;
+    phekda::HnswIndex index;
+    ASSERT_TRUE(index.load("numa_index", index_config()).ok());
+    EXPECT_EQ(index.num_replicas(), static_cast<size_t>(phekda::numa_num_nodes()));
+    // replicas are read only
+    EXPECT_EQ(index.add_vector(vec(0), n, {}).ok(), index.num_replicas() == 1);
+
+    // every node searches its own copy with the same results
+    auto expect = search(index, 11);
+    EXPECT_EQ(expect[0], 11);
+    phekda::NumaWorkerPool pool;
+    ASSERT_TRUE(pool.start(1).ok());
+    std::vector<std::vector<phekda::LabelType>> results(pool.num_nodes());
+    std::vector<std::future<void>> futures;
+    for (int node = 0; node < pool.num_nodes(); ++node) {
+        futures.push_back(pool.submit(node, [&, node] {
+            results[node] = search(index, 11);
+        }));
+    }
+    for (auto &f: futures) {
+        f.get();
+    }
+    for (auto &r: results) {
+        EXPECT_EQ(r, expect);
+    }
+}
@@ -0,0 +1,91 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-24.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+class QueryViewTest : public ::testing::Test,
+                      public phekda::test::BasicTestVectors<phekda::aligned_allocator<float, phekda::aligned_bytes>> {
+public:
+    // row stride of 16 floats keeps every row aligned
+    QueryViewTest() : BasicTestVectors(16, 1000) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config())).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_F(QueryViewTest, borrow_aligned_rows) {
+    size_t row = d * sizeof(float);
+    auto context = index.create_search_context();
+    context.with_top_k(5);
+    for (phekda::LabelType q = 0; q < 20; ++q) {
+        auto ptr = reinterpret_cast<const uint8_t *>(data.data() + q * d);
+        ASSERT_TRUE(context.with_query_view({ptr, row}).ok());
+        EXPECT_TRUE(context.is_query_borrowed());
+        EXPECT_EQ(context.get_query(), ptr);
+        ASSERT_TRUE(index.search(context).ok());
+
+        auto copied = index.create_search_context();
+        copied.with_top_k(5).with_query(ptr);
+        ASSERT_TRUE(index.search(copied).ok());
+        ASSERT_EQ(context.results.size(), copied.results.size());
+        for (size_t i = 0; i < copied.results.size(); ++i) {
+            EXPECT_EQ(context.results[i].label, copied.results[i].label);
+        }
+        EXPECT_EQ(context.results[0].label, q);
+    }
+    // with_query drops the view
+    context.with_query(reinterpret_cast<const uint8_t *>(data.data()));
+    EXPECT_FALSE(context.is_query_borrowed());
+    context.reset();
+    EXPECT_FALSE(context.is_query_borrowed());
+}
+
+TEST_F(QueryViewTest, misaligned_is_copied) {
+    size_t row = d * sizeof(float);
+    std::vector<uint8_t, phekda::aligned_allocator<uint8_t, phekda::aligned_bytes>> buffer(row + 4);
+    memcpy(buffer.data() + 4, data.data() + 7 * d, row);
+    auto context = index.create_search_context();
+    context.with_top_k(5);
+    ASSERT_TRUE(context.with_query_view({buffer.data() + 4, row}).ok());
+    EXPECT_FALSE(context.is_query_borrowed());
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(context.get_query()) % phekda::aligned_bytes, 0u);
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_EQ(context.results[0].label, 7);
+
+    EXPECT_FALSE(context.with_query_view({buffer.data(), row - 1}).ok());
+}
+
+TEST_F(QueryViewTest, mutable_query_copies) {
+    size_t row = d * sizeof(float);
+    auto ptr = reinterpret_cast<const uint8_t *>(data.data() + 3 * d);
+    auto context = index.create_search_context();
+    ASSERT_TRUE(context.with_query_view({ptr, row}).ok());
+    auto *q = static_cast<float *>(context.mutable_query());
+    EXPECT_FALSE(context.is_query_borrowed());
+    EXPECT_NE(static_cast<const void *>(q), ptr);
+    q[0] = -1.0f;
+    EXPECT_NE(data[3 * d], -1.0f);
+}
@@ -0,0 +1,65 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-25.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+class RawVectorTest : public ::testing::TestWithParam<phekda::IndexType>, public phekda::test::TestVectors {
+public:
+    RawVectorTest() : TestVectors(12, 1000) {}
+
+    void SetUp() override {
+        auto config = phekda::test::hnsw_config();
+        config.split_layout = true;
+        ASSERT_TRUE(build(index, make_config(n, config, GetParam())).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_P(RawVectorTest, rows_follow_results) {
+    for (bool with_location: {false, true}) {
+        for (bool reverse: {false, true}) {
+            auto context = index.create_search_context();
+            context.with_top_k(8).with_query(vec(21)).with_with_raw_vector(true)
+                    .with_with_location(with_location).with_reverse_result(reverse);
+            ASSERT_TRUE(index.search(context).ok());
+            ASSERT_EQ(context.results.size(), 8u);
+            ASSERT_EQ(context.raw_vectors.size(), 8 * context.data_size);
+            for (size_t i = 0; i < context.results.size(); ++i) {
+                EXPECT_EQ(memcmp(context.raw_vector(i), vec(context.results[i].label), context.data_size), 0);
+                if (!with_location) {
+                    EXPECT_EQ(context.results[i].location, 0u);
+                }
+            }
+        }
+    }
+    // off by default
+    auto context = index.create_search_context();
+    context.with_top_k(8).with_query(vec(21));
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_TRUE(context.raw_vectors.empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(Index, RawVectorTest,
+                         ::testing::Values(phekda::IndexType::INDEX_HNSWLIB, phekda::IndexType::INDEX_HNSW_FLAT));
@@ -0,0 +1,98 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+class ReorderTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    ReorderTest() : TestVectors(8, 2000) {}
+
+    void SetUp() override {
+        config.random_seed = 123;
+        config.space = &space;
+        ASSERT_TRUE(alg.initialize(core_config, config).ok());
+        // labels unrelated to the insertion order
+        for (phekda::LabelType i = 0; i < n; ++i) {
+            ASSERT_TRUE(alg.addPoint(data.data() + i * d, i * 3 + 1, phekda::kHnswNotReplaceDeleted).ok());
+        }
+        ASSERT_TRUE(alg.markDelete(4).ok());
+    }
+
+    phekda::L2Space space{static_cast<size_t>(d)};
+    phekda::CoreConfig core_config = make_core_config(n);
+    phekda::HnswlibConfig config = phekda::test::hnsw_config(8, 100);
+    phekda::HierarchicalNSW alg;
+};
+
+TEST_F(ReorderTest, permutation) {
+    for (auto type: {phekda::ReorderType::REORDER_BFS, phekda::ReorderType::REORDER_RCM}) {
+        auto order = phekda::compute_reorder(alg, type);
+        ASSERT_EQ(order.size(), n);
+        std::vector<bool> seen(n, false);
+        for (auto id: order) {
+            ASSERT_LT(id, n);
+            ASSERT_FALSE(seen[id]);
+            seen[id] = true;
+        }
+        EXPECT_LT(phekda::average_neighbor_distance(alg, order), phekda::average_neighbor_distance(alg, {}));
+    }
+    auto order = phekda::compute_reorder(alg, phekda::ReorderType::REORDER_BFS);
+    EXPECT_EQ(order[0], alg.enterpoint_node_);
+}
+
+TEST_F(ReorderTest, save_reordered) {
+    phekda::ReorderReport report;
+    phekda::HnswlibBuildConfig build_conf;
+    build_conf.reorder = phekda::ReorderType::REORDER_RCM;
+    build_conf.path = "reorder_index";
+    build_conf.snapshot = 5;
+    build_conf.report = &report;
+    ASSERT_TRUE(phekda::save_reordered(alg, build_conf).ok());
+    EXPECT_EQ(report.elements, n);
+    EXPECT_LT(report.avg_neighbor_distance_after, report.avg_neighbor_distance_before);
+
+    phekda::HierarchicalNSW loaded;
+    ASSERT_TRUE(loaded.loadIndex("reorder_index", core_config, config).ok());
+    EXPECT_EQ(loaded.snapshot_id(), 5);
+    EXPECT_EQ(loaded.getCurrentElementCount(), n);
+    EXPECT_EQ(loaded.getDeletedCount(), 1);
+    std::vector<float> out(d);
+    for (phekda::LabelType i = 0; i < n; i += 7) {
+        if (i * 3 + 1 == 4) {
+            continue;
+        }
+        ASSERT_TRUE(loaded.getVector(i * 3 + 1, out.data()).ok());
+        EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + i * d));
+    }
+    // same graph under new ids, the search visits the same elements
+    alg.setEf(50);
+    loaded.setEf(50);
+    for (phekda::LabelType q = 0; q < 50; ++q) {
+        auto expect = alg.searchKnnCloserFirst(data.data() + q * d, 5);
+        auto got = loaded.searchKnnCloserFirst(data.data() + q * d, 5);
+        ASSERT_EQ(expect.size(), got.size());
+        for (size_t i = 0; i < got.size(); ++i) {
+            EXPECT_EQ(expect[i].second, got[i].second);
+        }
+    }
+}
@@ -20,6 +20,8 @@
 //
 #include <phekda/hnswlib/index.h>
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
 
 #include <vector>
 #include <iostream>
@@ -140,4 +142,73 @@ TEST_F(HnswIndexTest, save_load) {
     auto core_config_load = alg_brute_load->get_core_config();
     EXPECT_EQ(core_config_load.max_elements, core_config.max_elements);
     EXPECT_EQ(11, alg_brute_load->snapshot_id());
-}
\ No newline at end of file
+}
+TEST_F(HnswIndexTest, load_legacy_format) {
+    phekda::L2Space space(d);
+    config.space = &space;
+    phekda::HierarchicalNSW alg;
+    ASSERT_TRUE(alg.initialize(core_config, config).ok());
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        std::vector<float> data(d);
+        for (int j = 0; j < d; ++j) {
+            data[j] = i * d + j;
+        }
+        ASSERT_TRUE(alg.addPoint(data.data(), i, phekda::kHnswNotReplaceDeleted).ok());
+    }
+    // the delete mark sits in the word the layout flags now take
+    ASSERT_TRUE(alg.markDelete(0).ok());
+
+    // the file as saved before the layout flags were added to the header
+    {
+        std::ofstream output("legacy_index", std::ios::binary);
+        auto conf = alg.get_core_config();
+        phekda::writeBinaryPOD(output, static_cast<uint32_t>(conf.index_type));
+        phekda::writeBinaryPOD(output, static_cast<uint32_t>(conf.data));
+        phekda::writeBinaryPOD(output, static_cast<uint32_t>(conf.metric));
+        phekda::writeBinaryPOD(output, conf.dimension);
+        phekda::writeBinaryPOD(output, conf.worker_num);
+        phekda::writeBinaryPOD(output, conf.max_elements);
+        phekda::writeBinaryPOD(output, uint64_t(7));
+        phekda::writeBinaryPOD(output, alg.offsetLevel0_);
+        phekda::writeBinaryPOD(output, alg.cur_element_count);
+        phekda::writeBinaryPOD(output, alg.size_data_per_element_);
+        phekda::writeBinaryPOD(output, alg.label_offset_);
+        phekda::writeBinaryPOD(output, alg.offsetData_);
+        phekda::writeBinaryPOD(output, alg.maxlevel_);
+        phekda::writeBinaryPOD(output, alg.enterpoint_node_);
+        phekda::writeBinaryPOD(output, alg.maxM_);
+        phekda::writeBinaryPOD(output, alg.maxM0_);
+        phekda::writeBinaryPOD(output, alg.hnsw_conf.M);
+        phekda::writeBinaryPOD(output, alg.mult_);
+        phekda::writeBinaryPOD(output, alg.hnsw_conf.ef_construction);
+        alg.data_level0_.for_each_chunk(alg.cur_element_count, [&](const char *chunk, size_t count) {
+            output.write(chunk, count * alg.size_data_per_element_);
+        });
+        for (size_t i = 0; i < alg.cur_element_count; i++) {
+            unsigned int linkListSize =
+                    alg.element_levels_[i] > 0 ? alg.size_links_per_element_ * alg.element_levels_[i] : 0;
+            phekda::writeBinaryPOD(output, linkListSize);
+            if (linkListSize) {
+                output.write(alg.linkLists_[i], linkListSize);
+            }
+        }
+    }
+
+    phekda::HierarchicalNSW loaded;
+    ASSERT_TRUE(loaded.loadIndex("legacy_index", core_config, config).ok());
+    std::remove("legacy_index");
+    EXPECT_EQ(loaded.snapshot_id(), 7);
+    EXPECT_FALSE(loaded.get_index_config().dense_label);
+    EXPECT_FALSE(loaded.get_index_config().split_layout);
+    EXPECT_EQ(loaded.cur_element_count, n);
+    EXPECT_EQ(loaded.getDeletedCount(), 1);
+    EXPECT_TRUE(loaded.isMarkedDeleted(0));
+    for (phekda::LabelType i = 1; i < n; ++i) {
+        auto data = loaded.getDataByLabel<float>(i);
+        EXPECT_EQ(data[0], static_cast<float>(i * d));
+    }
+    std::vector<float> query = {40, 41, 42, 43};
+    auto result = loaded.searchKnn(query.data(), 1);
+    ASSERT_EQ(result.size(), 1u);
+    EXPECT_EQ(result.top().second, 10u);
+}
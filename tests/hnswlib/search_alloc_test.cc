@@ -0,0 +1,82 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-24.
+//
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+    std::atomic<bool> counting{false};
+    std::atomic<size_t> allocations{0};
+}  // namespace
+
+void *operator new(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+TEST(SearchAllocTest, steady_state_search_allocates_nothing) {
+    phekda::test::TestVectors vectors(16, 2000);
+    phekda::HnswIndex index;
+    ASSERT_TRUE(vectors.build(index, vectors.make_config(vectors.n, phekda::test::hnsw_config())).ok());
+    // deleted elements take the other search path
+    ASSERT_TRUE(index.lazy_delete(3).ok());
+
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_query(vectors.vec(0));
+    // warm up the pools and the result vector
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(index.search(context).ok());
+    }
+
+    size_t ok = 0;
+    counting = true;
+    for (phekda::LabelType q = 0; q < 100; ++q) {
+        // same size query, the buffer is reused
+        context.with_query(vectors.vec(q));
+        ok += index.search(context).ok();
+    }
+    counting = false;
+    EXPECT_EQ(ok, 100u);
+    EXPECT_EQ(allocations.load(), 0u);
+    ASSERT_EQ(context.results.size(), 10u);
+    EXPECT_EQ(context.results[0].label, 99);
+    for (size_t i = 1; i < context.results.size(); ++i) {
+        EXPECT_LE(context.results[i - 1].distance, context.results[i].distance);
+    }
+}
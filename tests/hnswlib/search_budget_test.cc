@@ -0,0 +1,105 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-29.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+class SearchBudgetTest : public ::testing::TestWithParam<phekda::IndexType>, public phekda::test::TestVectors {
+public:
+    SearchBudgetTest() : TestVectors(8, 5000) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config(), GetParam())).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_P(SearchBudgetTest, unlimited_is_complete) {
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_search_list_size(100).with_query(vec(11));
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_FALSE(context.partial);
+    auto full = context.results;
+
+    // a budget that is never reached changes nothing
+    context.with_timeout(turbo::Duration::seconds(60)).with_max_distance_computations(1000000);
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_FALSE(context.partial);
+    ASSERT_EQ(context.results.size(), full.size());
+    for (size_t i = 0; i < full.size(); ++i) {
+        EXPECT_EQ(context.results[i].label, full[i].label);
+    }
+}
+
+TEST_P(SearchBudgetTest, distance_computations) {
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_search_list_size(200).with_query(vec(11)).with_max_distance_computations(300);
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_TRUE(context.partial);
+    EXPECT_FALSE(context.results.empty());
+    // stopped within one hop, or one scan stride, of the limit
+    EXPECT_GE(context.stats.distance_computations, 300u);
+    EXPECT_LE(context.stats.distance_computations, 300u + 64u);
+    for (size_t i = 1; i < context.results.size(); ++i) {
+        EXPECT_LE(context.results[i - 1].distance, context.results[i].distance);
+    }
+    EXPECT_EQ(index.metrics().value().partial_searches, 1u);
+}
+
+TEST_P(SearchBudgetTest, hops) {
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_search_list_size(200).with_query(vec(11));
+    ASSERT_TRUE(index.search(context).ok());
+    auto full = context.stats;
+    context.with_max_hops(5);
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_TRUE(context.partial);
+    EXPECT_FALSE(context.results.empty());
+    if (GetParam() == phekda::IndexType::INDEX_HNSWLIB) {
+        // the upper layer hops count too, level 0 makes at least one
+        EXPECT_GE(context.stats.hops, 5u);
+        EXPECT_LT(context.stats.hops, full.hops);
+    } else {
+        EXPECT_EQ(context.stats.distance_computations, 5u * phekda::BruteforceSearch::kScanStride);
+    }
+}
+
+TEST_P(SearchBudgetTest, expired_deadline) {
+    auto context = index.create_search_context();
+    // expired before the search starts, still answers with what one hop finds
+    context.with_top_k(10).with_search_list_size(200).with_query(vec(11))
+            .with_deadline(turbo::Time::current_time() - turbo::Duration::milliseconds(1));
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_TRUE(context.partial);
+    EXPECT_FALSE(context.results.empty());
+
+    // reset drops the budget
+    context.reset();
+    context.with_top_k(10).with_query(vec(11));
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_FALSE(context.partial);
+    EXPECT_EQ(context.results[0].label, 11u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Index, SearchBudgetTest,
+                         ::testing::Values(phekda::IndexType::INDEX_HNSWLIB, phekda::IndexType::INDEX_HNSW_FLAT));
@@ -0,0 +1,100 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-24.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <phekda/search_context_pool.h>
+#include <gtest/gtest.h>
+#include <vector>
+
+class SearchContextPoolTest : public ::testing::TestWithParam<phekda::IndexType>, public phekda::test::TestVectors {
+public:
+    SearchContextPoolTest() : TestVectors(8, 1000) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config(), GetParam())).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_P(SearchContextPoolTest, reuse_keeps_buffers) {
+    phekda::SearchContextPool pool(&index);
+    phekda::SearchContext *first;
+    const uint8_t *query_buffer;
+    {
+        auto context = pool.acquire();
+        first = context.get();
+        ASSERT_NE(context->scratch, nullptr);
+        context->with_top_k(5).with_query(vec(3)).with_with_location(true);
+        ASSERT_TRUE(index.search(*context).ok());
+        ASSERT_EQ(context->results.size(), 5u);
+        EXPECT_EQ(context->results[0].label, 3);
+        query_buffer = context->query.data();
+    }
+    EXPECT_EQ(pool.idle(), 1u);
+
+    auto context = pool.acquire();
+    EXPECT_EQ(pool.idle(), 0u);
+    // same context, per query state cleared, buffers kept
+    EXPECT_EQ(context.get(), first);
+    EXPECT_TRUE(context->results.empty());
+    EXPECT_GE(context->results.capacity(), 5u);
+    EXPECT_TRUE(context->query.empty());
+    EXPECT_EQ(context->top_k, 0u);
+    EXPECT_FALSE(context->with_location);
+    EXPECT_EQ(context->dimension, static_cast<uint32_t>(d));
+
+    context->with_top_k(5).with_query(vec(9)).with_reverse_result(true);
+    EXPECT_EQ(context->query.data(), query_buffer);
+    ASSERT_TRUE(index.search(*context).ok());
+
+    // same results as a fresh context
+    auto fresh = index.create_search_context();
+    fresh.with_top_k(5).with_query(vec(9)).with_reverse_result(true);
+    ASSERT_TRUE(index.search(fresh).ok());
+    ASSERT_EQ(context->results.size(), fresh.results.size());
+    for (size_t i = 0; i < fresh.results.size(); ++i) {
+        EXPECT_EQ(context->results[i].label, fresh.results[i].label);
+    }
+    EXPECT_EQ(context->results.back().label, 9);
+}
+
+TEST_P(SearchContextPoolTest, zero_top_k) {
+    phekda::SearchContextPool pool(&index);
+    auto context = pool.acquire();
+    context->with_top_k(0).with_query(vec(3));
+    ASSERT_TRUE(index.search(*context).ok());
+    EXPECT_TRUE(context->results.empty());
+}
+
+TEST_P(SearchContextPoolTest, max_idle) {
+    phekda::SearchContextPool pool(&index, 2);
+    {
+        auto a = pool.acquire();
+        auto b = pool.acquire();
+        auto c = pool.acquire();
+        EXPECT_NE(a.get(), b.get());
+    }
+    EXPECT_EQ(pool.idle(), 2u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Index, SearchContextPoolTest,
+                         ::testing::Values(phekda::IndexType::INDEX_HNSWLIB, phekda::IndexType::INDEX_HNSW_FLAT));
@@ -0,0 +1,107 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-25.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+class SearchStatsTest : public ::testing::TestWithParam<phekda::IndexType>, public phekda::test::TestVectors {
+public:
+    SearchStatsTest() : TestVectors(8, 2000) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config(), GetParam())).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_P(SearchStatsTest, per_query_and_totals) {
+    bool graph = GetParam() == phekda::IndexType::INDEX_HNSWLIB;
+    auto before = index.search_stats();
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_query(vec(5));
+    ASSERT_TRUE(index.search(context).ok());
+    auto plain = context.stats;
+    EXPECT_EQ(plain.queries, 1u);
+    EXPECT_GT(plain.distance_computations, 0u);
+    EXPECT_GT(plain.visited, 0u);
+    EXPECT_EQ(plain.filtered_out, 0u);
+    if (graph) {
+        EXPECT_GT(plain.hops, 0u);
+        EXPECT_LT(plain.visited, static_cast<uint64_t>(n));
+    } else {
+        EXPECT_EQ(plain.distance_computations, static_cast<uint64_t>(n));
+    }
+
+    // exclude every odd label, the rejected candidates are counted
+    phekda::BitmapCondition condition;
+    std::vector<phekda::LabelType> odd;
+    for (phekda::LabelType i = 1; i < n; i += 2) {
+        odd.push_back(i);
+    }
+    ASSERT_TRUE(condition.exclude(turbo::span<phekda::LabelType>(odd.data(), odd.size())).ok());
+    context.with_condition(&condition);
+    ASSERT_TRUE(index.search(context).ok());
+    EXPECT_GT(context.stats.filtered_out, 0u);
+    for (auto &r: context.results) {
+        EXPECT_EQ(r.label % 2, 0u);
+    }
+
+    // totals sum the queries of all threads
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (int q = 0; q < 25; ++q) {
+                auto ctx = index.create_search_context();
+                ctx.with_top_k(10).with_query(vec(t * 25 + q));
+                EXPECT_TRUE(index.search(ctx).ok());
+            }
+        });
+    }
+    for (auto &t: threads) {
+        t.join();
+    }
+    auto after = index.search_stats();
+    EXPECT_EQ(after.queries - before.queries, 102u);
+    EXPECT_GE(after.distance_computations - before.distance_computations,
+              plain.distance_computations + context.stats.distance_computations);
+}
+
+TEST_P(SearchStatsTest, search_list_size_sets_ef) {
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_query(vec(7));
+    ASSERT_TRUE(index.search(context).ok());
+    auto narrow = context.stats.distance_computations;
+    context.with_search_list_size(200);
+    ASSERT_TRUE(index.search(context).ok());
+    ASSERT_EQ(context.results.size(), 10u);
+    EXPECT_EQ(context.results[0].label, 7u);
+    if (GetParam() == phekda::IndexType::INDEX_HNSWLIB) {
+        EXPECT_GT(context.stats.distance_computations, narrow);
+    } else {
+        EXPECT_EQ(context.stats.distance_computations, narrow);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Index, SearchStatsTest,
+                         ::testing::Values(phekda::IndexType::INDEX_HNSWLIB, phekda::IndexType::INDEX_HNSW_FLAT));
@@ -0,0 +1,112 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-26.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+    // exclude odd labels and ask for a trace
+    class ExplainOddCondition : public phekda::SearchCondition {
+    public:
+        bool is_exclude(phekda::LabelType label) const override {
+            return label % 2 == 1;
+        }
+
+        bool should_explain() const override {
+            return true;
+        }
+    };
+}  // namespace
+
+class SearchTraceTest : public ::testing::TestWithParam<phekda::IndexType>, public phekda::test::TestVectors {
+public:
+    SearchTraceTest() : TestVectors(8, 5000) {}
+
+    void SetUp() override {
+        ASSERT_TRUE(build(index, make_config(n, phekda::test::hnsw_config(8, 100), GetParam())).ok());
+    }
+
+    phekda::HnswIndex index;
+};
+
+TEST_P(SearchTraceTest, explain) {
+    bool graph = GetParam() == phekda::IndexType::INDEX_HNSWLIB;
+    auto context = index.create_search_context();
+    context.with_top_k(10).with_query(vec(42));
+    ASSERT_TRUE(index.search(context).ok());
+    // not asked, not recorded
+    EXPECT_EQ(context.trace, nullptr);
+
+    ExplainOddCondition condition;
+    context.with_condition(&condition);
+    ASSERT_TRUE(index.search(context).ok());
+    ASSERT_NE(context.trace, nullptr);
+    auto &trace = *context.trace;
+    EXPECT_EQ(context.results[0].label, 42);
+    EXPECT_EQ(trace.filtered_out, context.stats.filtered_out);
+    EXPECT_GT(trace.filtered_out, 0u);
+    EXPECT_GT(trace.level0_time.to_nanoseconds(), 0);
+    if (!graph) {
+        EXPECT_TRUE(trace.level0.empty());
+        return;
+    }
+
+    ASSERT_EQ(trace.level_hops.size(), static_cast<size_t>(trace.max_level + 1));
+    uint64_t hops = 0;
+    for (auto h: trace.level_hops) {
+        hops += h;
+    }
+    EXPECT_EQ(hops, context.stats.hops);
+    EXPECT_EQ(trace.level_hops[0], trace.level0.size());
+
+    // the greedy path only goes down and gets closer
+    auto from = trace.entry_point;
+    auto dist = trace.entry_distance;
+    int level = trace.max_level;
+    for (auto &step: trace.upper_path) {
+        EXPECT_EQ(step.from, from);
+        EXPECT_LT(step.distance, dist);
+        EXPECT_LE(step.level, level);
+        EXPECT_GE(step.level, 1);
+        from = step.to;
+        dist = step.distance;
+        level = step.level;
+    }
+    EXPECT_EQ(trace.level0_entry, from);
+
+    // level 0 starts from the end of the path, the bound only tightens once full
+    ASSERT_FALSE(trace.level0.empty());
+    EXPECT_EQ(trace.level0.front().node, trace.level0_entry);
+    for (size_t i = 1; i < trace.level0.size(); ++i) {
+        EXPECT_GE(trace.level0[i].filtered_out, trace.level0[i - 1].filtered_out);
+        if (trace.level0[i - 1].results >= 10) {
+            EXPECT_LE(trace.level0[i].lower_bound, trace.level0[i - 1].lower_bound);
+        }
+    }
+
+    // reset drops the trace
+    context.reset();
+    EXPECT_EQ(context.trace, nullptr);
+}
+
+INSTANTIATE_TEST_SUITE_P(Index, SearchTraceTest,
+                         ::testing::Values(phekda::IndexType::INDEX_HNSWLIB, phekda::IndexType::INDEX_HNSW_FLAT));
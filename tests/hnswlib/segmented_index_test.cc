@@ -0,0 +1,227 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-30.
+//
+#include <phekda/segmented_index.h>
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+class SegmentedIndexTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    SegmentedIndexTest() : TestVectors(8, 4000) {}
+
+    phekda::IndexConfig segmented_config(phekda::IndexType segment_type, bool background) const {
+        auto conf = make_config(n, phekda::test::hnsw_config(), phekda::IndexType::INDEX_SEGMENTED);
+        phekda::SegmentedConfig segmented;
+        segmented.head_capacity = 500;
+        segmented.segment_type = segment_type;
+        segmented.segment_conf = conf.index_conf;
+        segmented.max_segments = 3;
+        segmented.background = background;
+        segmented.threads = 2;
+        conf.with_index(segmented);
+        return conf;
+    }
+
+    // labels of the top k of the query
+    std::vector<phekda::LabelType> top(phekda::UnifiedIndex &index, const uint8_t *query, uint32_t k) const {
+        auto context = index.create_search_context();
+        context.with_top_k(k).with_search_list_size(100).with_query(query);
+        EXPECT_TRUE(index.search(context).ok());
+        std::vector<phekda::LabelType> result;
+        for (auto &rez: context.results) {
+            result.push_back(rez.label);
+        }
+        return result;
+    }
+};
+
+TEST_F(SegmentedIndexTest, seal_and_merge) {
+    // flat segments, the searches are exact
+    phekda::HnswIndex single;
+    ASSERT_TRUE(single.initialize(make_config(n, phekda::test::hnsw_config(), phekda::IndexType::INDEX_HNSW_FLAT)).ok());
+    phekda::SegmentedIndex segmented;
+    ASSERT_TRUE(segmented.initialize(segmented_config(phekda::IndexType::INDEX_HNSW_FLAT, false)).ok());
+    auto all = labels();
+    ASSERT_TRUE(single.add_vectors(vec(0), all.data(), n, {}).ok());
+    for (phekda::LabelType i = 0; i < n; ++i) {
+        ASSERT_TRUE(segmented.add_vector(vec(i), i, {}).ok());
+    }
+    // 7 heads sealed, merged whenever there were more than 3
+    EXPECT_LE(segmented.num_segments(), 3u);
+    EXPECT_GE(segmented.num_segments(), 1u);
+    EXPECT_EQ(segmented.metrics().value().elements, n);
+    EXPECT_EQ(segmented.metrics().value().deleted, 0u);
+
+    for (phekda::LabelType q = 0; q < 50; ++q) {
+        auto expect = single.create_search_context();
+        expect.with_top_k(10).with_query(vec(q * 13));
+        ASSERT_TRUE(single.search(expect).ok());
+        auto context = segmented.create_search_context();
+        context.with_top_k(10).with_query(vec(q * 13)).with_with_raw_vector(true);
+        ASSERT_TRUE(segmented.search(context).ok());
+        ASSERT_EQ(context.results.size(), expect.results.size());
+        for (size_t i = 0; i < expect.results.size(); ++i) {
+            EXPECT_FLOAT_EQ(context.results[i].distance, expect.results[i].distance);
+            EXPECT_EQ(0, memcmp(context.raw_vector(i), vec(context.results[i].label), context.data_size));
+        }
+    }
+}
+
+TEST_F(SegmentedIndexTest, background_hnsw_segments) {
+    phekda::HnswIndex single;
+    ASSERT_TRUE(single.initialize(make_config(n, phekda::test::hnsw_config(), phekda::IndexType::INDEX_HNSW_FLAT)).ok());
+    std::unique_ptr<phekda::UnifiedIndex> index(phekda::UnifiedIndex::create_index(phekda::IndexType::INDEX_SEGMENTED));
+    ASSERT_NE(index, nullptr);
+    ASSERT_TRUE(index->initialize(segmented_config(phekda::IndexType::INDEX_HNSWLIB, true)).ok());
+    auto &segmented = static_cast<phekda::SegmentedIndex &>(*index);
+    auto all = labels();
+    ASSERT_TRUE(single.add_vectors(vec(0), all.data(), n, {}).ok());
+    ASSERT_TRUE(segmented.add_vectors(vec(0), all.data(), n, {}).ok());
+    ASSERT_TRUE(segmented.wait_sealed().ok());
+    EXPECT_LE(segmented.num_segments(), 3u);
+    EXPECT_EQ(segmented.metrics().value().elements, n);
+
+    size_t hits = 0;
+    size_t total = 0;
+    for (phekda::LabelType q = 0; q < 100; ++q) {
+        auto expect = top(single, vec(q * 37), 10);
+        auto got = top(segmented, vec(q * 37), 10);
+        for (auto label: expect) {
+            hits += std::count(got.begin(), got.end(), label);
+        }
+        total += expect.size();
+    }
+    EXPECT_GE(static_cast<double>(hits) / static_cast<double>(total), 0.9);
+}
+
+TEST_F(SegmentedIndexTest, delete_and_update) {
+    phekda::SegmentedIndex segmented;
+    ASSERT_TRUE(segmented.initialize(segmented_config(phekda::IndexType::INDEX_HNSWLIB, false)).ok());
+    auto all = labels();
+    ASSERT_TRUE(segmented.add_vectors(vec(0), all.data(), 2000, {}).ok());
+
+    // 7 lives in a sealed segment, its stale copy is skipped
+    ASSERT_TRUE(segmented.lazy_delete(7).ok());
+    EXPECT_FALSE(segmented.lazy_delete(7).ok());
+    for (auto label: top(segmented, vec(7), 10)) {
+        EXPECT_NE(label, 7u);
+    }
+    std::vector<float> out(d);
+    EXPECT_FALSE(segmented.get_vector(7, reinterpret_cast<uint8_t *>(out.data())).ok());
+
+    // 8 updated to the vector of 3000, the new copy is in the head
+    ASSERT_TRUE(segmented.add_vector(vec(3000), 8, {}).ok());
+    ASSERT_TRUE(segmented.get_vector(8, reinterpret_cast<uint8_t *>(out.data())).ok());
+    EXPECT_EQ(0, memcmp(out.data(), vec(3000), d * sizeof(float)));
+    EXPECT_EQ(top(segmented, vec(3000), 1)[0], 8u);
+    for (auto label: top(segmented, vec(8), 10)) {
+        EXPECT_NE(label, 8u);
+    }
+    // the add sealed the 4th head and merged the segments, which dropped 7,
+    // the old copy of 8 is left
+    auto before = segmented.metrics().value();
+    EXPECT_EQ(before.elements, 1999u);
+    EXPECT_EQ(before.deleted, 1u);
+
+    auto report = segmented.consolidate({});
+    ASSERT_TRUE(report.ok());
+    EXPECT_EQ(report.value().active_points, 1999u);
+    EXPECT_EQ(report.value().slots_released, 1u);
+    EXPECT_EQ(segmented.num_segments(), 1u);
+    EXPECT_EQ(segmented.metrics().value().deleted, 0u);
+    EXPECT_EQ(top(segmented, vec(3000), 1)[0], 8u);
+    EXPECT_FALSE(segmented.get_vector(7, reinterpret_cast<uint8_t *>(out.data())).ok());
+}
+
+TEST_F(SegmentedIndexTest, save_load) {
+    std::string path = "segmented_test_index";
+    auto conf = segmented_config(phekda::IndexType::INDEX_HNSWLIB, true);
+    auto all = labels();
+    phekda::SegmentedIndex segmented;
+    ASSERT_TRUE(segmented.initialize(conf).ok());
+    ASSERT_TRUE(segmented.add_vectors(vec(0), all.data(), 1800, {}).ok());
+    ASSERT_TRUE(segmented.lazy_delete(5).ok());
+    // the same parts on both sides
+    ASSERT_TRUE(segmented.wait_sealed().ok());
+    ASSERT_TRUE(segmented.save(3, path, {}).ok());
+
+    phekda::SegmentedIndex loaded;
+    ASSERT_TRUE(loaded.load(path, conf).ok());
+    EXPECT_EQ(loaded.get_initialization_type(), phekda::IndexInitializationType::INIT_LOAD);
+    EXPECT_EQ(loaded.snapshot_id(), 3u);
+    EXPECT_EQ(loaded.num_segments(), segmented.num_segments());
+    EXPECT_EQ(loaded.metrics().value().elements, 1799u);
+    for (phekda::LabelType q = 0; q < 20; ++q) {
+        EXPECT_EQ(top(loaded, vec(q * 50), 10), top(segmented, vec(q * 50), 10));
+    }
+    // the head keeps taking writes after the load
+    ASSERT_TRUE(loaded.add_vectors(vec(1800), all.data() + 1800, 500, {}).ok());
+    ASSERT_TRUE(loaded.wait_sealed().ok());
+    EXPECT_EQ(loaded.metrics().value().elements, 2299u);
+    EXPECT_EQ(top(loaded, vec(2000), 1)[0], 2000u);
+
+    size_t parts = segmented.num_segments() + 1;
+    std::remove(path.c_str());
+    for (size_t i = 0; i < parts; ++i) {
+        std::remove(phekda::SegmentedIndex::segment_path(path, i).c_str());
+    }
+}
+
+TEST_F(SegmentedIndexTest, save_with_a_writer) {
+    std::string path = "segmented_writer_index";
+    auto conf = segmented_config(phekda::IndexType::INDEX_HNSW_FLAT, true);
+    auto all = labels();
+    phekda::SegmentedIndex segmented;
+    ASSERT_TRUE(segmented.initialize(conf).ok());
+    ASSERT_TRUE(segmented.add_vectors(vec(0), all.data(), 300, {}).ok());
+
+    // labels go in in order, a save holds some prefix of them whole
+    std::thread writer([&] {
+        for (phekda::LabelType i = 300; i < 1300; ++i) {
+            ASSERT_TRUE(segmented.add_vector(vec(i), i, {}).ok());
+        }
+    });
+    auto rs = segmented.save(4, path, {});
+    writer.join();
+    ASSERT_TRUE(rs.ok());
+
+    phekda::SegmentedIndex loaded;
+    ASSERT_TRUE(loaded.load(path, conf).ok());
+    ASSERT_TRUE(loaded.wait_sealed().ok());
+    auto saved = loaded.metrics().value().elements;
+    ASSERT_GE(saved, 300u);
+    ASSERT_LE(saved, 1300u);
+    std::vector<float> out(d);
+    for (phekda::LabelType i = 0; i < saved; ++i) {
+        ASSERT_TRUE(loaded.get_vector(i, reinterpret_cast<uint8_t *>(out.data())).ok()) << i;
+        ASSERT_EQ(0, memcmp(out.data(), vec(i), d * sizeof(float)));
+    }
+    EXPECT_FALSE(loaded.get_vector(saved, reinterpret_cast<uint8_t *>(out.data())).ok());
+
+    std::remove(path.c_str());
+    for (size_t i = 0; i < 8; ++i) {
+        std::remove(phekda::SegmentedIndex::segment_path(path, i).c_str());
+    }
+}
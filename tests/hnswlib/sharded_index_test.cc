@@ -0,0 +1,176 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-29.
+//
+#include <phekda/sharded_index.h>
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <vector>
+
+class ShardedIndexTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    ShardedIndexTest() : TestVectors(8, 3000) {}
+
+    // shards of the flat index, searches are exact
+    phekda::IndexConfig sharded_config(size_t shards) const {
+        auto shard = make_config(n, phekda::test::hnsw_config(), phekda::IndexType::INDEX_HNSW_FLAT);
+        phekda::ShardedConfig sharded;
+        sharded.num_shards = shards;
+        sharded.shard_type = phekda::IndexType::INDEX_HNSW_FLAT;
+        sharded.shard_conf = shard.index_conf;
+        auto conf = shard;
+        conf.core.index_type = phekda::IndexType::INDEX_SHARDED;
+        conf.with_index(sharded);
+        return conf;
+    }
+};
+
+TEST_F(ShardedIndexTest, create_index) {
+    std::unique_ptr<phekda::UnifiedIndex> index(phekda::UnifiedIndex::create_index(phekda::IndexType::INDEX_SHARDED));
+    ASSERT_NE(index, nullptr);
+    ASSERT_TRUE(index->initialize(sharded_config(3)).ok());
+    EXPECT_EQ(static_cast<phekda::ShardedIndex *>(index.get())->num_shards(), 3u);
+
+    phekda::ShardedIndex bad;
+    EXPECT_FALSE(bad.initialize(make_config(n, phekda::test::hnsw_config(), phekda::IndexType::INDEX_SHARDED)).ok());
+    // no shards after the failed initialize
+    EXPECT_FALSE(bad.train({}).ok());
+    EXPECT_FALSE(bad.save(1, "sharded_bad_index", {}).ok());
+}
+
+TEST_F(ShardedIndexTest, same_results_as_one_index) {
+    phekda::HnswIndex single;
+    ASSERT_TRUE(single.initialize(make_config(n, phekda::test::hnsw_config(), phekda::IndexType::INDEX_HNSW_FLAT)).ok());
+    phekda::ShardedIndex sharded;
+    ASSERT_TRUE(sharded.initialize(sharded_config(4)).ok());
+    auto all = labels();
+    ASSERT_TRUE(single.add_vectors(vec(0), all.data(), n, {}).ok());
+    ASSERT_TRUE(sharded.add_vectors(vec(0), all.data(), n, {}).ok());
+
+    // every shard got a fair part
+    size_t total = 0;
+    for (size_t i = 0; i < sharded.num_shards(); ++i) {
+        auto elements = sharded.shard(i)->metrics().value().elements;
+        EXPECT_GT(elements, n / 8);
+        total += elements;
+    }
+    EXPECT_EQ(total, n);
+    EXPECT_EQ(sharded.metrics().value().elements, n);
+
+    for (phekda::LabelType q = 0; q < 50; ++q) {
+        auto expect = single.create_search_context();
+        expect.with_top_k(10).with_query(vec(q * 7));
+        ASSERT_TRUE(single.search(expect).ok());
+        auto context = sharded.create_search_context();
+        context.with_top_k(10).with_query(vec(q * 7)).with_with_raw_vector(true);
+        ASSERT_TRUE(sharded.search(context).ok());
+        ASSERT_EQ(context.results.size(), expect.results.size());
+        for (size_t i = 0; i < expect.results.size(); ++i) {
+            EXPECT_FLOAT_EQ(context.results[i].distance, expect.results[i].distance);
+            EXPECT_EQ(0, memcmp(context.raw_vector(i), vec(context.results[i].label), context.data_size));
+        }
+        EXPECT_EQ(context.results[0].label, q * 7);
+        EXPECT_EQ(context.stats.distance_computations, n);
+    }
+}
+
+TEST_F(ShardedIndexTest, reverse_result) {
+    phekda::ShardedIndex sharded;
+    ASSERT_TRUE(sharded.initialize(sharded_config(3)).ok());
+    auto all = labels();
+    ASSERT_TRUE(sharded.add_vectors(vec(0), all.data(), n, {}).ok());
+    auto context = sharded.create_search_context();
+    context.with_top_k(20).with_query(vec(5)).with_reverse_result(true).with_with_raw_vector(true);
+    ASSERT_TRUE(sharded.search(context).ok());
+    ASSERT_EQ(context.results.size(), 20u);
+    EXPECT_EQ(context.results.back().label, 5u);
+    for (size_t i = 1; i < context.results.size(); ++i) {
+        EXPECT_GE(context.results[i - 1].distance, context.results[i].distance);
+    }
+    for (size_t i = 0; i < context.results.size(); ++i) {
+        EXPECT_EQ(0, memcmp(context.raw_vector(i), vec(context.results[i].label), context.data_size));
+    }
+
+    // reversed without raw vectors, only the results move
+    auto plain = sharded.create_search_context();
+    plain.with_top_k(20).with_query(vec(5)).with_reverse_result(true);
+    ASSERT_TRUE(sharded.search(plain).ok());
+    ASSERT_EQ(plain.results.size(), 20u);
+    EXPECT_TRUE(plain.raw_vectors.empty());
+    for (size_t i = 0; i < plain.results.size(); ++i) {
+        EXPECT_EQ(plain.results[i].label, context.results[i].label);
+    }
+}
+
+TEST_F(ShardedIndexTest, get_and_delete) {
+    phekda::ShardedIndex sharded;
+    ASSERT_TRUE(sharded.initialize(sharded_config(3)).ok());
+    for (phekda::LabelType i = 0; i < 100; ++i) {
+        ASSERT_TRUE(sharded.add_vector(vec(i), i, {}).ok());
+    }
+    std::vector<float> out(d);
+    ASSERT_TRUE(sharded.get_vector(42, reinterpret_cast<uint8_t *>(out.data())).ok());
+    EXPECT_EQ(0, memcmp(out.data(), vec(42), d * sizeof(float)));
+    EXPECT_FALSE(sharded.get_vector(1000, reinterpret_cast<uint8_t *>(out.data())).ok());
+
+    ASSERT_TRUE(sharded.lazy_delete(42).ok());
+    auto context = sharded.create_search_context();
+    context.with_top_k(5).with_query(vec(42));
+    ASSERT_TRUE(sharded.search(context).ok());
+    for (auto &rez: context.results) {
+        EXPECT_NE(rez.label, 42u);
+    }
+    // the flat shards remove at once
+    EXPECT_EQ(sharded.metrics().value().elements, 99u);
+}
+
+TEST_F(ShardedIndexTest, save_load) {
+    std::string path = "sharded_test_index";
+    auto conf = sharded_config(3);
+    auto all = labels();
+    phekda::ShardedIndex sharded;
+    ASSERT_TRUE(sharded.initialize(conf).ok());
+    ASSERT_TRUE(sharded.add_vectors(vec(0), all.data(), n, {}).ok());
+    ASSERT_TRUE(sharded.save(0, path, {}).ok());
+
+    phekda::ShardedIndex loaded;
+    ASSERT_TRUE(loaded.load(path, conf).ok());
+    EXPECT_EQ(loaded.get_initialization_type(), phekda::IndexInitializationType::INIT_LOAD);
+    auto expect = sharded.create_search_context();
+    expect.with_top_k(10).with_query(vec(123));
+    ASSERT_TRUE(sharded.search(expect).ok());
+    auto context = loaded.create_search_context();
+    context.with_top_k(10).with_query(vec(123));
+    ASSERT_TRUE(loaded.search(context).ok());
+    ASSERT_EQ(context.results.size(), expect.results.size());
+    for (size_t i = 0; i < expect.results.size(); ++i) {
+        EXPECT_EQ(context.results[i].label, expect.results[i].label);
+    }
+
+    // the number of shards must match
+    phekda::ShardedIndex mismatch;
+    EXPECT_FALSE(mismatch.load(path, sharded_config(2)).ok());
+
+    std::remove(path.c_str());
+    for (size_t i = 0; i < 3; ++i) {
+        std::remove(phekda::ShardedIndex::shard_path(path, i).c_str());
+    }
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-6-22.
+//
+#include <phekda/hnswlib/index.h>
+#include "test_index_util.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+class SplitLayoutTest : public ::testing::Test, public phekda::test::TestVectors {
+public:
+    SplitLayoutTest() : TestVectors(13, 1000) {}
+
+    void SetUp() override {
+        config.random_seed = 123;
+        config.space = &space;
+    }
+
+    void build(phekda::HierarchicalNSW &alg, const phekda::HnswlibConfig &conf) {
+        ASSERT_TRUE(alg.initialize(core_config, conf).ok());
+        for (phekda::LabelType i = 0; i < n; ++i) {
+            // labels apart from the internal ids
+            ASSERT_TRUE(alg.addPoint(data.data() + i * d, i + 1000, phekda::kHnswNotReplaceDeleted).ok());
+        }
+        alg.setEf(50);
+    }
+
+    void expect_same_results(phekda::HierarchicalNSW &a, phekda::HierarchicalNSW &b) {
+        for (phekda::LabelType q = 0; q < 50; ++q) {
+            auto ra = a.searchKnnCloserFirst(data.data() + q * d, 10);
+            auto rb = b.searchKnnCloserFirst(data.data() + q * d, 10);
+            ASSERT_EQ(ra, rb);
+        }
+    }
+
+    phekda::L2Space space{static_cast<size_t>(d)};
+    phekda::CoreConfig core_config = make_core_config(n);
+    phekda::HnswlibConfig config = phekda::test::hnsw_config();
+};
+
+TEST_F(SplitLayoutTest, same_as_interleaved) {
+    phekda::HierarchicalNSW interleaved;
+    build(interleaved, config);
+    config.split_layout = true;
+    phekda::HierarchicalNSW split;
+    build(split, config);
+
+    // level 0 element only holds the links
+    EXPECT_EQ(split.size_data_per_element_, split.size_links_level0_);
+    EXPECT_EQ(split.vectors_.capacity(), split.data_level0_.capacity());
+    expect_same_results(interleaved, split);
+
+    std::vector<float> out(d);
+    ASSERT_TRUE(split.getVector(1005, out.data()).ok());
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin() + 5 * d));
+    ASSERT_TRUE(split.markDelete(1005).ok());
+    auto res = split.searchKnnCloserFirst(data.data() + 5 * d, 1);
+    ASSERT_EQ(res.size(), 1);
+    EXPECT_NE(res[0].second, 1005);
+}
+
+TEST_F(SplitLayoutTest, save_load_across_layouts) {
+    config.alignment = 64;
+    phekda::HierarchicalNSW interleaved;
+    build(interleaved, config);
+    ASSERT_TRUE(interleaved.saveIndex("split_layout_index", 1).ok());
+
+    // interleaved file loaded into split layout
+    phekda::HnswlibConfig load_config;
+    load_config.space = &space;
+    load_config.split_layout = true;
+    phekda::HierarchicalNSW split;
+    ASSERT_TRUE(split.loadIndex("split_layout_index", core_config, load_config).ok());
+    EXPECT_TRUE(split.get_index_config().split_layout);
+    EXPECT_EQ(split.get_index_config().alignment, 64);
+    split.setEf(50);
+    expect_same_results(interleaved, split);
+    for (phekda::LocationType i = 0; i < n; ++i) {
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(split.getDataByInternalId(i)) % 64, 0);
+    }
+
+    // saved again from split layout, the file is readable as before
+    ASSERT_TRUE(split.saveIndex("split_layout_index", 2).ok());
+    phekda::HierarchicalNSW reloaded;
+    load_config.split_layout = false;
+    core_config.max_elements = 2 * n;
+    ASSERT_TRUE(reloaded.loadIndex("split_layout_index", core_config, load_config).ok());
+    EXPECT_TRUE(reloaded.get_index_config().split_layout);
+    reloaded.setEf(50);
+    expect_same_results(interleaved, reloaded);
+    ASSERT_TRUE(reloaded.addPoint(data.data(), 5000, phekda::kHnswNotReplaceDeleted).ok());
+    std::vector<float> out(d);
+    ASSERT_TRUE(reloaded.getVector(5000, out.data()).ok());
+    EXPECT_TRUE(std::equal(out.begin(), out.end(), data.begin()));
+}
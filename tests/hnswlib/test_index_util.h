@@ -0,0 +1,107 @@
+//
+// Copyright (C) 2024 EA group inc.
+// Author: Jeff.li lijippy@163.com
+// All rights reserved.
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published
+// by the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+//
+//
+// Created by jeff on 24-7-2.
+//
+#pragma once
+
+#include <phekda/unified.h>
+#include <phekda/hnswlib/hnswlib.h>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace phekda::test {
+
+    // the graph parameters most tests build with
+    inline HnswlibConfig hnsw_config(size_t M = 16, size_t ef_construction = 100) {
+        HnswlibConfig config;
+        config.M = M;
+        config.ef_construction = ef_construction;
+        return config;
+    }
+
+    // count random rows of dimension floats, the same seed for every test
+    template<typename Alloc = std::allocator<float>>
+    class BasicTestVectors {
+    public:
+        BasicTestVectors(int dimension, LabelType count) : d(dimension), n(count) {
+            std::mt19937 rng(47);
+            std::uniform_real_distribution<> distrib;
+            data.resize(n * d);
+            for (auto &v: data) {
+                v = distrib(rng);
+            }
+        }
+
+        const uint8_t *vec(LabelType i) const {
+            return reinterpret_cast<const uint8_t *>(data.data() + i * d);
+        }
+
+        // the label of every row, 0 to n - 1
+        std::vector<LabelType> labels() const {
+            std::vector<LabelType> all(n);
+            for (LabelType i = 0; i < n; ++i) {
+                all[i] = i;
+            }
+            return all;
+        }
+
+        IndexConfig make_config(size_t max_elements, const HnswlibConfig &config,
+                               IndexType type = IndexType::INDEX_HNSWLIB) const {
+            IndexConfig conf;
+            conf.with_dimension(d)
+                    .with_metric(MetricType::METRIC_L2)
+                    .with_data_type(DataType::FLOAT32)
+                    .with_max_elements(max_elements)
+                    .with_index(config);
+            conf.core.index_type = type;
+            return conf;
+        }
+
+        // for the tests that drive HierarchicalNSW directly
+        CoreConfig make_core_config(size_t max_elements) const {
+            return make_config(max_elements, HnswlibConfig()).core;
+        }
+
+        // initializes the index and adds every row, row i under label i + label_offset
+        turbo::Status build(UnifiedIndex &index, const IndexConfig &conf, LabelType label_offset = 0) const {
+            auto rs = index.initialize(conf);
+            if (!rs.ok()) {
+                return rs;
+            }
+            for (LabelType i = 0; i < n; ++i) {
+                rs = index.add_vector(vec(i), i + label_offset, {});
+                if (!rs.ok()) {
+                    return rs;
+                }
+            }
+            return turbo::OkStatus();
+        }
+
+        int d;
+        LabelType n;
+        std::vector<float, Alloc> data;
+    };
+
+    class TestVectors : public BasicTestVectors<> {
+    public:
+        using BasicTestVectors::BasicTestVectors;
+    };
+
+}  // namespace phekda::test
@@ -169,14 +169,14 @@ test_vs_recall(
     for (size_t ef : efs) {
         appr_alg.setEf(ef);
 
-        appr_alg.metric_hops = 0;
-        appr_alg.metric_distance_computations = 0;
+        appr_alg.resetSearchStats();
         StopW stopw = StopW();
 
         float recall = test_approx(queries, qsize, appr_alg, vecdim, answers, k);
         float time_us_per_query = stopw.getElapsedTimeMicro() / qsize;
-        float distance_comp_per_query =  appr_alg.metric_distance_computations / (1.0f * qsize);
-        float hops_per_query =  appr_alg.metric_hops / (1.0f * qsize);
+        auto stats = appr_alg.getSearchStats();
+        float distance_comp_per_query =  stats.distance_computations / (1.0f * qsize);
+        float hops_per_query =  stats.hops / (1.0f * qsize);
 
         std::cout << ef << "\t" << recall << "\t" << time_us_per_query << "us \t" << hops_per_query << "\t" << distance_comp_per_query << "\n";
         if (recall > 0.99) {